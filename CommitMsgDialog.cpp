@@ -22,11 +22,210 @@
 #include <wx/intl.h>
 #include <wx/string.h>
 //*)
+#include <wx/dcmemory.h>
+#include <wx/imaglist.h>
+#include <wx/renderer.h>
+#include "VcsStatusTable.h"
+
+namespace
+{
+// Rows above and below the selected one whose patches are computed ahead
+const long kPrefetchRows = 2;
+
+enum CheckImage
+{
+    Check_Off,
+    Check_On
+};
+
+wxBitmap CheckBitmap(wxWindow* window, int flags)
+{
+    wxBitmap bitmap(16, 16);
+    wxMemoryDC dc(bitmap);
+    dc.SetBackground(*wxWHITE_BRUSH);
+    dc.Clear();
+    wxRendererNative::Get().DrawCheckBox(window, dc, wxRect(0, 0, 16, 16), flags);
+    dc.SelectObject(wxNullBitmap);
+    return bitmap;
+}
+
+wxString StateName(ItemState state)
+{
+    switch(state)
+    {
+    case Item_Added:
+        return _("Added");
+    case Item_Modified:
+        return _("Modified");
+    case Item_Removed:
+        return _("Removed");
+    case Item_Conflicted:
+        return _("Conflicted");
+    default:
+        return wxEmptyString;
+    }
+}
+}
+
+BEGIN_EVENT_TABLE(CommitFileList,wxListCtrl)
+    EVT_LEFT_DOWN(CommitFileList::OnLeftDown)
+    EVT_LIST_KEY_DOWN(wxID_ANY, CommitFileList::OnKeyDown)
+END_EVENT_TABLE()
+
+CommitFileList::CommitFileList(wxWindow* parent, wxWindowID id, const wxPoint& pos, const wxSize& size) :
+    wxListCtrl(parent, id, pos, size, wxLC_REPORT|wxLC_VIRTUAL),
+    m_StatusTable(0)
+{
+    wxImageList* images = new wxImageList(16, 16, true, 2);
+    images->Add(CheckBitmap(this, 0));
+    images->Add(CheckBitmap(this, wxCONTROL_CHECKED));
+    AssignImageList(images, wxIMAGE_LIST_SMALL);
+
+    InsertColumn(0, _("File"), wxLIST_FORMAT_LEFT, size.GetWidth() - 140);
+    InsertColumn(1, _("State"), wxLIST_FORMAT_LEFT, 110);
+}
+
+void CommitFileList::SetPaths(std::vector<wxString>& paths, const VcsStatusTable& statusTable)
+{
+    m_Paths.swap(paths);
+    m_StatusTable = &statusTable;
+    m_Checked.Clear();
+    m_Checked.Add(0, m_Paths.size());
+    SetFilter(wxEmptyString);
+}
+
+void CommitFileList::SetFilter(const wxString& filter)
+{
+    m_Visible.clear();
+    wxString lowerFilter = filter.Lower();
+    for(size_t i = 0; i < m_Paths.size(); i++)
+    {
+        if(lowerFilter.empty() || m_Paths[i].Lower().Find(lowerFilter) != wxNOT_FOUND)
+        {
+            m_Visible.push_back(i);
+        }
+    }
+    SetItemCount(m_Visible.size());
+    Refresh();
+}
+
+void CommitFileList::CheckVisible(bool check)
+{
+    // m_Visible is sorted, so each run of consecutive indices is one range
+    size_t row = 0;
+    while(row < m_Visible.size())
+    {
+        size_t first = m_Visible[row];
+        size_t last = first + 1;
+        for(row++; row < m_Visible.size() && m_Visible[row] == last; row++)
+        {
+            last++;
+        }
+        m_Checked.Set(first, last, check);
+    }
+    Refresh();
+    NotifyToggled();
+}
+
+wxString CommitFileList::OnGetItemText(long item, long column) const
+{
+    if(item < 0 || static_cast<size_t>(item) >= m_Visible.size())
+    {
+        return wxEmptyString;
+    }
+    const wxString& path = m_Paths[m_Visible[item]];
+    if(column == 0)
+    {
+        return path;
+    }
+    ItemState state;
+    if(m_StatusTable && m_StatusTable->Lookup(path, state))
+    {
+        return StateName(state);
+    }
+    return wxEmptyString;
+}
+
+int CommitFileList::OnGetItemImage(long item) const
+{
+    if(item < 0 || static_cast<size_t>(item) >= m_Visible.size())
+    {
+        return -1;
+    }
+    return IsChecked(m_Visible[item]) ? Check_On : Check_Off;
+}
+
+bool CommitFileList::GetRowPath(long row, wxString& path) const
+{
+    if(row < 0 || static_cast<size_t>(row) >= m_Visible.size())
+    {
+        return false;
+    }
+    path = m_Paths[m_Visible[row]];
+    return true;
+}
+
+void CommitFileList::Toggle(long row)
+{
+    if(row < 0 || static_cast<size_t>(row) >= m_Visible.size())
+    {
+        return;
+    }
+    size_t index = m_Visible[row];
+    m_Checked.Set(index, index + 1, !IsChecked(index));
+    RefreshItem(row);
+    NotifyToggled();
+}
+
+void CommitFileList::NotifyToggled()
+{
+    wxCommandEvent event(wxEVT_COMMAND_CHECKLISTBOX_TOGGLED, GetId());
+    event.SetEventObject(this);
+    GetEventHandler()->ProcessEvent(event);
+}
+
+void CommitFileList::OnLeftDown(wxMouseEvent& event)
+{
+    int flags = 0;
+    long row = HitTest(event.GetPosition(), flags);
+    if(row != wxNOT_FOUND && (flags & wxLIST_HITTEST_ONITEMICON))
+    {
+        Toggle(row);
+    }
+    event.Skip();
+}
+
+void CommitFileList::OnKeyDown(wxListEvent& event)
+{
+    if(event.GetKeyCode() != WXK_SPACE)
+    {
+        event.Skip();
+        return;
+    }
+    // Toggle the whole selection to the opposite of the focused row
+    long focused = GetFocusedItem();
+    if(focused == wxNOT_FOUND)
+    {
+        return;
+    }
+    bool check = !IsChecked(m_Visible[focused]);
+    for(long row = GetFirstSelected(); row != wxNOT_FOUND; row = GetNextSelected(row))
+    {
+        m_Checked.Set(m_Visible[row], m_Visible[row] + 1, check);
+    }
+    m_Checked.Set(m_Visible[focused], m_Visible[focused] + 1, check);
+    Refresh();
+    NotifyToggled();
+}
 
 //(*IdInit(CommitMsgDialog)
 const long CommitMsgDialog::ID_SUMMARY1 = wxNewId();
 const long CommitMsgDialog::ID_DETAILS = wxNewId();
 const long CommitMsgDialog::ID_FILELIST = wxNewId();
+const long CommitMsgDialog::ID_FILTER = wxNewId();
+const long CommitMsgDialog::ID_SELECTALL = wxNewId();
+const long CommitMsgDialog::ID_SELECTNONE = wxNewId();
+const long CommitMsgDialog::ID_PATCH = wxNewId();
 //*)
 
 BEGIN_EVENT_TABLE(CommitMsgDialog,wxScrollingDialog)
@@ -34,13 +233,15 @@ BEGIN_EVENT_TABLE(CommitMsgDialog,wxScrollingDialog)
 	//*)
 END_EVENT_TABLE()
 
-CommitMsgDialog::CommitMsgDialog(wxWindow* parent, wxString& msg, wxArrayString& CommitList) :
-    m_msg(msg)
+CommitMsgDialog::CommitMsgDialog(wxWindow* parent, wxString& msg, std::vector<wxString>& CommitList, const VcsStatusTable& statusTable,
+                                 VcsDiffPreview::PatchFunction patchFunction) :
+    m_msg(msg),
+    m_Preview(patchFunction, [this](const wxString& path) { CallAfter(&CommitMsgDialog::OnPatchReady, path); })
 {
     const int id = wxID_ANY;    // I'm sick of fighting the resource editor
 	//(*Initialize(CommitMsgDialog)
 	Create(parent, id, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE, _T("id"));
-	SetClientSize(wxSize(567,585));
+	SetClientSize(wxSize(1067,585));
 	Move(wxDefaultPosition);
 	new wxStaticText(this, wxID_ANY, _("Summary of changes:"), wxPoint(16,8), wxDefaultSize, 0, _T("wxID_ANY"));
 	m_Summary = new wxTextCtrl(this, ID_SUMMARY1, _("Brief summary of changes"), wxPoint(16,32), wxSize(536,27), 0, wxDefaultValidator, _T("ID_SUMMARY1"));
@@ -50,29 +251,48 @@ CommitMsgDialog::CommitMsgDialog(wxWindow* parent, wxString& msg, wxArrayString&
 	m_OkButton = new wxButton(this, wxID_OK, wxEmptyString, wxPoint(464,544), wxDefaultSize, 0, wxDefaultValidator, _T("wxID_OK"));
 	m_OkButton->SetDefault();
 	new wxButton(this, wxID_CANCEL, wxEmptyString, wxPoint(368,544), wxDefaultSize, 0, wxDefaultValidator, _T("wxID_CANCEL"));
-	m_FileList = new wxCheckListBox(this, ID_FILELIST, wxPoint(16,392), wxSize(536,136), 0, 0, 0, wxDefaultValidator, _T("ID_FILELIST"));
+	m_FileList = new CommitFileList(this,ID_FILELIST,wxPoint(16,400),wxSize(536,128));
 	new wxStaticText(this, wxID_ANY, _("File list:"), wxPoint(16,368), wxDefaultSize, 0, _T("wxID_ANY"));
+	m_Filter = new wxTextCtrl(this, ID_FILTER, wxEmptyString, wxPoint(88,364), wxSize(272,27), 0, wxDefaultValidator, _T("ID_FILTER"));
+	new wxButton(this, ID_SELECTALL, _("Select all"), wxPoint(368,364), wxDefaultSize, 0, wxDefaultValidator, _T("ID_SELECTALL"));
+	new wxButton(this, ID_SELECTNONE, _("Select none"), wxPoint(464,364), wxDefaultSize, 0, wxDefaultValidator, _T("ID_SELECTNONE"));
+	new wxStaticText(this, wxID_ANY, _("Preview:"), wxPoint(568,8), wxDefaultSize, 0, _T("wxID_ANY"));
+	m_Patch = new wxTextCtrl(this, ID_PATCH, wxEmptyString, wxPoint(568,32), wxSize(484,496), wxTE_MULTILINE|wxTE_READONLY|wxTE_DONTWRAP|wxHSCROLL, wxDefaultValidator, _T("ID_PATCH"));
 
 	Connect(ID_SUMMARY1,wxEVT_COMMAND_TEXT_UPDATED,(wxObjectEventFunction)&CommitMsgDialog::OnMessageChange);
 	Connect(ID_DETAILS,wxEVT_COMMAND_TEXT_UPDATED,(wxObjectEventFunction)&CommitMsgDialog::OnMessageChange);
-	Connect(ID_FILELIST,wxEVT_COMMAND_CHECKLISTBOX_TOGGLED,(wxObjectEventFunction)&CommitMsgDialog::OnMessageChange);
+	Connect(ID_FILTER,wxEVT_COMMAND_TEXT_UPDATED,(wxObjectEventFunction)&CommitMsgDialog::OnFilterChange);
+	Connect(ID_SELECTALL,wxEVT_COMMAND_BUTTON_CLICKED,(wxObjectEventFunction)&CommitMsgDialog::OnSelectAll);
+	Connect(ID_SELECTNONE,wxEVT_COMMAND_BUTTON_CLICKED,(wxObjectEventFunction)&CommitMsgDialog::OnSelectNone);
 	//*)
 
-    SetCommitList(CommitList);
-}
-
-void CommitMsgDialog::SetCommitList(wxArrayString& CommitList)
-{
-    m_FileList->Set(CommitList);
-
-    for(unsigned int i=0; i<CommitList.size(); i++)
+    // The file list reports its checkboxes the way a wxCheckListBox would
+    Connect(ID_FILELIST,wxEVT_COMMAND_CHECKLISTBOX_TOGGLED,(wxObjectEventFunction)&CommitMsgDialog::OnMessageChange);
+    Connect(ID_FILELIST,wxEVT_COMMAND_LIST_ITEM_SELECTED,(wxObjectEventFunction)&CommitMsgDialog::OnFileSelected);
+    m_Patch->SetFont(wxFont(9, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+    m_Filter->SetHint(_("Filter"));
+    m_FileList->SetPaths(CommitList, statusTable);
+    // A message passed in, such as the one a merge leaves, is offered for editing
+    if (!msg.IsEmpty())
     {
-        m_FileList->Check(i);
+        // A first line longer than the summary allows is kept whole in the details, for the user to shorten
+        const wxString summary = msg.BeforeFirst(wxT('\n'));
+        if (summary.length() <= 50)
+        {
+            m_Summary->ChangeValue(summary);
+            m_Details->ChangeValue(msg.AfterFirst(wxT('\n')).Trim(false));
+        }
+        else
+        {
+            m_Summary->ChangeValue(wxEmptyString);
+            m_Details->ChangeValue(msg);
+        }
     }
 }
 
 CommitMsgDialog::~CommitMsgDialog()
 {
+    m_Preview.Stop();
 	//(*Destroy(CommitMsgDialog)
 	//*)
 }
@@ -83,37 +303,92 @@ void CommitMsgDialog::EndModal(int retCode)
     {
         m_msg = m_Summary->GetValue();
         wxString details = m_Details->GetValue();
-        if (!details.empty())
+        if (!details.empty() && !m_msg.empty())
             m_msg += _("\n\n") + details;
+        else if (!details.empty())
+            m_msg = details;
     }
 
+    m_Preview.Stop();
     wxScrollingDialog::EndModal(retCode);
 }
 
 bool CommitMsgDialog::IsSelectionValid(void)
 {
-    unsigned int i;
+    return m_FileList->HasChecked();
+}
+
+void CommitMsgDialog::OnMessageChange(wxCommandEvent& event)
+{
+    if((m_Summary->GetValue().size() + m_Details->GetValue().size()) != 0
+       && IsSelectionValid())
+    {
+        m_OkButton->Enable();
+    }
+    else
+    {
+        m_OkButton->Disable();
+    }
+}
+
+void CommitMsgDialog::OnFilterChange(wxCommandEvent& event)
+{
+    m_FileList->SetFilter(m_Filter->GetValue());
+}
+
+void CommitMsgDialog::OnSelectAll(wxCommandEvent& event)
+{
+    m_FileList->CheckVisible(true);
+}
 
-    for(i=0; i<m_FileList->GetCount(); i++)
+void CommitMsgDialog::OnSelectNone(wxCommandEvent& event)
+{
+    m_FileList->CheckVisible(false);
+}
+
+void CommitMsgDialog::OnFileSelected(wxListEvent& event)
+{
+    long row = event.GetIndex();
+    if(!m_FileList->GetRowPath(row, m_PreviewPath))
     {
-        if(m_FileList->IsChecked(i))
+        return;
+    }
+    std::vector<wxString> neighbours;
+    for(long distance = 1; distance <= kPrefetchRows; distance++)
+    {
+        wxString path;
+        if(m_FileList->GetRowPath(row + distance, path))
+        {
+            neighbours.push_back(path);
+        }
+        if(m_FileList->GetRowPath(row - distance, path))
         {
-            return true;
+            neighbours.push_back(path);
         }
     }
+    ShowPatch(m_Preview.Request(m_PreviewPath, neighbours));
+}
 
-    return false;
+void CommitMsgDialog::OnPatchReady(wxString path)
+{
+    if(path == m_PreviewPath)
+    {
+        ShowPatch(m_Preview.Lookup(path));
+    }
 }
 
-void CommitMsgDialog::OnMessageChange(wxCommandEvent& event)
+void CommitMsgDialog::ShowPatch(const VcsDiffPreview::Patch& patch)
 {
-    if((m_Summary->GetValue().size() + m_Details->GetValue().size()) != 0
-       && IsSelectionValid())
+    if(!patch)
     {
-        m_OkButton->Enable();
+        m_Patch->ChangeValue(_("Computing diff..."));
+    }
+    else if(patch->empty())
+    {
+        m_Patch->ChangeValue(_("No changes to show"));
     }
     else
     {
-        m_OkButton->Disable();
+        m_Patch->ChangeValue(wxString::FromUTF8(patch->data(), patch->size()));
     }
 }
@@ -21,26 +21,77 @@
 //(*Headers(CommitMsgDialog)
 #include <wx/stattext.h>
 #include <wx/textctrl.h>
-#include <wx/checklst.h>
+#include <wx/listctrl.h>
 #include <wx/button.h>
 #include "scrollingdialog.h"
 //*)
+#include <vector>
+#include "VcsDiffPreview.h"
+#include "VcsRangeSet.h"
+
+class VcsStatusTable;
+
+/** Virtual list of the files offered for commit.
+ *
+ * Rows are drawn on demand from the path list and the status table, so
+ * the control stays cheap however many files are changed. Checked files
+ * are held as ranges of indices into the path list.
+ */
+class CommitFileList : public wxListCtrl
+{
+    public:
+        CommitFileList(wxWindow* parent, wxWindowID id, const wxPoint& pos, const wxSize& size);
+
+        /** Show paths (relative to the VCS root), all of them checked */
+        void SetPaths(std::vector<wxString>& paths, const VcsStatusTable& statusTable);
+        /** Only show the paths containing filter, ignoring case */
+        void SetFilter(const wxString& filter);
+        /** Check or uncheck every row that passes the filter */
+        void CheckVisible(bool check);
+        bool IsChecked(size_t index) const { return m_Checked.Contains(index); }
+        bool HasChecked() const { return !m_Checked.IsEmpty(); }
+        /** \return false if row is past the filtered rows */
+        bool GetRowPath(long row, wxString& path) const;
+
+    protected:
+        virtual wxString OnGetItemText(long item, long column) const;
+        virtual int OnGetItemImage(long item) const;
+
+    private:
+        std::vector<wxString> m_Paths;
+        const VcsStatusTable* m_StatusTable;
+        /** Index into m_Paths of each row */
+        std::vector<size_t> m_Visible;
+        VcsRangeSet m_Checked;
+
+        void Toggle(long row);
+        void NotifyToggled();
+        void OnLeftDown(wxMouseEvent& event);
+        void OnKeyDown(wxListEvent& event);
+
+        DECLARE_EVENT_TABLE()
+};
 
 class CommitMsgDialog: public wxScrollingDialog
 {
 	public:
 
-		CommitMsgDialog(wxWindow* parent, wxString& msg, wxArrayString& CommitList);
+		CommitMsgDialog(wxWindow* parent, wxString& msg, std::vector<wxString>& CommitList, const VcsStatusTable& statusTable,
+                        VcsDiffPreview::PatchFunction patchFunction);
 		virtual ~CommitMsgDialog();
 
 		//(*Declarations(CommitMsgDialog)
 		wxButton* m_OkButton;
 		wxTextCtrl* m_Details;
 		wxTextCtrl* m_Summary;
-		wxCheckListBox* m_FileList;
+		wxTextCtrl* m_Filter;
+		wxTextCtrl* m_Patch;
+		CommitFileList* m_FileList;
 		//*)
 
 		virtual void EndModal( int retCode );
+		/** Whether the file at index of the commit list was left checked */
+		bool IsChecked(size_t index) const { return m_FileList->IsChecked(index); }
 
 	protected:
 
@@ -48,16 +99,28 @@ class CommitMsgDialog: public wxScrollingDialog
 		static const long ID_SUMMARY1;
 		static const long ID_DETAILS;
 		static const long ID_FILELIST;
+		static const long ID_FILTER;
+		static const long ID_SELECTALL;
+		static const long ID_SELECTNONE;
+		static const long ID_PATCH;
 		//*)
 
 	private:
         wxString& m_msg;
+        VcsDiffPreview m_Preview;
+        /** File whose patch the preview pane shows or waits for */
+        wxString m_PreviewPath;
 
         bool IsSelectionValid(void);
-        void SetCommitList(wxArrayString& CommitList);
+        void ShowPatch(const VcsDiffPreview::Patch& patch);
+        void OnPatchReady(wxString path);
+        void OnFileSelected(wxListEvent& event);
 
 		//(*Handlers(CommitMsgDialog)
 		void OnMessageChange(wxCommandEvent& event);
+		void OnFilterChange(wxCommandEvent& event);
+		void OnSelectAll(wxCommandEvent& event);
+		void OnSelectNone(wxCommandEvent& event);
 		//*)
 
 		DECLARE_EVENT_TABLE()
@@ -24,7 +24,11 @@ IVersionControlSystem::IVersionControlSystem(const wxString& project,
                                              VcsFileOp* commit,
                                              VcsFileOp* diff,
                                              VcsFileOp* restore,
-                                             VcsFileOp* updateFull) :
+                                             VcsFileOp* updateFull,
+                                             VcsFileOp* checkout,
+                                             VcsFileOp* merge,
+                                             VcsFileOp* stash,
+                                             VcsFileOp* fetch) :
     UpdateOp(update),
     AddOp(add),
     RemoveOp(remove),
@@ -32,6 +36,10 @@ IVersionControlSystem::IVersionControlSystem(const wxString& project,
     DiffOp(diff),
     RestoreOp(restore),
     UpdateFullOp(updateFull),
+    CheckoutOp(checkout),
+    MergeOp(merge),
+    StashOp(stash),
+    FetchOp(fetch),
     m_project(project)
 {
     //ctor
@@ -19,13 +19,54 @@
 #define IVERSIONCONTROLSYSTEM_H
 
 #include <globals.h>
+#include <functional>
 #include <vector>
 #include <map>
 
 class wxString;
 class ProjectFile;
+class VcsBlameTable;
+class VcsCommitTable;
 
 #include "VcsFileOp.h"
+#include "VcsLineDiff.h"
+#include "VcsStatusTable.h"
+
+/** Where HEAD points, as shown next to the project */
+struct VcsBranchInfo
+{
+    /** Empty when HEAD is detached */
+    wxString branch;
+    /** Abbreviated commit id, empty before the first commit */
+    wxString head;
+    bool detached;
+    /** Empty when the branch has no upstream */
+    wxString upstream;
+    /** Whether ahead and behind were worked out yet */
+    bool countsKnown;
+    size_t ahead;
+    size_t behind;
+
+    VcsBranchInfo() : detached(false), countsKnown(false), ahead(0), behind(0) {}
+};
+
+/** Refs that can be listed */
+enum VcsRefKind
+{
+    VcsRef_Branch,
+    VcsRef_Tag,
+    /** Stash entries, listed newest first as "stash@{n}: message" */
+    VcsRef_Stash
+};
+
+/** What the next StashOp does */
+enum VcsStashAction
+{
+    VcsStash_Save,
+    VcsStash_Apply,
+    /** Apply, then drop the entry if it applied */
+    VcsStash_Pop
+};
 
 class IVersionControlSystem
 {
@@ -37,7 +78,11 @@ class IVersionControlSystem
                               VcsFileOp* commit,
                               VcsFileOp* diff,
                               VcsFileOp* restore,
-                              VcsFileOp* updateFull);
+                              VcsFileOp* updateFull,
+                              VcsFileOp* checkout,
+                              VcsFileOp* merge,
+                              VcsFileOp* stash,
+                              VcsFileOp* fetch);
         virtual ~IVersionControlSystem();
 
         VcsFileOp* UpdateOp;
@@ -48,11 +93,105 @@ class IVersionControlSystem
         VcsFileOp* DiffOp;
         VcsFileOp* RestoreOp;
         VcsFileOp* UpdateFullOp;
+        /** Switches the working tree to another branch; the items are the project files, whose states it sets */
+        VcsFileOp* CheckoutOp;
+        /** Merges a branch into HEAD, leaving conflicts in the working tree; the items are the project files, whose states it sets */
+        VcsFileOp* MergeOp;
+        /** Saves local changes to the stash or applies an entry; the items are the project files, whose states it sets */
+        VcsFileOp* StashOp;
+        /** Fetches from the remote of the current branch, and fast-forwards the branch when pulling; the items are the project files */
+        VcsFileOp* FetchOp;
         virtual wxString GetBranch() { return wxEmptyString; }
+        /** Branch, HEAD and upstream, cheap enough to ask for on every editor activation
+         * \return false if the VCS has no such notion
+         */
+        virtual bool GetBranchInfo(VcsBranchInfo& /*info*/) { return false; }
+        virtual wxString GetRoot() const { return wxEmptyString; }
+        /** Select what the next DiffOp compares against. revision is only used for VcsDiff_Revision */
+        virtual void SetDiffTarget(VcsDiffTarget /*target*/, const wxString& /*revision*/) {}
+        /** Select where the next RestoreOp takes the files from. revision is only used for VcsRestore_Revision */
+        virtual void SetRestoreSource(VcsRestoreSource /*source*/, const wxString& /*revision*/) {}
+        /** Select the branch or tag the next CheckoutOp switches to. A tag detaches HEAD at its commit */
+        virtual void SetCheckoutTarget(VcsRefKind /*kind*/, const wxString& /*name*/) {}
+        /** Select the branch the next MergeOp merges into HEAD */
+        virtual void SetMergeSource(const wxString& /*branch*/) {}
+        /** Select what the next StashOp does. entry is used to apply and pop, message and keepIndex to save */
+        virtual void SetStashAction(VcsStashAction /*action*/, size_t /*entry*/, const wxString& /*message*/, bool /*keepIndex*/) {}
+        /** Select whether the next FetchOp also fast-forwards the current branch to its upstream */
+        virtual void SetPull(bool /*pull*/) {}
+        /** Called with each ref name; returns false to stop listing */
+        typedef std::function<bool(const wxString&)> RefHandler;
+        /** List the short names of the refs of kind, without resolving what they point at. Runs on a worker */
+        virtual bool ListRefs(VcsRefKind /*kind*/, const RefHandler& /*handler*/) { return false; }
+        /** Create branch name at HEAD, and make it the current branch if checkout is set.
+         *  The working tree is left as it is either way. Reports failures itself.
+         */
+        virtual bool CreateBranch(const wxString& /*name*/, bool /*checkout*/) { return false; }
+        /** Tag HEAD as name, with an annotated tag if message is not empty and a lightweight one otherwise.
+         *  Reports failures itself.
+         */
+        virtual bool CreateTag(const wxString& /*name*/, const wxString& /*message*/) { return false; }
+        /** Conflicted path merged afresh from the stages in the index, with diff3 style markers around each conflict.
+         *  If the working tree file was edited since the merge, it is returned instead. Runs on a worker.
+         */
+        virtual bool GetConflict(const wxString& /*path*/, std::string& /*merged*/) { return false; }
+        /** Write the resolved content of path to the working tree and replace its conflict stages with one index entry */
+        virtual bool ResolveConflict(const wxString& /*path*/, const std::string& /*content*/) { return false; }
+        /** Staged content of path, as it would be checked out.
+         * \param id identifies the content, it is only loaded when it differs from the id passed in
+         * \return false if path is not in the index
+         */
+        virtual bool GetIndexedFile(const wxString& /*path*/, std::string& /*id*/, std::string& /*content*/) { return false; }
+        /** State of path for a working copy equal to the index (unchanged) and for one that differs from it (changed).
+         *  Only the index and HEAD are looked at, never the file itself.
+         */
+        virtual bool GetIndexedStates(const wxString& /*path*/, ItemState& /*unchanged*/, ItemState& /*changed*/) { return false; }
+        /** Keep the repository and its index open for the GetIndexedFile() and GetIndexedStates() calls made until
+         *  EndIndexPass(), for callers that look at several files in one go
+         */
+        virtual void BeginIndexPass() {}
+        virtual void EndIndexPass() {}
+        /** Id the VCS would give buffer as file content */
+        virtual bool HashBuffer(const char* /*data*/, size_t /*length*/, std::string& /*id*/) { return false; }
+        /** Line hunks turning base into buffer, without context lines */
+        virtual bool DiffBuffers(const std::string& /*base*/, const std::string& /*buffer*/, std::vector<VcsLineHunk>& /*hunks*/) { return false; }
+        /** UTF-8 patch of the changes a commit of path would record, empty if there are none.
+         *  Safe to call from any thread.
+         */
+        virtual bool GetCommitPatch(const wxString& /*path*/, std::string& /*patch*/) { return false; }
+        /** Stage the changes of path touching working copy lines [first, last] (0 based), leaving the others unstaged
+         * \param wholeHunks stage every hunk that is touched rather than just the lines
+         * \return false if nothing could be staged
+         */
+        virtual bool StageLines(const wxString& /*path*/, int /*first*/, int /*last*/, bool /*wholeHunks*/) { return false; }
+        /** Called after each full page of history was added, and now and then while commits are skipped; returns false to stop reading */
+        typedef std::function<bool()> HistoryPageHandler;
+        /** Add the commits that changed path (all of them for an empty path) to table, newest first.
+         *  Runs on a worker, and stays there until pageRead asks to stop or the history ends.
+         */
+        virtual bool ReadHistory(const wxString& /*path*/, VcsCommitTable& /*table*/, const HistoryPageHandler& /*pageRead*/) { return false; }
+        /** Fill table with the commit that last changed each line of buffer, the content of path as an editor holds it.
+         *  Runs on a worker. The blame of the committed file is kept, so blaming an edited buffer again only diffs it.
+         */
+        virtual bool BlameBuffer(const wxString& /*path*/, const std::string& /*buffer*/, VcsBlameTable& /*table*/) { return false; }
+        VcsStatusTable& GetStatusTable() { return m_StatusTable; }
+
+        /** paths are the files whose states were set, relative to the root as VcsTreeItem::GetRelativeName() gives them */
+        typedef std::function<void(const std::vector<wxString>& paths)> StatesChangedHandler;
+        void SetStatesChangedHandler(StatesChangedHandler handler) { m_StatesChangedHandler = handler; }
+        /** Called on the UI thread after new states have been visualised */
+        void NotifyStatesChanged(const std::vector<wxString>& paths) { if (m_StatesChangedHandler) m_StatesChangedHandler(paths); }
+        typedef std::function<void()> BranchChangedHandler;
+        void SetBranchChangedHandler(BranchChangedHandler handler) { m_BranchChangedHandler = handler; }
+        /** Called on the UI thread when only what GetBranchInfo() reports changed, e.g. the ahead and behind counts */
+        void NotifyBranchChanged() { if (m_BranchChangedHandler) m_BranchChangedHandler(); }
 
     protected:
         const wxString& m_project;
+        VcsStatusTable m_StatusTable;
     private:
+        StatesChangedHandler m_StatesChangedHandler;
+        BranchChangedHandler m_BranchChangedHandler;
 };
 
 #endif // IVERSIONCONTROLSYSTEM_H
@@ -0,0 +1,324 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <sdk.h> // Code::Blocks SDK
+#include <cbeditor.h>
+#include <cbproject.h>
+#include <cbstyledtextctrl.h>
+#include <editor_hooks.h>
+#include <logmanager.h>
+#include <projectfile.h>
+#include <algorithm>
+#include <wx/datetime.h>
+
+#include "VcsBlameGutter.h"
+#include "IVersionControlSystem.h"
+#include "VcsFileItem.h"
+#include "vcstrackermap.h"
+
+namespace
+{
+const int idBlameTimer = wxNewId();
+// Typing pause after which the buffer is blamed again
+const int kUpdateDelay = 500;
+// cbEditor uses the margins before this one for line numbers, markers, the change bar and folding
+const int kBlameMargin = 4;
+const int kMarginPadding = 8;
+
+wxString GetLabel(const VcsBlameHunk& hunk)
+{
+    if(hunk.id.empty())
+    {
+        return _("Not committed");
+    }
+    return wxString::FromUTF8(hunk.id.substr(0, 8).c_str()) + _T("  ")
+           + wxDateTime(hunk.time).Format(_T("%Y-%m-%d")) + _T("  ") + hunk.author;
+}
+}
+
+BEGIN_EVENT_TABLE(VcsBlameGutter, wxEvtHandler)
+    EVT_TIMER( idBlameTimer, VcsBlameGutter::OnTimer )
+END_EVENT_TABLE()
+
+VcsBlameGutter::VcsBlameGutter(VcsTrackerMap& trackers) :
+    m_Trackers(trackers),
+    m_Timer(this, idBlameTimer),
+    m_HookId(-1),
+    m_Generation(0),
+    m_Running(0),
+    m_Abort(false)
+{
+}
+
+VcsBlameGutter::~VcsBlameGutter()
+{
+    Detach();
+}
+
+void VcsBlameGutter::Attach()
+{
+    if(m_HookId == -1)
+    {
+        m_HookId = EditorHooks::RegisterHook(new EditorHooks::HookFunctor<VcsBlameGutter>(this, &VcsBlameGutter::OnEditorHook));
+    }
+}
+
+void VcsBlameGutter::Detach()
+{
+    m_Timer.Stop();
+    if(m_HookId != -1)
+    {
+        EditorHooks::UnregisterHook(m_HookId, true);
+        m_HookId = -1;
+    }
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Abort = true;
+        m_Requests.clear();
+        m_Wake.notify_one();
+    }
+    if(m_Worker.joinable())
+    {
+        m_Worker.join();
+    }
+    m_Abort = false;
+    m_Editors.clear();
+}
+
+IVersionControlSystem* VcsBlameGutter::GetVcs(cbEditor* editor, wxString& relativePath)
+{
+    ProjectFile* pf = editor->GetProjectFile();
+    if(!pf || !pf->GetParentProject())
+    {
+        return 0;
+    }
+    vcsProjectTracker* prjTracker = m_Trackers.GetTracker(pf->GetParentProject()->GetFilename());
+    if(!prjTracker)
+    {
+        return 0;
+    }
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    relativePath = VcsFileItem(pf).GetRelativeName(vcs.GetRoot());
+    if(relativePath.IsEmpty())
+    {
+        return 0;
+    }
+    return &vcs;
+}
+
+bool VcsBlameGutter::IsShown(cbEditor* editor) const
+{
+    return m_Editors.find(editor) != m_Editors.end();
+}
+
+void VcsBlameGutter::Toggle(cbEditor* editor)
+{
+    if(!editor)
+    {
+        return;
+    }
+    if(IsShown(editor))
+    {
+        Remove(editor);
+        cbStyledTextCtrl* ctrl = editor->GetControl();
+        if(ctrl)
+        {
+            // Margin text belongs to the document, both split views show it
+            ctrl->MarginTextClearAll();
+        }
+        ShowMargin(editor->GetLeftSplitViewControl(), 0);
+        ShowMargin(editor->GetRightSplitViewControl(), 0);
+        return;
+    }
+    Blame(editor, m_Editors[editor]);
+}
+
+void VcsBlameGutter::Refresh(IVersionControlSystem& vcs, const std::vector<wxString>& paths, bool headMoved)
+{
+    for(auto& editor : m_Editors)
+    {
+        wxString relativePath;
+        if(GetVcs(editor.first, relativePath) != &vcs)
+        {
+            continue;
+        }
+        // Only a new HEAD changes the committed side of a blame; a state change may mean the file was replaced
+        if(headMoved || std::find(paths.begin(), paths.end(), relativePath) != paths.end())
+        {
+            Blame(editor.first, editor.second);
+        }
+    }
+}
+
+void VcsBlameGutter::Remove(cbEditor* editor)
+{
+    m_Editors.erase(editor);
+}
+
+void VcsBlameGutter::Forget(IVersionControlSystem& vcs)
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for(auto it = m_Requests.begin(); it != m_Requests.end();)
+    {
+        it = (it->vcs == &vcs) ? m_Requests.erase(it) : it + 1;
+    }
+    m_Idle.wait(lock, [this, &vcs]() { return m_Running != &vcs; });
+}
+
+void VcsBlameGutter::Blame(cbEditor* editor, EditorBlame& blame)
+{
+    wxString relativePath;
+    IVersionControlSystem* vcs = GetVcs(editor, relativePath);
+    cbStyledTextCtrl* ctrl = editor->GetControl();
+    if(!vcs || !ctrl)
+    {
+        return;
+    }
+    blame.dirty = false;
+    blame.generation = ++m_Generation;
+    wxCharBuffer text = ctrl->GetTextRaw();
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    // A blame still waiting for the editor is outdated by this one
+    for(auto it = m_Requests.begin(); it != m_Requests.end(); ++it)
+    {
+        if(it->editor == editor)
+        {
+            m_Requests.erase(it);
+            break;
+        }
+    }
+    Request request;
+    request.editor = editor;
+    request.vcs = vcs;
+    request.path = relativePath;
+    request.buffer.assign(text.data(), text.length());
+    request.generation = blame.generation;
+    m_Requests.push_back(std::move(request));
+    if(!m_Worker.joinable())
+    {
+        m_Worker = std::thread(&VcsBlameGutter::Run, this);
+    }
+    m_Wake.notify_one();
+}
+
+void VcsBlameGutter::Run()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for(;;)
+    {
+        m_Wake.wait(lock, [this]() { return m_Abort || !m_Requests.empty(); });
+        if(m_Abort)
+        {
+            return;
+        }
+        Request request = std::move(m_Requests.front());
+        m_Requests.pop_front();
+        m_Running = request.vcs;
+        lock.unlock();
+
+        std::shared_ptr<Result> result = std::make_shared<Result>();
+        result->editor = request.editor;
+        result->generation = request.generation;
+        result->blamed = request.vcs->BlameBuffer(request.path, request.buffer, result->table);
+        CallAfter(&VcsBlameGutter::OnBlamed, result);
+
+        lock.lock();
+        m_Running = 0;
+        m_Idle.notify_all();
+    }
+}
+
+void VcsBlameGutter::OnBlamed(std::shared_ptr<Result> result)
+{
+    auto it = m_Editors.find(result->editor);
+    if(it == m_Editors.end() || it->second.generation != result->generation)
+    {
+        return;
+    }
+    cbStyledTextCtrl* ctrl = result->editor->GetControl();
+    if(!ctrl)
+    {
+        return;
+    }
+    if(!result->blamed)
+    {
+        Manager::Get()->GetLogManager()->Log(_("cbvcs: blame failed for ") + result->editor->GetFilename());
+        return;
+    }
+
+    // Lines keep their margin text while text is inserted above them, so only the labels that moved or changed are set
+    const int lineCount = ctrl->GetLineCount();
+    int width = it->second.width;
+    for(int line = 0; line < lineCount; ++line)
+    {
+        const VcsBlameHunk* hunk = result->table.Find(line);
+        const wxString label = (hunk && hunk->start == line) ? GetLabel(*hunk) : wxString();
+        if(ctrl->MarginGetText(line) != label)
+        {
+            ctrl->MarginSetText(line, label);
+            ctrl->MarginSetStyle(line, wxSCI_STYLE_LINENUMBER);
+        }
+        if(!label.IsEmpty())
+        {
+            width = std::max(width, ctrl->TextWidth(wxSCI_STYLE_LINENUMBER, label) + kMarginPadding);
+        }
+    }
+    if(width != it->second.width)
+    {
+        it->second.width = width;
+        ShowMargin(result->editor->GetLeftSplitViewControl(), width);
+        ShowMargin(result->editor->GetRightSplitViewControl(), width);
+    }
+}
+
+void VcsBlameGutter::ShowMargin(cbStyledTextCtrl* ctrl, int width)
+{
+    if(!ctrl)
+    {
+        return;
+    }
+    ctrl->SetMarginType(kBlameMargin, wxSCI_MARGIN_TEXT);
+    ctrl->SetMarginWidth(kBlameMargin, width);
+}
+
+void VcsBlameGutter::OnEditorHook(cbEditor* editor, wxScintillaEvent& event)
+{
+    if(event.GetEventType() != wxEVT_SCI_MODIFIED
+       || !(event.GetModificationType() & (wxSCI_MOD_INSERTTEXT | wxSCI_MOD_DELETETEXT)))
+    {
+        return;
+    }
+    auto it = m_Editors.find(editor);
+    if(it == m_Editors.end())
+    {
+        return;
+    }
+    it->second.dirty = true;
+    m_Timer.StartOnce(kUpdateDelay);
+}
+
+void VcsBlameGutter::OnTimer(wxTimerEvent& /*event*/)
+{
+    for(auto& editor : m_Editors)
+    {
+        if(editor.second.dirty)
+        {
+            Blame(editor.first, editor.second);
+        }
+    }
+}
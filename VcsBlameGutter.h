@@ -0,0 +1,118 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSBLAMEGUTTER_H
+#define VCSBLAMEGUTTER_H
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <wx/event.h>
+#include <wx/timer.h>
+#include "copyprotector.h"
+#include "VcsBlameTable.h"
+
+class cbEditor;
+class cbStyledTextCtrl;
+class IVersionControlSystem;
+class VcsTrackerMap;
+class wxScintillaEvent;
+
+/** Blame annotations in a margin of the editors they are turned on for.
+ *
+ * The buffer is blamed on a worker, against a blame of the committed
+ * file that the VCS keeps, so turning blame on again, or blaming after
+ * an edit, only costs a diff of the buffer. Edits are blamed once typing
+ * has paused, and only the lines whose annotation changed are rewritten.
+ */
+class VcsBlameGutter : public wxEvtHandler, private CopyProtector
+{
+    public:
+        explicit VcsBlameGutter(VcsTrackerMap& trackers);
+        /** Default destructor, stops the worker */
+        virtual ~VcsBlameGutter();
+
+        void Attach();
+        void Detach();
+        bool IsShown(cbEditor* editor) const;
+        /** Show the blame of editor, or hide it if it is shown */
+        void Toggle(cbEditor* editor);
+        /** Blame the shown editors of vcs again, those whose files are among paths or all of them if HEAD moved */
+        void Refresh(IVersionControlSystem& vcs, const std::vector<wxString>& paths, bool headMoved);
+        void Remove(cbEditor* editor);
+        /** Drop the blames waiting for vcs and wait for the one running, vcs is about to go away */
+        void Forget(IVersionControlSystem& vcs);
+
+    protected:
+    private:
+        struct Request
+        {
+            cbEditor* editor;
+            IVersionControlSystem* vcs;
+            wxString path;
+            std::string buffer;
+            unsigned generation;
+        };
+        struct Result
+        {
+            cbEditor* editor;
+            unsigned generation;
+            bool blamed;
+            VcsBlameTable table;
+        };
+        struct EditorBlame
+        {
+            /** Of the last blame asked for; earlier results are dropped */
+            unsigned generation;
+            bool dirty;
+            int width;
+
+            EditorBlame() : generation(0), dirty(false), width(0) {}
+        };
+
+        VcsTrackerMap& m_Trackers;
+        std::map<cbEditor*, EditorBlame> m_Editors;
+        wxTimer m_Timer;
+        int m_HookId;
+        unsigned m_Generation;
+
+        std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        std::condition_variable m_Idle;
+        std::deque<Request> m_Requests;
+        /** VCS the worker is blaming with, 0 when idle */
+        IVersionControlSystem* m_Running;
+        bool m_Abort;
+        std::thread m_Worker;
+
+        IVersionControlSystem* GetVcs(cbEditor* editor, wxString& relativePath);
+        void Blame(cbEditor* editor, EditorBlame& blame);
+        void Run();
+        void OnBlamed(std::shared_ptr<Result> result);
+        void ShowMargin(cbStyledTextCtrl* ctrl, int width);
+        void OnEditorHook(cbEditor* editor, wxScintillaEvent& event);
+        void OnTimer(wxTimerEvent& event);
+
+        DECLARE_EVENT_TABLE()
+};
+
+#endif // VCSBLAMEGUTTER_H
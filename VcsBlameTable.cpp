@@ -0,0 +1,47 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsBlameTable.h"
+#include <algorithm>
+
+void VcsBlameTable::Append(int start, int lines, const std::string& id, const char* author, time_t time)
+{
+    VcsBlameHunk hunk;
+    hunk.start = start;
+    hunk.lines = lines;
+    hunk.id = id;
+    hunk.author = wxString::FromUTF8(author ? author : "");
+    hunk.time = time;
+    m_Hunks.push_back(hunk);
+}
+
+const VcsBlameHunk* VcsBlameTable::Find(int line) const
+{
+    auto it = std::upper_bound(m_Hunks.begin(), m_Hunks.end(), line,
+                               [](int value, const VcsBlameHunk& hunk) { return value < hunk.start; });
+    if(it == m_Hunks.begin())
+    {
+        return 0;
+    }
+    --it;
+    return (line < it->start + it->lines) ? &*it : 0;
+}
+
+int VcsBlameTable::GetLineCount() const
+{
+    return m_Hunks.empty() ? 0 : m_Hunks.back().start + m_Hunks.back().lines;
+}
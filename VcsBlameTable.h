@@ -0,0 +1,59 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSBLAMETABLE_H
+#define VCSBLAMETABLE_H
+
+#include <ctime>
+#include <string>
+#include <vector>
+#include <wx/string.h>
+
+/** Lines last changed by one commit, or not committed yet */
+struct VcsBlameHunk
+{
+    /** First line, 0 based */
+    int start;
+    int lines;
+    /** Full commit id, empty for lines that are not committed */
+    std::string id;
+    wxString author;
+    time_t time;
+
+    VcsBlameHunk() : start(0), lines(0), time(0) {}
+};
+
+/** Blame of a file as an editor holds it: the hunks, in line order, that
+ * tell for each line which commit changed it last.
+ */
+class VcsBlameTable
+{
+    public:
+        /** Add the hunk after the others. author is UTF-8 */
+        void Append(int start, int lines, const std::string& id, const char* author, time_t time);
+        /** \return the hunk holding line, or 0 past the last one */
+        const VcsBlameHunk* Find(int line) const;
+        const std::vector<VcsBlameHunk>& GetHunks() const { return m_Hunks; }
+        int GetLineCount() const;
+        void Clear() { m_Hunks.clear(); }
+
+    protected:
+    private:
+        std::vector<VcsBlameHunk> m_Hunks;
+};
+
+#endif // VCSBLAMETABLE_H
@@ -0,0 +1,169 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsBloomFilter.h"
+
+#include <set>
+
+namespace
+{
+const uint32_t kSeed0 = 0x293ae76f;
+const uint32_t kSeed1 = 0x7e646e2c;
+// Commits changing more paths get a filter that matches everything
+const size_t kMaxChangedPaths = 512;
+
+inline uint32_t RotateLeft(uint32_t value, int count)
+{
+    return (value << count) | (value >> (32 - count));
+}
+
+inline uint32_t ByteAt(const char* data, size_t index, uint32_t hashVersion)
+{
+    if(hashVersion == 1)
+    {
+        return static_cast<uint32_t>(static_cast<int32_t>(static_cast<signed char>(data[index])));
+    }
+    return static_cast<unsigned char>(data[index]);
+}
+}
+
+uint32_t VcsBloomFilter::Murmur3(const char* data, size_t length, uint32_t seed, uint32_t hashVersion)
+{
+    const uint32_t c1 = 0xcc9e2d51;
+    const uint32_t c2 = 0x1b873593;
+    uint32_t h = seed;
+    const size_t blocks = length / 4;
+    for(size_t i = 0; i < blocks; i++)
+    {
+        uint32_t k = ByteAt(data, 4 * i, hashVersion)
+                     | (ByteAt(data, 4 * i + 1, hashVersion) << 8)
+                     | (ByteAt(data, 4 * i + 2, hashVersion) << 16)
+                     | (ByteAt(data, 4 * i + 3, hashVersion) << 24);
+        k *= c1;
+        k = RotateLeft(k, 15);
+        k *= c2;
+        h ^= k;
+        h = RotateLeft(h, 13);
+        h = h * 5 + 0xe6546b64;
+    }
+
+    const size_t tail = blocks * 4;
+    uint32_t k1 = 0;
+    switch(length & 3)
+    {
+    case 3:
+        k1 ^= ByteAt(data, tail + 2, hashVersion) << 16;
+        // fall through
+    case 2:
+        k1 ^= ByteAt(data, tail + 1, hashVersion) << 8;
+        // fall through
+    case 1:
+        k1 ^= ByteAt(data, tail, hashVersion);
+        k1 *= c1;
+        k1 = RotateLeft(k1, 15);
+        k1 *= c2;
+        h ^= k1;
+        break;
+    default:
+        break;
+    }
+
+    h ^= static_cast<uint32_t>(length);
+    h ^= h >> 16;
+    h *= 0x85ebca6b;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35;
+    h ^= h >> 16;
+    return h;
+}
+
+VcsBloomFilter::Key VcsBloomFilter::MakeKey(const std::string& path, const Settings& settings)
+{
+    const uint32_t hash0 = Murmur3(path.data(), path.size(), kSeed0, settings.hashVersion);
+    const uint32_t hash1 = Murmur3(path.data(), path.size(), kSeed1, settings.hashVersion);
+    Key key(settings.numHashes);
+    for(uint32_t i = 0; i < settings.numHashes; i++)
+    {
+        key[i] = hash0 + i * hash1;
+    }
+    return key;
+}
+
+std::vector<VcsBloomFilter::Key> VcsBloomFilter::MakePathKeys(const std::string& path, const Settings& settings)
+{
+    std::vector<Key> keys;
+    keys.push_back(MakeKey(path, settings));
+    for(size_t slash = path.rfind('/'); slash != std::string::npos && slash > 0; slash = path.rfind('/', slash - 1))
+    {
+        keys.push_back(MakeKey(path.substr(0, slash), settings));
+    }
+    return keys;
+}
+
+std::string VcsBloomFilter::Build(const std::vector<std::string>& changedPaths, const Settings& settings)
+{
+    std::set<std::string> entries;
+    for(const std::string& path : changedPaths)
+    {
+        entries.insert(path);
+        for(size_t slash = path.find('/'); slash != std::string::npos; slash = path.find('/', slash + 1))
+        {
+            entries.insert(path.substr(0, slash));
+        }
+    }
+    if(entries.size() > kMaxChangedPaths)
+    {
+        return std::string(1, '\xff');
+    }
+    if(entries.empty())
+    {
+        return std::string(1, '\0');
+    }
+
+    std::string filter((entries.size() * settings.bitsPerEntry + 7) / 8, '\0');
+    const uint64_t bits = filter.size() * 8;
+    for(const std::string& entry : entries)
+    {
+        for(uint32_t hash : MakeKey(entry, settings))
+        {
+            const uint64_t bit = hash % bits;
+            filter[bit / 8] |= static_cast<char>(1 << (bit % 8));
+        }
+    }
+    return filter;
+}
+
+VcsBloomFilter::Result VcsBloomFilter::Lookup(const unsigned char* filter, size_t length, const std::vector<Key>& keys)
+{
+    if(!length)
+    {
+        return Bloom_Unknown;
+    }
+    const uint64_t bits = static_cast<uint64_t>(length) * 8;
+    for(const Key& key : keys)
+    {
+        for(uint32_t hash : key)
+        {
+            const uint64_t bit = hash % bits;
+            if(!(filter[bit / 8] & (1 << (bit % 8))))
+            {
+                return Bloom_No;
+            }
+        }
+    }
+    return Bloom_Maybe;
+}
@@ -0,0 +1,62 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSBLOOMFILTER_H
+#define VCSBLOOMFILTER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/** Changed-path Bloom filters, laid out the way git's commit-graph stores them.
+ *
+ * A filter holds every path a commit changed against its first parent,
+ * and every folder above those paths. A lookup that misses means the
+ * commit certainly did not touch the path; a hit still has to be checked.
+ */
+class VcsBloomFilter
+{
+    public:
+        struct Settings
+        {
+            /** 1 reproduces git's original hash, which sign extended bytes above 0x7f */
+            uint32_t hashVersion;
+            uint32_t numHashes;
+            uint32_t bitsPerEntry;
+
+            Settings() : hashVersion(2), numHashes(7), bitsPerEntry(10) {}
+        };
+        typedef std::vector<uint32_t> Key;
+
+        enum Result
+        {
+            Bloom_No,       ///< the path certainly did not change
+            Bloom_Maybe,    ///< the path may have changed
+            Bloom_Unknown   ///< there is no usable filter
+        };
+
+        static uint32_t Murmur3(const char* data, size_t length, uint32_t seed, uint32_t hashVersion);
+        static Key MakeKey(const std::string& path, const Settings& settings);
+        /** Keys of path and of each folder above it, all of which a filter must hold */
+        static std::vector<Key> MakePathKeys(const std::string& path, const Settings& settings);
+        /** Filter holding changedPaths and the folders above them */
+        static std::string Build(const std::vector<std::string>& changedPaths, const Settings& settings);
+        static Result Lookup(const unsigned char* filter, size_t length, const std::vector<Key>& keys);
+};
+
+#endif // VCSBLOOMFILTER_H
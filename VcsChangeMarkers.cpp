@@ -0,0 +1,341 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <sdk.h> // Code::Blocks SDK
+#include <cbeditor.h>
+#include <cbproject.h>
+#include <cbstyledtextctrl.h>
+#include <editor_hooks.h>
+#include <editormanager.h>
+#include <projectfile.h>
+
+#include "VcsChangeMarkers.h"
+#include "IVersionControlSystem.h"
+#include "VcsFileItem.h"
+#include "vcstrackermap.h"
+
+namespace
+{
+const int idChangeTimer = wxNewId();
+// Typing pause after which the edited lines are diffed again
+const int kUpdateDelay = 300;
+// cbEditor shows bookmarks and breakpoints in this margin
+const int kMarkerMargin = 1;
+const int kAddedMarker = 20;
+const int kModifiedMarker = 21;
+const int kDeletedMarker = 22;
+const int kMarkerMask = (1 << kAddedMarker) | (1 << kModifiedMarker) | (1 << kDeletedMarker);
+}
+
+BEGIN_EVENT_TABLE(VcsChangeMarkers, wxEvtHandler)
+    EVT_TIMER( idChangeTimer, VcsChangeMarkers::OnTimer )
+END_EVENT_TABLE()
+
+VcsChangeMarkers::VcsChangeMarkers(VcsTrackerMap& trackers) :
+    m_Trackers(trackers),
+    m_Timer(this, idChangeTimer),
+    m_HookId(-1)
+{
+}
+
+VcsChangeMarkers::~VcsChangeMarkers()
+{
+    Detach();
+}
+
+void VcsChangeMarkers::Attach()
+{
+    if(m_HookId == -1)
+    {
+        m_HookId = EditorHooks::RegisterHook(new EditorHooks::HookFunctor<VcsChangeMarkers>(this, &VcsChangeMarkers::OnEditorHook));
+    }
+}
+
+void VcsChangeMarkers::Detach()
+{
+    m_Timer.Stop();
+    if(m_HookId != -1)
+    {
+        EditorHooks::UnregisterHook(m_HookId, true);
+        m_HookId = -1;
+    }
+    m_Editors.clear();
+}
+
+IVersionControlSystem* VcsChangeMarkers::GetVcs(cbEditor* editor, wxString& relativePath)
+{
+    ProjectFile* pf = editor->GetProjectFile();
+    if(!pf || !pf->GetParentProject())
+    {
+        return 0;
+    }
+    vcsProjectTracker* prjTracker = m_Trackers.GetTracker(pf->GetParentProject()->GetFilename());
+    if(!prjTracker)
+    {
+        return 0;
+    }
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    relativePath = VcsFileItem(pf).GetRelativeName(vcs.GetRoot());
+    if(relativePath.IsEmpty())
+    {
+        return 0;
+    }
+    return &vcs;
+}
+
+void VcsChangeMarkers::DefineMarkers(cbStyledTextCtrl* ctrl)
+{
+    if(!ctrl)
+    {
+        return;
+    }
+    ctrl->MarkerDefine(kAddedMarker, wxSCI_MARK_LEFTRECT, wxColour(0x2e, 0xa0, 0x43), wxColour(0x2e, 0xa0, 0x43));
+    ctrl->MarkerDefine(kModifiedMarker, wxSCI_MARK_LEFTRECT, wxColour(0x1f, 0x6f, 0xd0), wxColour(0x1f, 0x6f, 0xd0));
+    ctrl->MarkerDefine(kDeletedMarker, wxSCI_MARK_LEFTRECT, wxColour(0xd0, 0x30, 0x30), wxColour(0xd0, 0x30, 0x30));
+    ctrl->SetMarginMask(kMarkerMargin, ctrl->GetMarginMask(kMarkerMargin) | kMarkerMask);
+}
+
+void VcsChangeMarkers::ReloadBase(cbEditor* editor)
+{
+    if(!editor)
+    {
+        return;
+    }
+    wxString relativePath;
+    IVersionControlSystem* vcs = GetVcs(editor, relativePath);
+    if(!vcs)
+    {
+        Remove(editor);
+        return;
+    }
+
+    std::unique_ptr<EditorChanges>& changes = m_Editors[editor];
+    if(!changes)
+    {
+        changes.reset(new EditorChanges);
+        DefineMarkers(editor->GetLeftSplitViewControl());
+        DefineMarkers(editor->GetRightSplitViewControl());
+    }
+
+    std::string content;
+    const std::string previousId = changes->baseId;
+    if(!vcs->GetIndexedFile(relativePath, changes->baseId, content))
+    {
+        changes->baseId.clear();
+        if(changes->diff.HasBase())
+        {
+            changes->diff.ClearBase();
+        }
+    }
+    else if(changes->baseId != previousId)
+    {
+        changes->diff.SetBase(content);
+        changes->baseHash.clear();
+        vcs->HashBuffer(content.data(), content.size(), changes->baseHash);
+    }
+    // A commit changes the state of an unchanged buffer without touching the index entry
+    changes->hasStates = changes->diff.HasBase() && vcs->GetIndexedStates(relativePath, changes->unchangedState, changes->changedState);
+    if(changes->diff.IsDirty())
+    {
+        UpdateMarkers(editor, *changes);
+    }
+}
+
+void VcsChangeMarkers::ReloadBases(IVersionControlSystem& vcs, const std::vector<wxString>& paths)
+{
+    // Few editors are open and many paths may have changed, so the editors are looked up by path
+    std::multimap<wxString, cbEditor*> editors;
+    EditorManager* editorManager = Manager::Get()->GetEditorManager();
+    for(int i = 0; i < editorManager->GetEditorsCount(); ++i)
+    {
+        cbEditor* editor = editorManager->GetBuiltinEditor(i);
+        wxString relativePath;
+        if(editor && GetVcs(editor, relativePath) == &vcs)
+        {
+            editors.insert(std::make_pair(relativePath, editor));
+        }
+    }
+    std::vector<cbEditor*> changed;
+    for(const wxString& path : paths)
+    {
+        auto range = editors.equal_range(path);
+        for(auto it = range.first; it != range.second; ++it)
+        {
+            changed.push_back(it->second);
+        }
+        editors.erase(range.first, range.second);
+    }
+    if(changed.empty())
+    {
+        return;
+    }
+    vcs.BeginIndexPass();
+    for(cbEditor* editor : changed)
+    {
+        ReloadBase(editor);
+    }
+    vcs.EndIndexPass();
+}
+
+void VcsChangeMarkers::Remove(cbEditor* editor)
+{
+    m_Editors.erase(editor);
+}
+
+bool VcsChangeMarkers::UpdateBufferState(cbEditor* editor)
+{
+    auto it = m_Editors.find(editor);
+    if(it == m_Editors.end())
+    {
+        return false;
+    }
+    EditorChanges& changes = *it->second;
+    if(!changes.hasStates || changes.baseHash.empty())
+    {
+        return false;
+    }
+    wxString relativePath;
+    IVersionControlSystem* vcs = GetVcs(editor, relativePath);
+    cbStyledTextCtrl* ctrl = editor->GetControl();
+    if(!vcs || !ctrl)
+    {
+        return false;
+    }
+    if(changes.bufferHash.empty())
+    {
+        wxCharBuffer text = ctrl->GetTextRaw();
+        if(!vcs->HashBuffer(text.data(), text.length(), changes.bufferHash))
+        {
+            return false;
+        }
+    }
+
+    const ItemState state = (changes.bufferHash == changes.baseHash) ? changes.unchangedState : changes.changedState;
+    VcsFileItem item(editor->GetProjectFile());
+    bool changed = vcs->GetStatusTable().Update(relativePath, state);
+    if(item.GetState() != state)
+    {
+        item.SetState(state);
+        item.VisualiseState();
+        changed = true;
+    }
+    if(changed)
+    {
+        vcs->NotifyStatesChanged(std::vector<wxString>(1, relativePath));
+    }
+    return true;
+}
+
+void VcsChangeMarkers::UpdateMarkers(cbEditor* editor, EditorChanges& changes)
+{
+    wxString relativePath;
+    IVersionControlSystem* vcs = GetVcs(editor, relativePath);
+    cbStyledTextCtrl* ctrl = editor->GetControl();
+    if(!vcs || !ctrl)
+    {
+        return;
+    }
+
+    const int lineCount = ctrl->GetLineCount();
+    VcsLineDiff::LineReader reader = [ctrl, lineCount](int first, int count)
+    {
+        const int start = ctrl->PositionFromLine(first);
+        const int end = (first + count < lineCount) ? ctrl->PositionFromLine(first + count) : ctrl->GetLength();
+        wxCharBuffer text = ctrl->GetTextRangeRaw(start, end);
+        return std::string(text.data(), text.length());
+    };
+    VcsLineDiff::DiffFunction diff = [vcs](const std::string& base, const std::string& buffer, std::vector<VcsLineHunk>& hunks)
+    {
+        return vcs->DiffBuffers(base, buffer, hunks);
+    };
+    int first, last;
+    changes.diff.Update(lineCount, reader, diff, first, last);
+
+    if(first == 0 && last >= lineCount)
+    {
+        ctrl->MarkerDeleteAll(kAddedMarker);
+        ctrl->MarkerDeleteAll(kModifiedMarker);
+        ctrl->MarkerDeleteAll(kDeletedMarker);
+    }
+    else
+    {
+        for(int line = first; line < last; ++line)
+        {
+            ctrl->MarkerDelete(line, kAddedMarker);
+            ctrl->MarkerDelete(line, kModifiedMarker);
+            ctrl->MarkerDelete(line, kDeletedMarker);
+        }
+    }
+
+    for(const VcsLineHunk& hunk : changes.diff.GetHunks())
+    {
+        if(hunk.newStart + hunk.newLines < first || hunk.newStart > last)
+        {
+            continue;
+        }
+        if(hunk.newLines == 0)
+        {
+            // Mark the line the removed lines followed
+            const int line = std::max(0, hunk.newStart - 1);
+            if(line >= first && line < last)
+            {
+                ctrl->MarkerAdd(line, kDeletedMarker);
+            }
+            continue;
+        }
+        const int marker = hunk.oldLines ? kModifiedMarker : kAddedMarker;
+        const int end = std::min(last, hunk.newStart + hunk.newLines);
+        for(int line = std::max(first, hunk.newStart); line < end; ++line)
+        {
+            ctrl->MarkerAdd(line, marker);
+        }
+    }
+}
+
+void VcsChangeMarkers::OnEditorHook(cbEditor* editor, wxScintillaEvent& event)
+{
+    if(event.GetEventType() != wxEVT_SCI_MODIFIED
+       || !(event.GetModificationType() & (wxSCI_MOD_INSERTTEXT | wxSCI_MOD_DELETETEXT)))
+    {
+        return;
+    }
+    auto it = m_Editors.find(editor);
+    if(it == m_Editors.end() || !it->second->diff.HasBase())
+    {
+        return;
+    }
+    it->second->bufferHash.clear();
+    cbStyledTextCtrl* ctrl = editor->GetControl();
+    it->second->diff.Edit(ctrl->LineFromPosition(event.GetPosition()), event.GetLinesAdded());
+    m_Timer.StartOnce(kUpdateDelay);
+}
+
+void VcsChangeMarkers::OnTimer(wxTimerEvent& /*event*/)
+{
+    for(auto& editor : m_Editors)
+    {
+        if(editor.second->diff.IsDirty())
+        {
+            UpdateMarkers(editor.first, *editor.second);
+        }
+        // At the save point the buffer matches the file, which the regular status update covers
+        if(editor.second->bufferHash.empty() && editor.first->GetModified())
+        {
+            UpdateBufferState(editor.first);
+        }
+    }
+}
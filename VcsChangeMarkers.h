@@ -0,0 +1,96 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSCHANGEMARKERS_H
+#define VCSCHANGEMARKERS_H
+
+#include <map>
+#include <memory>
+#include <vector>
+#include <wx/event.h>
+#include <wx/timer.h>
+#include "copyprotector.h"
+#include "VcsLineDiff.h"
+#include "VcsTreeItem.h"
+
+class cbEditor;
+class cbStyledTextCtrl;
+class IVersionControlSystem;
+class VcsTrackerMap;
+class wxScintillaEvent;
+
+/** Gutter markers for the lines of open editors that differ from the index.
+ *
+ * Each tracked editor keeps the staged version of its file in memory and
+ * is diffed against that, so unsaved edits show up straight away. Edits
+ * only mark lines dirty; the dirty region is re-diffed once typing has
+ * paused.
+ *
+ * The same staged version gives the file state of a modified buffer:
+ * the buffer hash is compared with the hash of the staged content, and
+ * is only recomputed after an edit.
+ */
+class VcsChangeMarkers : public wxEvtHandler, private CopyProtector
+{
+    public:
+        explicit VcsChangeMarkers(VcsTrackerMap& trackers);
+        virtual ~VcsChangeMarkers();
+
+        void Attach();
+        void Detach();
+        /** Start tracking editor, or reload its base if the staged file changed */
+        void ReloadBase(cbEditor* editor);
+        /** ReloadBase() the open editors of vcs whose files are among paths, sharing one look at the index */
+        void ReloadBases(IVersionControlSystem& vcs, const std::vector<wxString>& paths);
+        void Remove(cbEditor* editor);
+        /** Set the file state of editor from its buffer rather than the file on disk
+         * \return false if the state cannot be told without the VCS looking at the file
+         */
+        bool UpdateBufferState(cbEditor* editor);
+
+    protected:
+    private:
+        struct EditorChanges
+        {
+            VcsLineDiff diff;
+            std::string baseId;
+            /** Hash of the base as the editor holds it, i.e. after checkout filters */
+            std::string baseHash;
+            /** Hash of the buffer, empty once an edit made it stale */
+            std::string bufferHash;
+            bool hasStates;
+            ItemState unchangedState;
+            ItemState changedState;
+
+            EditorChanges() : hasStates(false), unchangedState(Item_UpToDate), changedState(Item_Modified) {}
+        };
+
+        VcsTrackerMap& m_Trackers;
+        std::map<cbEditor*, std::unique_ptr<EditorChanges>> m_Editors;
+        wxTimer m_Timer;
+        int m_HookId;
+
+        IVersionControlSystem* GetVcs(cbEditor* editor, wxString& relativePath);
+        void DefineMarkers(cbStyledTextCtrl* ctrl);
+        void UpdateMarkers(cbEditor* editor, EditorChanges& changes);
+        void OnEditorHook(cbEditor* editor, wxScintillaEvent& event);
+        void OnTimer(wxTimerEvent& event);
+
+        DECLARE_EVENT_TABLE()
+};
+
+#endif // VCSCHANGEMARKERS_H
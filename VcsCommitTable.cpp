@@ -0,0 +1,66 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsCommitTable.h"
+
+void VcsCommitTable::Append(const std::string& id, const char* author, const char* summary, time_t time)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    Record record;
+    record.time = time;
+    record.id = AddString(id.c_str());
+    record.author = AddString(author ? author : "");
+    record.summary = AddString(summary ? summary : "");
+    m_Records.push_back(record);
+}
+
+bool VcsCommitTable::Get(size_t index, VcsCommitInfo& info) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if(index >= m_Records.size())
+    {
+        return false;
+    }
+    const Record& record = m_Records[index];
+    const char* strings = m_Strings.c_str();
+    info.id = strings + record.id;
+    info.author = wxString::FromUTF8(strings + record.author);
+    info.summary = wxString::FromUTF8(strings + record.summary);
+    info.time = static_cast<time_t>(record.time);
+    return true;
+}
+
+size_t VcsCommitTable::Count() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Records.size();
+}
+
+void VcsCommitTable::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Records.clear();
+    m_Strings.clear();
+}
+
+uint32_t VcsCommitTable::AddString(const char* text)
+{
+    uint32_t offset = static_cast<uint32_t>(m_Strings.size());
+    m_Strings.append(text);
+    m_Strings.push_back('\0');
+    return offset;
+}
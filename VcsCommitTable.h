@@ -0,0 +1,81 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSCOMMITTABLE_H
+#define VCSCOMMITTABLE_H
+
+#include <cstdint>
+#include <ctime>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <wx/string.h>
+#include "copyprotector.h"
+
+/** Commit as listed in the history */
+struct VcsCommitInfo
+{
+    /** Full id, as the VCS prints it */
+    std::string id;
+    wxString author;
+    wxString summary;
+    time_t time;
+
+    VcsCommitInfo() : time(0) {}
+};
+
+/** Commits of a history, in the order they were read.
+ *
+ * Each commit takes one fixed size record, its strings are packed into a
+ * single buffer. A few hundred thousand commits stay cheap to hold, and
+ * rows are drawn without touching the repository. The table is filled
+ * by a worker while the UI reads it, so every access is locked.
+ */
+class VcsCommitTable : private CopyProtector
+{
+    public:
+        /** Default constructor */
+        VcsCommitTable() {}
+        /** Default destructor */
+        virtual ~VcsCommitTable() {}
+
+        /** Add a commit after the others. author and summary are UTF-8 */
+        void Append(const std::string& id, const char* author, const char* summary, time_t time);
+        /** \return false if index is past the commits read so far */
+        bool Get(size_t index, VcsCommitInfo& info) const;
+        size_t Count() const;
+        void Clear();
+
+    protected:
+    private:
+        struct Record
+        {
+            int64_t time;
+            /** Offsets into m_Strings of the NUL terminated strings */
+            uint32_t id;
+            uint32_t author;
+            uint32_t summary;
+        };
+
+        mutable std::mutex m_Mutex;
+        std::vector<Record> m_Records;
+        std::string m_Strings;
+
+        uint32_t AddString(const char* text);
+};
+
+#endif // VCSCOMMITTABLE_H
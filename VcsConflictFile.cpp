@@ -0,0 +1,149 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsConflictFile.h"
+
+namespace
+{
+const size_t kMarkerSize = 7;
+
+/** Whether line is a marker of c characters, alone or followed by a space and a label */
+bool IsMarker(const std::string& line, char c)
+{
+    if(line.size() < kMarkerSize || line.compare(0, kMarkerSize, std::string(kMarkerSize, c)) != 0)
+    {
+        return false;
+    }
+    const char next = line.size() > kMarkerSize ? line[kMarkerSize] : '\n';
+    return next == ' ' || next == '\n' || next == '\r';
+}
+
+enum Section
+{
+    Section_Text,
+    Section_Ours,
+    Section_Base,
+    Section_Theirs
+};
+}
+
+size_t VcsConflictFile::Parse(const std::string& merged)
+{
+    m_Text.assign(1, std::string());
+    m_Regions.clear();
+    VcsConflictRegion region;
+    Section section = Section_Text;
+    int lineNumber = 0;
+    for(size_t start = 0; start < merged.size(); ++lineNumber)
+    {
+        size_t end = merged.find('\n', start);
+        end = (end == std::string::npos) ? merged.size() : end + 1;
+        const std::string line = merged.substr(start, end - start);
+        start = end;
+
+        if(section == Section_Text)
+        {
+            if(IsMarker(line, '<'))
+            {
+                region = VcsConflictRegion();
+                region.line = lineNumber;
+                region.marked = line;
+                section = Section_Ours;
+            }
+            else
+            {
+                m_Text.back() += line;
+            }
+            continue;
+        }
+        region.marked += line;
+        if(section == Section_Ours && IsMarker(line, '|'))
+        {
+            region.hasBase = true;
+            section = Section_Base;
+        }
+        else if(section != Section_Theirs && IsMarker(line, '='))
+        {
+            section = Section_Theirs;
+        }
+        else if(section == Section_Theirs && IsMarker(line, '>'))
+        {
+            m_Regions.push_back(region);
+            m_Text.push_back(std::string());
+            section = Section_Text;
+        }
+        else
+        {
+            (section == Section_Ours ? region.ours : section == Section_Base ? region.base : region.theirs) += line;
+        }
+    }
+    if(section != Section_Text)
+    {
+        m_Text.back() += region.marked;
+    }
+    m_Resolutions.assign(m_Regions.size(), Conflict_Unresolved);
+    m_Unresolved = m_Regions.size();
+    return m_Regions.size();
+}
+
+bool VcsConflictFile::Resolve(size_t region, Resolution resolution)
+{
+    // Taking a base that is not there would drop both sides
+    if(resolution == Conflict_Base && !m_Regions[region].hasBase)
+    {
+        return false;
+    }
+    if(m_Resolutions[region] == Conflict_Unresolved)
+    {
+        --m_Unresolved;
+    }
+    if(resolution == Conflict_Unresolved)
+    {
+        ++m_Unresolved;
+    }
+    m_Resolutions[region] = resolution;
+    return true;
+}
+
+std::string VcsConflictFile::Compose() const
+{
+    std::string composed = m_Text[0];
+    for(size_t i = 0; i < m_Regions.size(); ++i)
+    {
+        const VcsConflictRegion& region = m_Regions[i];
+        switch(m_Resolutions[i])
+        {
+        case Conflict_Ours:
+            composed += region.ours;
+            break;
+        case Conflict_Theirs:
+            composed += region.theirs;
+            break;
+        case Conflict_Both:
+            composed += region.ours + region.theirs;
+            break;
+        case Conflict_Base:
+            composed += region.base;
+            break;
+        default:
+            composed += region.marked;
+            break;
+        }
+        composed += m_Text[i + 1];
+    }
+    return composed;
+}
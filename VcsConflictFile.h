@@ -0,0 +1,77 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSCONFLICTFILE_H
+#define VCSCONFLICTFILE_H
+
+#include <string>
+#include <vector>
+
+/** The two sides of a conflict and their common ancestor. Line ends are kept. */
+struct VcsConflictRegion
+{
+    /** First line of the region in the marked up file, 0 based */
+    int line;
+    std::string ours;
+    std::string base;
+    std::string theirs;
+    /** Whether the region had a ||||||| section. Two way markers leave base empty without one */
+    bool hasBase{false};
+    /** The region as marked up, put back while it is unresolved */
+    std::string marked;
+};
+
+/** A conflicted file, split into the text both sides agree on and the
+ * conflict regions between it. The regions are read from the diff3 style
+ * markers a three way merge writes: <<<<<<<, |||||||, ======= and >>>>>>>.
+ */
+class VcsConflictFile
+{
+    public:
+        enum Resolution
+        {
+            Conflict_Unresolved,
+            Conflict_Ours,
+            Conflict_Theirs,
+            /** Ours followed by theirs */
+            Conflict_Both,
+            Conflict_Base
+        };
+
+        /** Split merged into regions; a region left open at the end is taken as text.
+         * \return the number of regions
+         */
+        size_t Parse(const std::string& merged);
+        size_t GetRegionCount() const { return m_Regions.size(); }
+        const VcsConflictRegion& GetRegion(size_t region) const { return m_Regions[region]; }
+        Resolution GetResolution(size_t region) const { return m_Resolutions[region]; }
+        /** \return false, leaving the region as it was, for Conflict_Base on a region without a base */
+        bool Resolve(size_t region, Resolution resolution);
+        size_t GetUnresolvedCount() const { return m_Unresolved; }
+        /** The file with each region replaced by its resolution, unresolved ones still marked up */
+        std::string Compose() const;
+
+    protected:
+    private:
+        /** Text before each region, and after the last one */
+        std::vector<std::string> m_Text;
+        std::vector<VcsConflictRegion> m_Regions;
+        std::vector<Resolution> m_Resolutions;
+        size_t m_Unresolved{0};
+};
+
+#endif // VCSCONFLICTFILE_H
@@ -0,0 +1,257 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsConflictView.h"
+
+#include <wx/button.h>
+#include <wx/listctrl.h>
+#include <wx/sizer.h>
+#include <wx/stattext.h>
+#include <wx/textctrl.h>
+
+namespace
+{
+const long ID_REGIONS = wxNewId();
+const long ID_OURS = wxNewId();
+const long ID_THEIRS = wxNewId();
+const long ID_BOTH = wxNewId();
+const long ID_BASE = wxNewId();
+
+enum Column
+{
+    Column_Line,
+    Column_Resolution
+};
+
+wxString ResolutionName(VcsConflictFile::Resolution resolution)
+{
+    switch(resolution)
+    {
+    case VcsConflictFile::Conflict_Ours:
+        return _("Ours");
+    case VcsConflictFile::Conflict_Theirs:
+        return _("Theirs");
+    case VcsConflictFile::Conflict_Both:
+        return _("Both");
+    case VcsConflictFile::Conflict_Base:
+        return _("Base");
+    default:
+        return _("Unresolved");
+    }
+}
+}
+
+/** Virtual list drawing its rows from the regions of the view's file */
+class VcsConflictRegionList : public wxListCtrl
+{
+    public:
+        explicit VcsConflictRegionList(VcsConflictView* view) :
+            wxListCtrl(view, ID_REGIONS, wxDefaultPosition, wxSize(220, 320), wxLC_REPORT|wxLC_VIRTUAL|wxLC_SINGLE_SEL),
+            m_View(view)
+        {
+            InsertColumn(Column_Line, _("Line"), wxLIST_FORMAT_RIGHT, 70);
+            InsertColumn(Column_Resolution, _("Resolution"), wxLIST_FORMAT_LEFT, 130);
+        }
+
+    protected:
+        virtual wxString OnGetItemText(long item, long column) const
+        {
+            const VcsConflictFile& file = m_View->GetFile();
+            if(item < 0 || size_t(item) >= file.GetRegionCount())
+            {
+                return wxEmptyString;
+            }
+            if(column == Column_Line)
+            {
+                return wxString::Format(wxT("%d"), file.GetRegion(item).line + 1);
+            }
+            return ResolutionName(file.GetResolution(item));
+        }
+
+    private:
+        VcsConflictView* m_View;
+};
+
+BEGIN_EVENT_TABLE(VcsConflictView, wxDialog)
+    EVT_LIST_ITEM_SELECTED( ID_REGIONS, VcsConflictView::OnSelected )
+    EVT_BUTTON( ID_OURS, VcsConflictView::OnTake )
+    EVT_BUTTON( ID_THEIRS, VcsConflictView::OnTake )
+    EVT_BUTTON( ID_BOTH, VcsConflictView::OnTake )
+    EVT_BUTTON( ID_BASE, VcsConflictView::OnTake )
+END_EVENT_TABLE()
+
+VcsConflictView::VcsConflictView(wxWindow* parent, IVersionControlSystem& vcs, const wxString& path) :
+    wxDialog(parent, wxID_ANY, _("Resolve conflicts in ") + path, wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE|wxRESIZE_BORDER),
+    m_Loaded(false)
+{
+    const wxString labels[3] = { _("Ours"), _("Base"), _("Theirs") };
+    wxBoxSizer* sides = new wxBoxSizer(wxHORIZONTAL);
+    m_List = new VcsConflictRegionList(this);
+    sides->Add(m_List, 0, wxALL|wxEXPAND, 4);
+    for(int i = 0; i < 3; ++i)
+    {
+        wxBoxSizer* side = new wxBoxSizer(wxVERTICAL);
+        m_Sides[i] = new wxTextCtrl(this, wxID_ANY, wxEmptyString, wxDefaultPosition, wxSize(300, 300),
+                                    wxTE_MULTILINE|wxTE_READONLY|wxTE_DONTWRAP|wxHSCROLL);
+        m_Sides[i]->SetFont(wxFont(9, wxFONTFAMILY_TELETYPE, wxFONTSTYLE_NORMAL, wxFONTWEIGHT_NORMAL));
+        side->Add(new wxStaticText(this, wxID_ANY, labels[i]), 0, wxBOTTOM, 2);
+        side->Add(m_Sides[i], 1, wxEXPAND);
+        sides->Add(side, 1, wxALL|wxEXPAND, 4);
+    }
+
+    wxBoxSizer* take = new wxBoxSizer(wxHORIZONTAL);
+    take->Add(new wxButton(this, ID_OURS, _("Take ours")), 0, wxRIGHT, 4);
+    take->Add(new wxButton(this, ID_THEIRS, _("Take theirs")), 0, wxRIGHT, 4);
+    take->Add(new wxButton(this, ID_BOTH, _("Take both")), 0, wxRIGHT, 4);
+    m_Base = new wxButton(this, ID_BASE, _("Take base"));
+    m_Base->Disable();
+    take->Add(m_Base, 0, wxRIGHT, 4);
+    m_Status = new wxStaticText(this, wxID_ANY, _("Reading..."));
+    take->Add(m_Status, 1, wxLEFT|wxALIGN_CENTER_VERTICAL, 8);
+
+    wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+    sizer->Add(sides, 1, wxEXPAND);
+    sizer->Add(take, 0, wxALL|wxEXPAND, 4);
+    sizer->Add(CreateButtonSizer(wxOK|wxCANCEL), 0, wxALL|wxEXPAND, 4);
+    SetSizerAndFit(sizer);
+    m_Ok = static_cast<wxButton*>(FindWindow(wxID_OK));
+    if(m_Ok)
+    {
+        m_Ok->SetLabel(_("Resolve"));
+        m_Ok->Disable();
+    }
+
+    m_Worker = std::thread(&VcsConflictView::Load, this, &vcs, path);
+}
+
+VcsConflictView::~VcsConflictView()
+{
+    Stop();
+}
+
+void VcsConflictView::EndModal(int retCode)
+{
+    Stop();
+    wxDialog::EndModal(retCode);
+}
+
+void VcsConflictView::Stop()
+{
+    if(m_Worker.joinable())
+    {
+        m_Worker.join();
+    }
+}
+
+void VcsConflictView::Load(IVersionControlSystem* vcs, wxString path)
+{
+    std::string merged;
+    const bool loaded = vcs->GetConflict(path, merged);
+    if(loaded)
+    {
+        m_File.Parse(merged);
+    }
+    CallAfter(&VcsConflictView::OnLoaded, loaded);
+}
+
+void VcsConflictView::OnLoaded(bool loaded)
+{
+    Stop();
+    if(!loaded)
+    {
+        m_Status->SetLabel(_("The conflict could not be read from the index"));
+        return;
+    }
+    m_Loaded = true;
+    m_List->SetItemCount(m_File.GetRegionCount());
+    if(m_File.GetRegionCount() > 0)
+    {
+        m_List->SetItemState(0, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED);
+    }
+    ShowStatus();
+}
+
+void VcsConflictView::ShowRegion(long region)
+{
+    const VcsConflictRegion& sides = m_File.GetRegion(region);
+    m_Sides[0]->ChangeValue(wxString::FromUTF8(sides.ours.c_str()));
+    m_Sides[1]->ChangeValue(wxString::FromUTF8(sides.base.c_str()));
+    m_Sides[2]->ChangeValue(wxString::FromUTF8(sides.theirs.c_str()));
+    // Two way markers, as in a file edited since the merge, have no base to take
+    m_Base->Enable(sides.hasBase);
+}
+
+void VcsConflictView::ShowStatus()
+{
+    const size_t count = m_File.GetRegionCount();
+    m_Status->SetLabel(wxString::Format(_("%lu of %lu conflicts resolved"), (unsigned long)(count - m_File.GetUnresolvedCount()),
+                                        (unsigned long)count));
+    // Resolving with regions left would commit their markers
+    if(m_Ok)
+    {
+        m_Ok->Enable(m_Loaded && m_File.GetUnresolvedCount() == 0);
+    }
+}
+
+void VcsConflictView::OnSelected(wxListEvent& event)
+{
+    if(m_Loaded)
+    {
+        ShowRegion(event.GetIndex());
+    }
+}
+
+void VcsConflictView::OnTake(wxCommandEvent& event)
+{
+    const long region = m_List->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+    if(!m_Loaded || region < 0)
+    {
+        return;
+    }
+    VcsConflictFile::Resolution resolution = VcsConflictFile::Conflict_Base;
+    if(event.GetId() == ID_OURS)
+    {
+        resolution = VcsConflictFile::Conflict_Ours;
+    }
+    else if(event.GetId() == ID_THEIRS)
+    {
+        resolution = VcsConflictFile::Conflict_Theirs;
+    }
+    else if(event.GetId() == ID_BOTH)
+    {
+        resolution = VcsConflictFile::Conflict_Both;
+    }
+    if(!m_File.Resolve(region, resolution))
+    {
+        return;
+    }
+    m_List->RefreshItem(region);
+    ShowStatus();
+
+    // On to the next region still open, so a long file is worked through from the buttons alone
+    const long count = long(m_File.GetRegionCount());
+    for(long i = 1; i < count; ++i)
+    {
+        const long next = (region + i) % count;
+        if(m_File.GetResolution(next) == VcsConflictFile::Conflict_Unresolved)
+        {
+            m_List->SetItemState(next, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED);
+            m_List->EnsureVisible(next);
+            break;
+        }
+    }
+}
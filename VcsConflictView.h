@@ -0,0 +1,71 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSCONFLICTVIEW_H
+#define VCSCONFLICTVIEW_H
+
+#include <thread>
+#include <wx/dialog.h>
+#include "IVersionControlSystem.h"
+#include "VcsConflictFile.h"
+
+class VcsConflictRegionList;
+class wxButton;
+class wxListEvent;
+class wxStaticText;
+class wxTextCtrl;
+
+/** Dialog to resolve the conflicts of a file one region at a time.
+ *
+ * The three sides are merged on a worker when the dialog opens, so the
+ * blobs of a conflicted file are only read once it is looked at. The
+ * regions are listed virtually and only the selected one is shown, which
+ * keeps a file with hundreds of conflicts as quick as one with a few.
+ */
+class VcsConflictView : public wxDialog
+{
+    public:
+        VcsConflictView(wxWindow* parent, IVersionControlSystem& vcs, const wxString& path);
+        /** Default destructor, waits for the worker */
+        virtual ~VcsConflictView();
+
+        const VcsConflictFile& GetFile() const { return m_File; }
+        void EndModal(int retCode) override;
+
+    protected:
+    private:
+        VcsConflictRegionList* m_List;
+        wxTextCtrl* m_Sides[3];
+        wxStaticText* m_Status;
+        wxButton* m_Ok;
+        wxButton* m_Base;
+        VcsConflictFile m_File;
+        bool m_Loaded;
+        std::thread m_Worker;
+
+        void Stop();
+        void Load(IVersionControlSystem* vcs, wxString path);
+        void OnLoaded(bool loaded);
+        void ShowRegion(long region);
+        void ShowStatus();
+        void OnSelected(wxListEvent& event);
+        void OnTake(wxCommandEvent& event);
+
+        DECLARE_EVENT_TABLE()
+};
+
+#endif // VCSCONFLICTVIEW_H
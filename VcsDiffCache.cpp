@@ -0,0 +1,76 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsDiffCache.h"
+
+VcsDiffCache::Patch VcsDiffCache::Lookup(const std::string& key)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Index.find(key);
+    if(it == m_Index.end())
+    {
+        return Patch();
+    }
+    m_Entries.splice(m_Entries.begin(), m_Entries, it->second);
+    return it->second->second;
+}
+
+void VcsDiffCache::Insert(const std::string& key, Patch patch)
+{
+    if(!patch)
+    {
+        return;
+    }
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Index.find(key);
+    if(it != m_Index.end())
+    {
+        m_Bytes -= it->second->second->size();
+        m_Entries.erase(it->second);
+        m_Index.erase(it);
+    }
+    m_Bytes += patch->size();
+    m_Entries.emplace_front(key, std::move(patch));
+    m_Index[key] = m_Entries.begin();
+    Trim();
+}
+
+void VcsDiffCache::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Entries.clear();
+    m_Index.clear();
+    m_Bytes = 0;
+}
+
+size_t VcsDiffCache::GetSize() const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return m_Bytes;
+}
+
+void VcsDiffCache::Trim()
+{
+    // Always keep the newest patch, even if it alone is over the limit
+    while(m_Bytes > m_MaxBytes && m_Entries.size() > 1)
+    {
+        const Entries::value_type& oldest = m_Entries.back();
+        m_Bytes -= oldest.second->size();
+        m_Index.erase(oldest.first);
+        m_Entries.pop_back();
+    }
+}
@@ -0,0 +1,67 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSDIFFCACHE_H
+#define VCSDIFFCACHE_H
+
+#include <list>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include "copyprotector.h"
+
+/** Recently generated patches, most recently used first.
+ *
+ * The key identifies both sides of the diff and the options used, so a
+ * patch is reused for as long as neither side changes. How the key is
+ * made up is left to the VCS. Patches are kept as UTF-8 bytes, exactly
+ * as they are appended to the diff editor.
+ *
+ * Once the patches add up to more than the size limit the least recently
+ * used ones are dropped.
+ */
+class VcsDiffCache : private CopyProtector
+{
+    public:
+        typedef std::shared_ptr<const std::string> Patch;
+
+        /** Default constructor */
+        explicit VcsDiffCache(size_t maxBytes = 16 * 1024 * 1024) : m_MaxBytes(maxBytes), m_Bytes(0) {}
+        /** Default destructor */
+        virtual ~VcsDiffCache() {}
+
+        /** \return the cached patch, or an empty pointer on a miss */
+        Patch Lookup(const std::string& key);
+        void Insert(const std::string& key, Patch patch);
+        void Clear();
+        /** Bytes of patch text held */
+        size_t GetSize() const;
+    protected:
+    private:
+        typedef std::list<std::pair<std::string, Patch>> Entries;
+
+        mutable std::mutex m_Mutex;
+        Entries m_Entries;
+        std::map<std::string, Entries::iterator> m_Index;
+        const size_t m_MaxBytes;
+        size_t m_Bytes;
+
+        void Trim();
+};
+
+#endif // VCSDIFFCACHE_H
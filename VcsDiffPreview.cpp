@@ -0,0 +1,115 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsDiffPreview.h"
+
+VcsDiffPreview::VcsDiffPreview(PatchFunction produce, ReadyHandler ready) :
+    m_Produce(produce),
+    m_Ready(ready),
+    m_Stop(false)
+{
+}
+
+VcsDiffPreview::~VcsDiffPreview()
+{
+    Stop();
+}
+
+VcsDiffPreview::Patch VcsDiffPreview::Request(const wxString& path, const std::vector<wxString>& neighbours)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Patches.find(path);
+    if(it != m_Patches.end())
+    {
+        return it->second;
+    }
+    if(m_Stop)
+    {
+        return Patch();
+    }
+
+    // Prefetches for a row the user has moved away from are no longer wanted
+    m_Queue.clear();
+    m_Queue.push_back(path);
+    for(const wxString& neighbour : neighbours)
+    {
+        if(m_Patches.find(neighbour) == m_Patches.end())
+        {
+            m_Queue.push_back(neighbour);
+        }
+    }
+    if(!m_Worker.joinable())
+    {
+        m_Worker = std::thread(&VcsDiffPreview::Run, this);
+    }
+    m_Wake.notify_one();
+    return Patch();
+}
+
+VcsDiffPreview::Patch VcsDiffPreview::Lookup(const wxString& path) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    auto it = m_Patches.find(path);
+    return it != m_Patches.end() ? it->second : Patch();
+}
+
+void VcsDiffPreview::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Stop = true;
+        m_Queue.clear();
+    }
+    m_Wake.notify_one();
+    if(m_Worker.joinable())
+    {
+        m_Worker.join();
+    }
+}
+
+void VcsDiffPreview::Run()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    for(;;)
+    {
+        m_Wake.wait(lock, [this]() { return m_Stop || !m_Queue.empty(); });
+        if(m_Stop)
+        {
+            return;
+        }
+        wxString path = m_Queue.front();
+        m_Queue.pop_front();
+        if(m_Patches.find(path) != m_Patches.end())
+        {
+            continue;
+        }
+
+        lock.unlock();
+        std::string text;
+        if(!m_Produce(path, text))
+        {
+            text.clear();
+        }
+        Patch patch = std::make_shared<const std::string>(std::move(text));
+        lock.lock();
+        m_Patches[path] = patch;
+
+        lock.unlock();
+        m_Ready(path);
+        lock.lock();
+    }
+}
@@ -0,0 +1,77 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSDIFFPREVIEW_H
+#define VCSDIFFPREVIEW_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <wx/string.h>
+#include "copyprotector.h"
+
+/** Patches of single files, produced on a worker as they are asked for.
+ *
+ * Each file is only diffed once for the lifetime of the preview. Asking
+ * for a file drops whatever was still queued and queues the file first,
+ * followed by the neighbours passed along with it, so stepping through a
+ * list usually finds the next patch ready.
+ */
+class VcsDiffPreview : private CopyProtector
+{
+    public:
+        typedef std::shared_ptr<const std::string> Patch;
+        /** Produces the UTF-8 patch of path, called on the worker */
+        typedef std::function<bool(const wxString& path, std::string& patch)> PatchFunction;
+        /** Called on the worker once the patch of path is available */
+        typedef std::function<void(const wxString& path)> ReadyHandler;
+
+        VcsDiffPreview(PatchFunction produce, ReadyHandler ready);
+        /** Default destructor, waits for the patch being produced */
+        virtual ~VcsDiffPreview();
+
+        /** \return the patch of path, or an empty pointer once it has been queued
+         * \param neighbours prefetched after path, most likely to be wanted next first
+         */
+        Patch Request(const wxString& path, const std::vector<wxString>& neighbours);
+        /** \return the patch of path, or an empty pointer if it has not been produced yet */
+        Patch Lookup(const wxString& path) const;
+        /** Drop the queue and wait for the worker to finish */
+        void Stop();
+
+    protected:
+    private:
+        PatchFunction m_Produce;
+        ReadyHandler m_Ready;
+        mutable std::mutex m_Mutex;
+        std::condition_variable m_Wake;
+        /** Produced patches. An empty patch means there was nothing to show */
+        std::map<wxString, Patch> m_Patches;
+        std::deque<wxString> m_Queue;
+        bool m_Stop;
+        std::thread m_Worker;
+
+        void Run();
+};
+
+#endif // VCSDIFFPREVIEW_H
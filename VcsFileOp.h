@@ -25,6 +25,23 @@
 
 class VcsTreeItem;
 
+/** What the working tree or index is compared with by a diff */
+enum VcsDiffTarget
+{
+    VcsDiff_Index,      ///< working tree against the index
+    VcsDiff_Head,       ///< working tree against HEAD
+    VcsDiff_Staged,     ///< index against HEAD
+    VcsDiff_Revision,   ///< working tree against any revision
+};
+
+/** Where a restore takes the files from */
+enum VcsRestoreSource
+{
+    VcsRestore_Head,        ///< HEAD, discarding staged and unstaged changes
+    VcsRestore_Index,       ///< the index, discarding unstaged changes only
+    VcsRestore_Revision,    ///< any revision, whose files are staged as well
+};
+
 class VcsFileOp
 {
     public:
@@ -36,6 +53,8 @@ class VcsFileOp
         virtual ~VcsFileOp() {}
         void execute(std::vector<std::shared_ptr<VcsTreeItem>>);
         virtual void stopExecution() {}
+        /** True if the op leaves the items in their new state, so they need no status update afterwards */
+        virtual bool SetsStates() const { return false; }
 
     protected:
         const wxString& m_VcsRootDir;
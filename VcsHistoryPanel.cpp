@@ -0,0 +1,220 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsHistoryPanel.h"
+
+#include <wx/datetime.h>
+#include <wx/listctrl.h>
+#include <wx/sizer.h>
+#include <wx/stattext.h>
+#include "IVersionControlSystem.h"
+
+namespace
+{
+// Commits read beyond the last row the list asked for
+const size_t kReadAhead = 1000;
+// Characters of the commit id shown
+const size_t kShortIdLength = 8;
+
+enum HistoryColumn
+{
+    Column_Id,
+    Column_Summary,
+    Column_Author,
+    Column_Date
+};
+}
+
+/** Virtual list drawing its rows from the commit table of the panel */
+class VcsHistoryList : public wxListCtrl
+{
+    public:
+        explicit VcsHistoryList(VcsHistoryPanel* panel) :
+            wxListCtrl(panel, wxID_ANY, wxDefaultPosition, wxDefaultSize, wxLC_REPORT|wxLC_VIRTUAL|wxLC_SINGLE_SEL),
+            m_Panel(panel)
+        {
+            InsertColumn(Column_Id, _("Commit"), wxLIST_FORMAT_LEFT, 80);
+            InsertColumn(Column_Summary, _("Summary"), wxLIST_FORMAT_LEFT, 420);
+            InsertColumn(Column_Author, _("Author"), wxLIST_FORMAT_LEFT, 140);
+            InsertColumn(Column_Date, _("Date"), wxLIST_FORMAT_LEFT, 130);
+        }
+
+    protected:
+        virtual wxString OnGetItemText(long item, long column) const
+        {
+            VcsCommitInfo info;
+            if(item < 0 || !m_Panel->GetCommits().Get(item, info))
+            {
+                return wxEmptyString;
+            }
+            switch(column)
+            {
+            case Column_Id:
+                return wxString::FromUTF8(info.id.substr(0, kShortIdLength).c_str());
+            case Column_Summary:
+                return info.summary;
+            case Column_Author:
+                return info.author;
+            default:
+                return wxDateTime(info.time).Format(_T("%Y-%m-%d %H:%M"));
+            }
+        }
+
+    private:
+        VcsHistoryPanel* m_Panel;
+
+        void OnCacheHint(wxListEvent& event)
+        {
+            m_Panel->WantRow(event.GetCacheTo());
+        }
+
+        DECLARE_EVENT_TABLE()
+};
+
+BEGIN_EVENT_TABLE(VcsHistoryList, wxListCtrl)
+    EVT_LIST_CACHE_HINT(wxID_ANY, VcsHistoryList::OnCacheHint)
+END_EVENT_TABLE()
+
+VcsHistoryPanel::VcsHistoryPanel(wxWindow* parent) :
+    wxPanel(parent, wxID_ANY),
+    m_Vcs(0),
+    m_Generation(0),
+    m_Reading(false),
+    m_Wanted(0),
+    m_Abort(false)
+{
+    wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+    m_Title = new wxStaticText(this, wxID_ANY, _("No history shown"));
+    m_List = new VcsHistoryList(this);
+    sizer->Add(m_Title, 0, wxALL, 4);
+    sizer->Add(m_List, 1, wxEXPAND);
+    SetSizer(sizer);
+}
+
+VcsHistoryPanel::~VcsHistoryPanel()
+{
+    Stop();
+}
+
+void VcsHistoryPanel::ShowHistory(IVersionControlSystem& vcs, const wxString& path, const wxString& title)
+{
+    Stop();
+    m_Generation++;
+    m_Commits.Clear();
+    m_List->SetItemCount(0);
+    m_Vcs = &vcs;
+    m_HistoryTitle = title;
+    m_Reading = true;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Abort = false;
+        m_Wanted = kReadAhead;
+    }
+    UpdateTitle();
+    m_Worker = std::thread(&VcsHistoryPanel::ReadHistory, this, &vcs, path, m_Generation);
+}
+
+void VcsHistoryPanel::Forget(IVersionControlSystem& vcs)
+{
+    if(m_Vcs != &vcs)
+    {
+        return;
+    }
+    Stop();
+    m_Generation++;
+    m_Commits.Clear();
+    m_List->SetItemCount(0);
+    m_Vcs = 0;
+    m_Reading = false;
+    m_Title->SetLabel(_("No history shown"));
+}
+
+void VcsHistoryPanel::WantRow(size_t row)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    if(row + kReadAhead > m_Wanted)
+    {
+        m_Wanted = row + kReadAhead;
+        m_MoreWanted.notify_one();
+    }
+}
+
+void VcsHistoryPanel::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Abort = true;
+    }
+    m_MoreWanted.notify_one();
+    if(m_Worker.joinable())
+    {
+        m_Worker.join();
+    }
+}
+
+void VcsHistoryPanel::ReadHistory(IVersionControlSystem* vcs, wxString path, unsigned generation)
+{
+    bool read = vcs->ReadHistory(path, m_Commits, [this, generation]()
+    {
+        CallAfter(&VcsHistoryPanel::OnPageRead, generation);
+        return WaitForMore();
+    });
+    if(!read)
+    {
+        fprintf(stderr, "VcsHistoryPanel::%s:%d reading the history failed\n", __FUNCTION__, __LINE__);
+    }
+    CallAfter(&VcsHistoryPanel::OnHistoryRead, generation);
+}
+
+bool VcsHistoryPanel::WaitForMore()
+{
+    std::unique_lock<std::mutex> lock(m_Mutex);
+    m_MoreWanted.wait(lock, [this]() { return m_Abort || m_Wanted > m_Commits.Count(); });
+    return !m_Abort;
+}
+
+void VcsHistoryPanel::OnPageRead(unsigned generation)
+{
+    if(generation != m_Generation)
+    {
+        return;
+    }
+    m_List->SetItemCount(m_Commits.Count());
+    UpdateTitle();
+}
+
+void VcsHistoryPanel::OnHistoryRead(unsigned generation)
+{
+    if(generation != m_Generation)
+    {
+        return;
+    }
+    m_Reading = false;
+    m_List->SetItemCount(m_Commits.Count());
+    UpdateTitle();
+}
+
+void VcsHistoryPanel::UpdateTitle()
+{
+    const size_t count = m_Commits.Count();
+    wxString label = m_HistoryTitle + wxString::Format(_(" - %lu commits"), (unsigned long)count);
+    if(m_Reading)
+    {
+        label += _(", reading...");
+    }
+    m_Title->SetLabel(label);
+}
@@ -0,0 +1,79 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSHISTORYPANEL_H
+#define VCSHISTORYPANEL_H
+
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <wx/panel.h>
+#include "VcsCommitTable.h"
+
+class IVersionControlSystem;
+class VcsHistoryList;
+class wxStaticText;
+
+/** Dockable list of the commits of a project, folder or file.
+ *
+ * The history is read on a worker, a page at a time, into a commit
+ * table the list draws its rows from. The worker only reads ahead of
+ * the rows the list is about to show, so opening the history of a huge
+ * repository costs a page or two until the user scrolls.
+ */
+class VcsHistoryPanel : public wxPanel
+{
+    public:
+        explicit VcsHistoryPanel(wxWindow* parent);
+        /** Default destructor, stops the worker */
+        virtual ~VcsHistoryPanel();
+
+        /** Replace the history shown by the one of path, relative to the VCS root. An empty path is the whole repository */
+        void ShowHistory(IVersionControlSystem& vcs, const wxString& path, const wxString& title);
+        /** Stop reading and clear the panel if it shows a history of vcs, which is about to go away */
+        void Forget(IVersionControlSystem& vcs);
+        /** Read ahead so that row can be shown */
+        void WantRow(size_t row);
+        const VcsCommitTable& GetCommits() const { return m_Commits; }
+
+    protected:
+    private:
+        wxStaticText* m_Title;
+        VcsHistoryList* m_List;
+        VcsCommitTable m_Commits;
+        IVersionControlSystem* m_Vcs;
+        wxString m_HistoryTitle;
+        /** Tells the callbacks of an earlier history apart from the current one */
+        unsigned m_Generation;
+        bool m_Reading;
+
+        std::mutex m_Mutex;
+        std::condition_variable m_MoreWanted;
+        /** Commits to read before the worker waits for the list */
+        size_t m_Wanted;
+        bool m_Abort;
+        std::thread m_Worker;
+
+        void Stop();
+        void ReadHistory(IVersionControlSystem* vcs, wxString path, unsigned generation);
+        bool WaitForMore();
+        void OnPageRead(unsigned generation);
+        void OnHistoryRead(unsigned generation);
+        void UpdateTitle();
+};
+
+#endif // VCSHISTORYPANEL_H
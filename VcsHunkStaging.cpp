@@ -0,0 +1,131 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsHunkStaging.h"
+
+namespace
+{
+// Working copy line of each line of hunk, and whether each change is selected
+void SelectLines(const VcsPatchHunk& hunk, int first, int last, std::vector<bool>& selected)
+{
+    selected.assign(hunk.lines.size(), false);
+    int newLine = hunk.newStart;
+    size_t i = 0;
+    while(i < hunk.lines.size())
+    {
+        if(hunk.lines[i].origin == ' ')
+        {
+            newLine++;
+            i++;
+            continue;
+        }
+        // A run of changes: removed lines all stand before newLine, added ones follow from it
+        size_t end = i;
+        bool added = false;
+        while(end < hunk.lines.size() && hunk.lines[end].origin != ' ')
+        {
+            added = added || hunk.lines[end].origin == '+';
+            end++;
+        }
+        const int runStart = newLine;
+        for(; i < end; i++)
+        {
+            if(hunk.lines[i].origin == '+')
+            {
+                selected[i] = newLine >= first && newLine <= last;
+                newLine++;
+            }
+            else
+            {
+                selected[i] = (runStart >= first && runStart <= last)
+                              || (!added && runStart - 1 >= first && runStart - 1 <= last);
+            }
+        }
+    }
+}
+
+void SplitLines(const std::string& text, std::vector<std::string>& lines)
+{
+    size_t start = 0;
+    while(start < text.size())
+    {
+        size_t end = text.find('\n', start);
+        end = (end == std::string::npos) ? text.size() : end + 1;
+        lines.push_back(text.substr(start, end - start));
+        start = end;
+    }
+}
+}
+
+std::string VcsApplyHunks(const std::string& base, const std::vector<VcsPatchHunk>& hunks, int first, int last, bool wholeHunks)
+{
+    std::vector<std::string> baseLines;
+    SplitLines(base, baseLines);
+
+    std::string result;
+    result.reserve(base.size());
+    size_t oldLine = 0;
+    std::vector<bool> selected;
+    for(const VcsPatchHunk& hunk : hunks)
+    {
+        for(; oldLine < static_cast<size_t>(hunk.oldStart) && oldLine < baseLines.size(); oldLine++)
+        {
+            result += baseLines[oldLine];
+        }
+
+        SelectLines(hunk, first, last, selected);
+        if(wholeHunks)
+        {
+            bool any = false;
+            for(bool line : selected)
+            {
+                any = any || line;
+            }
+            selected.assign(selected.size(), any);
+        }
+
+        for(size_t i = 0; i < hunk.lines.size(); i++)
+        {
+            const VcsPatchLine& line = hunk.lines[i];
+            switch(line.origin)
+            {
+            case '+':
+                if(selected[i])
+                {
+                    result += line.content;
+                }
+                break;
+            case '-':
+                if(!selected[i])
+                {
+                    result += line.content;
+                }
+                oldLine++;
+                break;
+            default:
+                result += line.content;
+                oldLine++;
+                break;
+            }
+        }
+    }
+    for(; oldLine < baseLines.size(); oldLine++)
+    {
+        result += baseLines[oldLine];
+    }
+    return result;
+}
@@ -0,0 +1,55 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSHUNKSTAGING_H
+#define VCSHUNKSTAGING_H
+
+#include <string>
+#include <vector>
+
+/** A line of a patch hunk, as the VCS reported it */
+struct VcsPatchLine
+{
+    /** ' ' for context, '+' for an added line, '-' for a removed one */
+    char origin;
+    /** Line text, line end included when the line has one */
+    std::string content;
+};
+
+/** A hunk turning the staged version of a file into the working copy. Lines are 0 based. */
+struct VcsPatchHunk
+{
+    /** Staged lines before the hunk */
+    int oldStart;
+    /** Working copy lines before the hunk */
+    int newStart;
+    std::vector<VcsPatchLine> lines;
+};
+
+/** Staged content with part of the working copy changes applied.
+ *
+ * Only changes touching the working copy lines [first, last] are taken.
+ * Added lines are selected by their own line. Removed lines count as
+ * standing before the working copy line that follows them; a deletion
+ * with nothing added in its place is also selected from the line above
+ * it, where the change marker is shown.
+ *
+ * \param wholeHunks take every change of a hunk as soon as one of its changes is selected
+ */
+std::string VcsApplyHunks(const std::string& base, const std::vector<VcsPatchHunk>& hunks, int first, int last, bool wholeHunks);
+
+#endif // VCSHUNKSTAGING_H
@@ -0,0 +1,183 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <algorithm>
+#include "VcsLineDiff.h"
+
+namespace
+{
+int HunkEnd(const VcsLineHunk& hunk)
+{
+    return hunk.newStart + hunk.newLines;
+}
+
+bool Touches(const VcsLineHunk& hunk, int first, int last)
+{
+    return HunkEnd(hunk) >= first && hunk.newStart <= last;
+}
+
+// Position of a buffer line once linesAdded lines were added after line
+int Shift(int pos, int line, int linesAdded)
+{
+    return pos > line ? std::max(line + 1, pos + linesAdded) : pos;
+}
+}
+
+void VcsLineDiff::SetBase(const std::string& base)
+{
+    m_Base = base;
+    m_BaseLineStarts.clear();
+    m_BaseLineStarts.push_back(0);
+    for(size_t i = 0; i < m_Base.size(); ++i)
+    {
+        if(m_Base[i] == '\n')
+        {
+            m_BaseLineStarts.push_back(i + 1);
+        }
+    }
+    m_BaseLineStarts.push_back(m_Base.size());
+    m_HasBase = true;
+    Invalidate();
+}
+
+void VcsLineDiff::ClearBase()
+{
+    m_Base.clear();
+    m_BaseLineStarts.clear();
+    m_HasBase = false;
+    Invalidate();
+}
+
+void VcsLineDiff::Edit(int line, int linesAdded)
+{
+    for(VcsLineHunk& hunk : m_Hunks)
+    {
+        hunk.newStart = Shift(hunk.newStart, line, linesAdded);
+    }
+
+    const int first = line;
+    const int last = line + std::max(linesAdded, 0) + 1;
+    if(m_Dirty)
+    {
+        m_DirtyFirst = std::min(Shift(m_DirtyFirst, line, linesAdded), first);
+        m_DirtyLast = std::max(Shift(m_DirtyLast, line, linesAdded), last);
+    }
+    else
+    {
+        m_DirtyFirst = first;
+        m_DirtyLast = last;
+    }
+    m_Dirty = true;
+}
+
+void VcsLineDiff::Invalidate()
+{
+    m_Dirty = true;
+    m_Whole = true;
+}
+
+bool VcsLineDiff::Update(int bufferLines, const LineReader& reader, const DiffFunction& diff, int& first, int& last)
+{
+    const int baseLines = m_BaseLineStarts.empty() ? 0 : m_BaseLineStarts.size() - 1;
+    int n0 = 0;
+    int n1 = bufferLines;
+    if(!m_Whole)
+    {
+        n0 = std::max(0, m_DirtyFirst);
+        n1 = std::min(bufferLines, m_DirtyLast);
+        bool widened = true;
+        while(widened)
+        {
+            widened = false;
+            for(const VcsLineHunk& hunk : m_Hunks)
+            {
+                if(Touches(hunk, n0, n1) && (hunk.newStart < n0 || HunkEnd(hunk) > n1))
+                {
+                    n0 = std::min(n0, hunk.newStart);
+                    n1 = std::max(n1, HunkEnd(hunk));
+                    widened = true;
+                }
+            }
+        }
+        n0 = std::max(0, n0);
+        n1 = std::min(bufferLines, n1);
+    }
+
+    // Outside the window the hunks are still right, so they tell which base lines the window stands for
+    std::vector<VcsLineHunk> before;
+    std::vector<VcsLineHunk> after;
+    int b0 = n0;
+    int b1 = baseLines - (bufferLines - n1);
+    if(!m_Whole)
+    {
+        for(const VcsLineHunk& hunk : m_Hunks)
+        {
+            if(Touches(hunk, n0, n1))
+            {
+                continue;
+            }
+            if(HunkEnd(hunk) < n0)
+            {
+                b0 += hunk.oldLines - hunk.newLines;
+                before.push_back(hunk);
+            }
+            else
+            {
+                b1 -= hunk.oldLines - hunk.newLines;
+                after.push_back(hunk);
+            }
+        }
+        if(b0 < 0 || b1 < b0 || b1 > baseLines)
+        {
+            // Edits we were not told about, start over
+            before.clear();
+            after.clear();
+            n0 = b0 = 0;
+            n1 = bufferLines;
+            b1 = baseLines;
+        }
+    }
+
+    m_Dirty = false;
+    m_Whole = false;
+    first = std::max(0, n0 - 1);
+    last = std::min(bufferLines, n1 + 1);
+    m_Hunks.swap(before);
+    if(!m_HasBase)
+    {
+        m_Hunks.clear();
+        return true;
+    }
+
+    std::vector<VcsLineHunk> window;
+    const std::string base = m_Base.substr(m_BaseLineStarts[b0], m_BaseLineStarts[b1] - m_BaseLineStarts[b0]);
+    if(!diff(base, reader(n0, n1 - n0), window))
+    {
+        m_Hunks.clear();
+        first = 0;
+        last = bufferLines;
+        return false;
+    }
+    for(VcsLineHunk& hunk : window)
+    {
+        hunk.oldStart += b0;
+        hunk.newStart += n0;
+        m_Hunks.push_back(hunk);
+    }
+    m_Hunks.insert(m_Hunks.end(), after.begin(), after.end());
+    return true;
+}
@@ -0,0 +1,86 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSLINEDIFF_H
+#define VCSLINEDIFF_H
+
+#include <functional>
+#include <string>
+#include <vector>
+#include "copyprotector.h"
+
+/** A changed run of lines between the base and the editor buffer. Lines are 0 based. */
+struct VcsLineHunk
+{
+    int oldStart;
+    int oldLines;
+    /** First changed buffer line. For a pure deletion, the line the removed lines stood before */
+    int newStart;
+    int newLines;
+};
+
+/** Changed lines of an editor buffer against its base version.
+ *
+ * Edits only mark lines dirty. Update() then re-diffs the smallest run
+ * of buffer lines covering the dirty lines and any hunk touching them,
+ * against the base lines it corresponds to. Everything outside that
+ * window keeps its hunks, shifted by the lines the edits added or
+ * removed.
+ */
+class VcsLineDiff : private CopyProtector
+{
+    public:
+        /** Produce the hunks turning base into buffer, numbered from the start of both texts */
+        typedef std::function<bool(const std::string& base, const std::string& buffer, std::vector<VcsLineHunk>& hunks)> DiffFunction;
+        /** Return buffer lines [first, first + count), line ends included */
+        typedef std::function<std::string(int first, int count)> LineReader;
+
+        /** Default constructor */
+        VcsLineDiff() : m_HasBase(false), m_Dirty(false), m_Whole(true), m_DirtyFirst(0), m_DirtyLast(0) {}
+        /** Default destructor */
+        virtual ~VcsLineDiff() {}
+
+        /** Replace the base. The whole buffer is diffed on the next Update() */
+        void SetBase(const std::string& base);
+        /** Forget the base, for files the VCS has no version of */
+        void ClearBase();
+        bool HasBase() const { return m_HasBase; }
+        /** Record an edit at buffer line, which added (or when negative removed) linesAdded lines after it */
+        void Edit(int line, int linesAdded);
+        /** Diff the whole buffer on the next Update() */
+        void Invalidate();
+        bool IsDirty() const { return m_Dirty; }
+        /** Re-diff the dirty lines
+         * \param first,last receive the buffer lines [first, last) whose hunks may have changed
+         * \return false if the diff failed, the hunks are then cleared
+         */
+        bool Update(int bufferLines, const LineReader& reader, const DiffFunction& diff, int& first, int& last);
+        const std::vector<VcsLineHunk>& GetHunks() const { return m_Hunks; }
+    protected:
+    private:
+        std::string m_Base;
+        /** Offset of every base line, followed by the base size */
+        std::vector<size_t> m_BaseLineStarts;
+        bool m_HasBase;
+        std::vector<VcsLineHunk> m_Hunks;
+        bool m_Dirty;
+        bool m_Whole;
+        int m_DirtyFirst;
+        int m_DirtyLast;
+};
+
+#endif // VCSLINEDIFF_H
@@ -0,0 +1,76 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsNameList.h"
+#include <algorithm>
+
+size_t VcsNameList::Append(const std::vector<wxString>& names)
+{
+    const size_t firstVisible = m_Visible.size();
+    const size_t firstOrdered = m_Order.size();
+    for(const wxString& name : names)
+    {
+        if(Matches(name))
+        {
+            m_Visible.push_back(m_Names.size());
+        }
+        if(m_Sorted)
+        {
+            m_Order.push_back(m_Names.size());
+        }
+        m_Names.push_back(name);
+    }
+    if(m_Sorted)
+    {
+        MergeByName(m_Order, firstOrdered);
+        MergeByName(m_Visible, firstVisible);
+    }
+    return m_Visible.size() - firstVisible;
+}
+
+void VcsNameList::SetFilter(const wxString& filter)
+{
+    m_Filter = filter.Lower();
+    m_Visible.clear();
+    for(size_t i = 0; i < m_Names.size(); ++i)
+    {
+        const size_t position = m_Sorted ? m_Order[i] : i;
+        if(Matches(m_Names[position]))
+        {
+            m_Visible.push_back(position);
+        }
+    }
+}
+
+void VcsNameList::Clear()
+{
+    m_Names.clear();
+    m_Order.clear();
+    m_Visible.clear();
+}
+
+void VcsNameList::MergeByName(std::vector<size_t>& positions, size_t first) const
+{
+    auto byName = [this](size_t left, size_t right) { return m_Names[left] < m_Names[right]; };
+    std::sort(positions.begin() + first, positions.end(), byName);
+    std::inplace_merge(positions.begin(), positions.begin() + first, positions.end(), byName);
+}
+
+bool VcsNameList::Matches(const wxString& name) const
+{
+    return m_Filter.IsEmpty() || name.Lower().Contains(m_Filter);
+}
@@ -0,0 +1,63 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSNAMELIST_H
+#define VCSNAMELIST_H
+
+#include <vector>
+#include <wx/string.h>
+
+/** Names, e.g. of branches or tags, as they arrive, and the rows of them that pass a filter.
+ *
+ * Names are only ever appended, so a filter is applied to each batch as
+ * it comes in; the whole list is only gone over when the filter changes.
+ * A sorted list merges each batch into the rows already shown.
+ */
+class VcsNameList
+{
+    public:
+        /** \param sorted show the names in order rather than as they arrived */
+        explicit VcsNameList(bool sorted = false) : m_Sorted(sorted) {}
+        /** Add names after the others
+         * \return the number of them that pass the filter
+         */
+        size_t Append(const std::vector<wxString>& names);
+        /** Keep the names that contain filter, ignoring case. An empty filter keeps all */
+        void SetFilter(const wxString& filter);
+        size_t GetCount() const { return m_Names.size(); }
+        size_t GetVisibleCount() const { return m_Visible.size(); }
+        /** Name shown in row, which has to be below GetVisibleCount() */
+        const wxString& GetVisible(size_t row) const { return m_Names[m_Visible[row]]; }
+        void Clear();
+
+    protected:
+    private:
+        bool m_Sorted;
+        std::vector<wxString> m_Names;
+        /** Positions in m_Names in name order, when sorted */
+        std::vector<size_t> m_Order;
+        /** Positions in m_Names of the names that pass the filter, in the order they are shown */
+        std::vector<size_t> m_Visible;
+        /** Lower case */
+        wxString m_Filter;
+
+        bool Matches(const wxString& name) const;
+        /** Merge the sorted positions from first on into the sorted ones before it */
+        void MergeByName(std::vector<size_t>& positions, size_t first) const;
+};
+
+#endif // VCSNAMELIST_H
@@ -0,0 +1,108 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsProgress.h"
+#include <algorithm>
+#include <manager.h>
+#include <wx/progdlg.h>
+
+namespace
+{
+const int idProgressTimer = wxNewId();
+// How often the dialog is refreshed and polled for cancellation
+const int kRefreshInterval = 100;
+}
+
+BEGIN_EVENT_TABLE(VcsProgress, wxEvtHandler)
+    EVT_TIMER( idProgressTimer, VcsProgress::OnTimer )
+END_EVENT_TABLE()
+
+VcsProgress::VcsProgress(std::atomic_bool& abort) :
+    m_Abort(abort),
+    m_Dialog(nullptr),
+    m_Timer(this, idProgressTimer),
+    m_Value(0),
+    m_Range(0),
+    m_ShownRange(0)
+{
+}
+
+VcsProgress::~VcsProgress()
+{
+    Stop();
+}
+
+void VcsProgress::Start(const wxString& title, const wxString& label, int range)
+{
+    Stop();
+    m_Value = 0;
+    m_Range = range;
+    m_ShownRange = std::max(range, 1);
+    SetLabel(label);
+    m_Dialog = new wxProgressDialog(title, label, m_ShownRange, Manager::Get()->GetAppWindow(), wxPD_CAN_ABORT | wxPD_ELAPSED_TIME);
+    m_Timer.Start(kRefreshInterval);
+}
+
+void VcsProgress::Stop()
+{
+    m_Timer.Stop();
+    if (m_Dialog)
+    {
+        m_Dialog->Destroy();
+        m_Dialog = nullptr;
+    }
+}
+
+void VcsProgress::SetValue(int value, int range)
+{
+    m_Range = range;
+    m_Value = value;
+}
+
+void VcsProgress::SetLabel(const wxString& label)
+{
+    std::lock_guard<std::mutex> lock(m_LabelMutex);
+    m_Label = label;
+}
+
+void VcsProgress::OnTimer(wxTimerEvent& /*event*/)
+{
+    if (!m_Dialog)
+    {
+        return;
+    }
+    const int range = std::max(int(m_Range), 1);
+    if (range != m_ShownRange)
+    {
+        m_Dialog->SetRange(range);
+        m_ShownRange = range;
+    }
+    wxString label;
+    if (m_Abort)
+    {
+        label = _("Cancelling...");
+    }
+    else
+    {
+        std::lock_guard<std::mutex> lock(m_LabelMutex);
+        label = m_Label;
+    }
+    if (!m_Dialog->Update(std::min(int(m_Value), range), label))
+    {
+        m_Abort = true;
+    }
+}
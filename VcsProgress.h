@@ -0,0 +1,67 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSPROGRESS_H
+#define VCSPROGRESS_H
+
+#include <atomic>
+#include <mutex>
+#include <wx/event.h>
+#include <wx/string.h>
+#include <wx/timer.h>
+#include "copyprotector.h"
+
+class wxProgressDialog;
+
+/** Progress dialog for an operation running on a worker thread.
+ *
+ * The worker posts its position and a label from any thread; the dialog
+ * picks them up on a timer, which is also when a press of its cancel
+ * button is noticed and passed on through the abort flag.
+ */
+class VcsProgress : public wxEvtHandler, private CopyProtector
+{
+    public:
+        explicit VcsProgress(std::atomic_bool& abort);
+        virtual ~VcsProgress();
+
+        /** Show the dialog. Call on the UI thread */
+        void Start(const wxString& title, const wxString& label, int range);
+        /** Hide the dialog. Call on the UI thread */
+        void Stop();
+        /** Callable from any thread */
+        void SetValue(int value, int range);
+        /** Callable from any thread */
+        void SetLabel(const wxString& label);
+
+    protected:
+    private:
+        std::atomic_bool& m_Abort;
+        wxProgressDialog* m_Dialog;
+        wxTimer m_Timer;
+        std::atomic_int m_Value;
+        std::atomic_int m_Range;
+        int m_ShownRange;
+        std::mutex m_LabelMutex;
+        wxString m_Label;
+
+        void OnTimer(wxTimerEvent& event);
+
+        DECLARE_EVENT_TABLE()
+};
+
+#endif // VCSPROGRESS_H
@@ -0,0 +1,104 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsRangeSet.h"
+
+void VcsRangeSet::Add(size_t first, size_t last)
+{
+    if (first >= last)
+    {
+        return;
+    }
+    // Swallow the ranges that overlap or touch [first, last)
+    std::map<size_t, size_t>::iterator it = m_Ranges.upper_bound(first);
+    if (it != m_Ranges.begin())
+    {
+        std::map<size_t, size_t>::iterator previous = it;
+        --previous;
+        if (previous->second >= first)
+        {
+            it = previous;
+        }
+    }
+    while (it != m_Ranges.end() && it->first <= last)
+    {
+        if (it->first < first)
+        {
+            first = it->first;
+        }
+        if (it->second > last)
+        {
+            last = it->second;
+        }
+        it = m_Ranges.erase(it);
+    }
+    m_Ranges[first] = last;
+}
+
+void VcsRangeSet::Remove(size_t first, size_t last)
+{
+    if (first >= last)
+    {
+        return;
+    }
+    std::map<size_t, size_t>::iterator it = m_Ranges.upper_bound(first);
+    if (it != m_Ranges.begin())
+    {
+        std::map<size_t, size_t>::iterator previous = it;
+        --previous;
+        if (previous->second > first)
+        {
+            it = previous;
+        }
+    }
+    while (it != m_Ranges.end() && it->first < last)
+    {
+        const size_t rangeFirst = it->first;
+        const size_t rangeLast = it->second;
+        it = m_Ranges.erase(it);
+        // Keep whatever sticks out on either side
+        if (rangeFirst < first)
+        {
+            m_Ranges[rangeFirst] = first;
+        }
+        if (rangeLast > last)
+        {
+            m_Ranges[last] = rangeLast;
+        }
+    }
+}
+
+bool VcsRangeSet::Contains(size_t index) const
+{
+    std::map<size_t, size_t>::const_iterator it = m_Ranges.upper_bound(index);
+    if (it == m_Ranges.begin())
+    {
+        return false;
+    }
+    --it;
+    return index < it->second;
+}
+
+size_t VcsRangeSet::Count() const
+{
+    size_t count = 0;
+    for (std::map<size_t, size_t>::const_iterator it = m_Ranges.begin(); it != m_Ranges.end(); ++it)
+    {
+        count += it->second - it->first;
+    }
+    return count;
+}
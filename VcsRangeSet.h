@@ -0,0 +1,49 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSRANGESET_H
+#define VCSRANGESET_H
+
+#include <cstddef>
+#include <map>
+
+/** Set of indices kept as disjoint half-open ranges.
+ *
+ * Marking or clearing a run of indices costs the same however long the
+ * run is, which keeps select-all over huge lists cheap.
+ */
+class VcsRangeSet
+{
+    public:
+        /** Add the indices [first, last) */
+        void Add(size_t first, size_t last);
+        /** Remove the indices [first, last) */
+        void Remove(size_t first, size_t last);
+        void Set(size_t first, size_t last, bool on) { on ? Add(first, last) : Remove(first, last); }
+        bool Contains(size_t index) const;
+        /** Number of indices in the set */
+        size_t Count() const;
+        bool IsEmpty() const { return m_Ranges.empty(); }
+        void Clear() { m_Ranges.clear(); }
+
+    protected:
+    private:
+        /** First index of each range, mapped to one past its last */
+        std::map<size_t, size_t> m_Ranges;
+};
+
+#endif // VCSRANGESET_H
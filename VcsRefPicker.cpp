@@ -0,0 +1,202 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "VcsRefPicker.h"
+
+#include <wx/button.h>
+#include <wx/listctrl.h>
+#include <wx/sizer.h>
+#include <wx/stattext.h>
+#include <wx/textctrl.h>
+
+namespace
+{
+const long ID_FILTER = wxNewId();
+const long ID_NAMES = wxNewId();
+// Names listed before the dialog is told about them
+const size_t kBatchSize = 500;
+}
+
+/** Virtual list drawing its rows from the filtered names of the picker */
+class VcsRefNameList : public wxListCtrl
+{
+    public:
+        explicit VcsRefNameList(VcsRefPicker* picker) :
+            wxListCtrl(picker, ID_NAMES, wxDefaultPosition, wxSize(360, 300), wxLC_REPORT|wxLC_VIRTUAL|wxLC_SINGLE_SEL|wxLC_NO_HEADER),
+            m_Picker(picker)
+        {
+            InsertColumn(0, wxEmptyString, wxLIST_FORMAT_LEFT, 340);
+        }
+
+    protected:
+        virtual wxString OnGetItemText(long item, long /*column*/) const
+        {
+            const VcsNameList& names = m_Picker->GetNames();
+            if(item < 0 || size_t(item) >= names.GetVisibleCount())
+            {
+                return wxEmptyString;
+            }
+            return names.GetVisible(item);
+        }
+
+    private:
+        VcsRefPicker* m_Picker;
+};
+
+BEGIN_EVENT_TABLE(VcsRefPicker, wxDialog)
+    EVT_TEXT( ID_FILTER, VcsRefPicker::OnFilter )
+    EVT_TEXT_ENTER( ID_FILTER, VcsRefPicker::OnOk )
+    EVT_LIST_ITEM_ACTIVATED( ID_NAMES, VcsRefPicker::OnActivated )
+    EVT_BUTTON( wxID_OK, VcsRefPicker::OnOk )
+END_EVENT_TABLE()
+
+VcsRefPicker::VcsRefPicker(wxWindow* parent, IVersionControlSystem& vcs, VcsRefKind kind, const wxString& title) :
+    wxDialog(parent, wxID_ANY, title, wxDefaultPosition, wxDefaultSize, wxDEFAULT_DIALOG_STYLE|wxRESIZE_BORDER),
+    // Stash entries stay newest first
+    m_Names(kind != VcsRef_Stash),
+    m_Reading(true),
+    m_Posted(false),
+    m_Abort(false)
+{
+    wxBoxSizer* sizer = new wxBoxSizer(wxVERTICAL);
+    m_Filter = new wxTextCtrl(this, ID_FILTER, wxEmptyString, wxDefaultPosition, wxDefaultSize, wxTE_PROCESS_ENTER);
+    m_Filter->SetHint(_("Filter"));
+    m_List = new VcsRefNameList(this);
+    m_Status = new wxStaticText(this, wxID_ANY, _("Reading..."));
+    sizer->Add(m_Filter, 0, wxALL|wxEXPAND, 4);
+    sizer->Add(m_List, 1, wxLEFT|wxRIGHT|wxEXPAND, 4);
+    sizer->Add(m_Status, 0, wxALL, 4);
+    sizer->Add(CreateButtonSizer(wxOK|wxCANCEL), 0, wxALL|wxEXPAND, 4);
+    SetSizerAndFit(sizer);
+    m_Filter->SetFocus();
+
+    m_Worker = std::thread(&VcsRefPicker::ReadRefs, this, &vcs, kind);
+}
+
+VcsRefPicker::~VcsRefPicker()
+{
+    Stop();
+}
+
+void VcsRefPicker::EndModal(int retCode)
+{
+    Stop();
+    wxDialog::EndModal(retCode);
+}
+
+void VcsRefPicker::Stop()
+{
+    m_Abort = true;
+    if(m_Worker.joinable())
+    {
+        m_Worker.join();
+    }
+}
+
+void VcsRefPicker::ReadRefs(IVersionControlSystem* vcs, VcsRefKind kind)
+{
+    size_t count = 0;
+    bool listed = vcs->ListRefs(kind, [this, &count](const wxString& name)
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        m_Pending.push_back(name);
+        // The first name is shown straight away, later ones in batches
+        const bool first = count++ == 0;
+        if(!m_Posted && (first || m_Pending.size() >= kBatchSize))
+        {
+            m_Posted = true;
+            CallAfter(&VcsRefPicker::OnNamesRead);
+        }
+        return !m_Abort;
+    });
+    CallAfter(&VcsRefPicker::OnRefsRead, listed);
+}
+
+void VcsRefPicker::OnNamesRead()
+{
+    ShowNames();
+}
+
+void VcsRefPicker::OnRefsRead(bool listed)
+{
+    if(m_Worker.joinable())
+    {
+        m_Worker.join();
+    }
+    m_Reading = false;
+    ShowNames();
+    if(!listed)
+    {
+        m_Status->SetLabel(_("Could not read the names"));
+    }
+}
+
+void VcsRefPicker::ShowNames()
+{
+    std::vector<wxString> pending;
+    {
+        std::lock_guard<std::mutex> lock(m_Mutex);
+        pending.swap(m_Pending);
+        m_Posted = false;
+    }
+    if(!pending.empty())
+    {
+        m_Names.Append(pending);
+        m_List->SetItemCount(m_Names.GetVisibleCount());
+        if(m_List->GetSelectedItemCount() == 0 && m_Names.GetVisibleCount())
+        {
+            m_List->SetItemState(0, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED);
+        }
+        m_List->Refresh();
+    }
+    wxString status = wxString::Format(_("%lu of %lu shown"), (unsigned long)m_Names.GetVisibleCount(), (unsigned long)m_Names.GetCount());
+    if(m_Reading)
+    {
+        status += _(", reading...");
+    }
+    m_Status->SetLabel(status);
+}
+
+void VcsRefPicker::OnFilter(wxCommandEvent& /*event*/)
+{
+    m_Names.SetFilter(m_Filter->GetValue());
+    m_List->SetItemCount(m_Names.GetVisibleCount());
+    if(m_Names.GetVisibleCount())
+    {
+        m_List->SetItemState(0, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED, wxLIST_STATE_SELECTED|wxLIST_STATE_FOCUSED);
+    }
+    m_List->Refresh();
+    ShowNames();
+}
+
+void VcsRefPicker::OnActivated(wxListEvent& /*event*/)
+{
+    wxCommandEvent event;
+    OnOk(event);
+}
+
+void VcsRefPicker::OnOk(wxCommandEvent& /*event*/)
+{
+    const long row = m_List->GetNextItem(-1, wxLIST_NEXT_ALL, wxLIST_STATE_SELECTED);
+    if(row < 0 || size_t(row) >= m_Names.GetVisibleCount())
+    {
+        wxBell();
+        return;
+    }
+    m_Name = m_Names.GetVisible(row);
+    EndModal(wxID_OK);
+}
@@ -0,0 +1,80 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSREFPICKER_H
+#define VCSREFPICKER_H
+
+#include <atomic>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <wx/dialog.h>
+#include "IVersionControlSystem.h"
+#include "VcsNameList.h"
+
+class VcsRefNameList;
+class wxListEvent;
+class wxStaticText;
+class wxTextCtrl;
+
+/** Dialog to pick a branch, tag or stash entry by name.
+ *
+ * The names are listed on a worker and shown in batches as they arrive,
+ * so the dialog is usable at once even with many thousands of refs.
+ * Nothing is resolved to a commit until a name has been picked.
+ */
+class VcsRefPicker : public wxDialog
+{
+    public:
+        VcsRefPicker(wxWindow* parent, IVersionControlSystem& vcs, VcsRefKind kind, const wxString& title);
+        /** Default destructor, stops the worker */
+        virtual ~VcsRefPicker();
+
+        /** Name picked, once ShowModal() returned wxID_OK */
+        const wxString& GetName() const { return m_Name; }
+        const VcsNameList& GetNames() const { return m_Names; }
+        void EndModal(int retCode) override;
+
+    protected:
+    private:
+        wxTextCtrl* m_Filter;
+        VcsRefNameList* m_List;
+        wxStaticText* m_Status;
+        VcsNameList m_Names;
+        wxString m_Name;
+        bool m_Reading;
+
+        std::mutex m_Mutex;
+        /** Names listed by the worker, not shown yet */
+        std::vector<wxString> m_Pending;
+        bool m_Posted;
+        std::atomic_bool m_Abort;
+        std::thread m_Worker;
+
+        void Stop();
+        void ReadRefs(IVersionControlSystem* vcs, VcsRefKind kind);
+        void OnNamesRead();
+        void OnRefsRead(bool listed);
+        void ShowNames();
+        void OnFilter(wxCommandEvent& event);
+        void OnActivated(wxListEvent& event);
+        void OnOk(wxCommandEvent& event);
+
+        DECLARE_EVENT_TABLE()
+};
+
+#endif // VCSREFPICKER_H
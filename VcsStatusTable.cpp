@@ -0,0 +1,274 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include <wx/filename.h>
+#include "VcsStatusTable.h"
+
+namespace
+{
+// Only files that are still there, so that they can be opened
+bool IsChanged(ItemState state)
+{
+    return state == Item_Modified
+        || state == Item_Added
+        || state == Item_Conflicted;
+}
+
+unsigned int* Counter(VcsStateCounts& counts, ItemState state)
+{
+    switch(state)
+    {
+    case Item_Modified:
+    case Item_Removed:
+    case Item_Missing:
+        return &counts.modified;
+    case Item_Added:
+        return &counts.added;
+    case Item_Conflicted:
+        return &counts.conflicted;
+    case Item_Untracked:
+        return &counts.untracked;
+    default:
+        return 0;
+    }
+}
+
+bool IsCounted(ItemState state)
+{
+    VcsStateCounts counts;
+    return Counter(counts, state) != 0;
+}
+
+// Paths are kept with '/' between folders on every platform
+wxString ToKey(const wxString& path)
+{
+    wxString key(path);
+    for(size_t i = 0; i < key.length(); i++)
+    {
+        if(wxFileName::IsPathSeparator(key[i]))
+        {
+            key[i] = wxT('/');
+        }
+    }
+    return key;
+}
+
+wxString FolderKey(const wxString& folder)
+{
+    wxString key = ToKey(folder);
+    if(!key.empty() && key.Last() == wxT('/'))
+    {
+        return key.Left(key.length() - 1);
+    }
+    return key;
+}
+}
+
+void VcsStateCounts::Add(ItemState state)
+{
+    unsigned int* counter = Counter(*this, state);
+    if(counter)
+    {
+        ++*counter;
+    }
+}
+
+void VcsStateCounts::Remove(ItemState state)
+{
+    unsigned int* counter = Counter(*this, state);
+    if(counter && *counter)
+    {
+        --*counter;
+    }
+}
+
+ItemState VcsStateCounts::GetState() const
+{
+    if(conflicted)
+    {
+        return Item_Conflicted;
+    }
+    if(modified || added)
+    {
+        return Item_Modified;
+    }
+    return Item_UpToDate;
+}
+
+void VcsStatusTable::Count(const wxString& path, ItemState state)
+{
+    if(!IsCounted(state))
+    {
+        return;
+    }
+
+    m_FolderCounts[wxEmptyString].Add(state);
+    for(size_t i = 0; i < path.length(); i++)
+    {
+        if(path[i] == wxT('/'))
+        {
+            m_FolderCounts[path.Left(i)].Add(state);
+        }
+    }
+
+    if(IsChanged(state))
+    {
+        m_Changed.insert(path);
+    }
+}
+
+void VcsStatusTable::Uncount(const wxString& path, ItemState state)
+{
+    if(!IsCounted(state))
+    {
+        return;
+    }
+
+    m_FolderCounts[wxEmptyString].Remove(state);
+    for(size_t i = 0; i < path.length(); i++)
+    {
+        if(path[i] == wxT('/'))
+        {
+            std::map<wxString, VcsStateCounts>::iterator folder = m_FolderCounts.find(path.Left(i));
+            if(folder == m_FolderCounts.end())
+            {
+                continue;
+            }
+            folder->second.Remove(state);
+            if(folder->second.IsEmpty())
+            {
+                m_FolderCounts.erase(folder);
+            }
+        }
+    }
+
+    m_Changed.erase(path);
+}
+
+bool VcsStatusTable::Update(const wxString& relativePath, ItemState state)
+{
+    const wxString path = ToKey(relativePath);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    std::map<wxString, ItemState>::iterator i = m_States.find(path);
+    if(i == m_States.end())
+    {
+        m_States.insert(std::make_pair(path, state));
+        Count(path, state);
+        return true;
+    }
+
+    if(i->second == state)
+    {
+        return false;
+    }
+
+    Uncount(path, i->second);
+    Count(path, state);
+    i->second = state;
+    return true;
+}
+
+bool VcsStatusTable::Lookup(const wxString& path, ItemState& state) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    std::map<wxString, ItemState>::const_iterator i = m_States.find(ToKey(path));
+    if(i == m_States.end())
+    {
+        return false;
+    }
+
+    state = i->second;
+    return true;
+}
+
+void VcsStatusTable::Erase(const wxString& relativePath)
+{
+    const wxString path = ToKey(relativePath);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    std::map<wxString, ItemState>::iterator i = m_States.find(path);
+    if(i == m_States.end())
+    {
+        return;
+    }
+
+    Uncount(path, i->second);
+    m_States.erase(i);
+}
+
+void VcsStatusTable::Clear()
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_States.clear();
+    m_FolderCounts.clear();
+    m_Changed.clear();
+}
+
+VcsStateCounts VcsStatusTable::GetCounts(const wxString& folder) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    std::map<wxString, VcsStateCounts>::const_iterator i = m_FolderCounts.find(FolderKey(folder));
+    if(i == m_FolderCounts.end())
+    {
+        return VcsStateCounts();
+    }
+
+    return i->second;
+}
+
+bool VcsStatusTable::GetNextChanged(const wxString& folder, const wxString& after, wxString& next) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    wxString prefix = FolderKey(folder);
+    if(!prefix.empty())
+    {
+        prefix += wxT('/');
+    }
+
+    // Paths sharing the prefix are contiguous in the set
+    std::set<wxString>::const_iterator first = m_Changed.lower_bound(prefix);
+    if(first == m_Changed.end() || !first->StartsWith(prefix))
+    {
+        return false;
+    }
+
+    std::set<wxString>::const_iterator i = m_Changed.upper_bound(ToKey(after));
+    if(i == m_Changed.end() || !i->StartsWith(prefix))
+    {
+        i = first;
+    }
+
+    next = *i;
+    return true;
+}
+
+bool VcsStatusTable::HasChanged(const wxString& folder) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+
+    wxString prefix = FolderKey(folder);
+    if(!prefix.empty())
+    {
+        prefix += wxT('/');
+    }
+    std::set<wxString>::const_iterator first = m_Changed.lower_bound(prefix);
+    return first != m_Changed.end() && first->StartsWith(prefix);
+}
@@ -0,0 +1,99 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef VCSSTATUSTABLE_H
+#define VCSSTATUSTABLE_H
+
+#include <map>
+#include <mutex>
+#include <set>
+#include <wx/string.h>
+#include "copyprotector.h"
+#include "VcsTreeItem.h"
+
+/** Number of changed files below a folder.
+ *
+ * Removed and missing files count as modified.
+ */
+struct VcsStateCounts
+{
+    unsigned int modified;
+    unsigned int added;
+    unsigned int conflicted;
+    unsigned int untracked;
+
+    VcsStateCounts() : modified(0), added(0), conflicted(0), untracked(0) {}
+    void Add(ItemState state);
+    void Remove(ItemState state);
+    bool IsEmpty() const { return !modified && !added && !conflicted && !untracked; }
+    /** Single state summarising the counts, as shown for a folder or project */
+    ItemState GetState() const;
+};
+
+/** Last known state of every path the VCS has reported on.
+ *
+ * Paths are relative to the VCS root, and may use either '/' or the native
+ * separator; they are kept with '/'. The table is shared between the
+ * UI thread and the status workers, so every access is locked.
+ *
+ * Folder roll-ups are adjusted on every Update(), so looking up the
+ * counts of a folder never walks the files below it.
+ */
+class VcsStatusTable : private CopyProtector
+{
+    public:
+        /** Default constructor */
+        VcsStatusTable() {}
+        /** Default destructor */
+        virtual ~VcsStatusTable() {}
+
+        /** Record the state of a path
+         * \return true if the state differs from the previous snapshot
+         */
+        bool Update(const wxString& path, ItemState state);
+        /** Look up the last recorded state of a path
+         * \return false if the path has never been recorded
+         */
+        bool Lookup(const wxString& path, ItemState& state) const;
+        void Erase(const wxString& path);
+        void Clear();
+
+        /** Counts of the files below folder. An empty folder is the VCS root */
+        VcsStateCounts GetCounts(const wxString& folder) const;
+        /** Find the changed file following after within folder
+         *
+         * Only modified, added and conflicted files count, as removed and
+         * missing ones cannot be opened. Wraps around to the first changed
+         * file of the folder.
+         * \param next set with '/' separators
+         * \return false if the folder has no changed files
+         */
+        bool GetNextChanged(const wxString& folder, const wxString& after, wxString& next) const;
+        /** Whether GetNextChanged() would find a file in folder */
+        bool HasChanged(const wxString& folder) const;
+    protected:
+    private:
+        mutable std::mutex m_Mutex;
+        std::map<wxString, ItemState> m_States;
+        std::map<wxString, VcsStateCounts> m_FolderCounts;
+        std::set<wxString> m_Changed;
+
+        void Count(const wxString& path, ItemState state);
+        void Uncount(const wxString& path, ItemState state);
+};
+
+#endif // VCSSTATUSTABLE_H
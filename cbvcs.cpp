@@ -27,10 +27,13 @@
 #include "cbvcs.h"
 #include "IVersionControlSystem.h"
 #include "VcsFileItem.h"
+#include "VcsHistoryPanel.h"
 #include "vcsprojecttracker.h"
 #include "vcstrackermap.h"
 #include "shellutilimpl.h"
 #include "VcsProject.h"
+#include "VcsRefPicker.h"
+#include "VcsConflictView.h"
 
 // Register the plugin with Code::Blocks.
 // We are using an anonymous namespace so we don't litter the global one.
@@ -41,15 +44,30 @@ const int idAdd = wxNewId();
 const int idRemove = wxNewId();
 const int idCommit = wxNewId();
 const int idDiff = wxNewId();
+const int idDiffHead = wxNewId();
+const int idDiffStaged = wxNewId();
+const int idDiffRevision = wxNewId();
 const int idRestore = wxNewId();
+const int idRestoreIndex = wxNewId();
+const int idRestoreRevision = wxNewId();
 const int idRefresh = wxNewId();
-#if 0
+const int idNextChanged = wxNewId();
+const int idStageHunk = wxNewId();
+const int idStageLines = wxNewId();
+const int idHistory = wxNewId();
+const int idBlame = wxNewId();
+const int idChangeSummary = wxNewId();
+const int idResolveConflict = wxNewId();
 const int idBranchCreate = wxNewId();
 const int idBranchCheckout = wxNewId();
-const int idBranchMerge = wxNewId();
 const int idTagCreate = wxNewId();
 const int idTagCheckout = wxNewId();
-#endif
+const int idBranchMerge = wxNewId();
+const int idFetch = wxNewId();
+const int idPull = wxNewId();
+const int idStashSave = wxNewId();
+const int idStashApply = wxNewId();
+const int idStashPop = wxNewId();
 }
 
 
@@ -60,12 +78,38 @@ BEGIN_EVENT_TABLE(cbvcs, cbPlugin)
     EVT_MENU( idRemove, cbvcs::OnRemove )
     EVT_MENU( idCommit, cbvcs::OnCommit )
     EVT_MENU( idDiff, cbvcs::OnDiff )
+    EVT_MENU( idDiffHead, cbvcs::OnDiff )
+    EVT_MENU( idDiffStaged, cbvcs::OnDiff )
+    EVT_MENU( idDiffRevision, cbvcs::OnDiff )
     EVT_MENU( idRestore, cbvcs::OnRestore )
+    EVT_MENU( idRestoreIndex, cbvcs::OnRestore )
+    EVT_MENU( idRestoreRevision, cbvcs::OnRestore )
     EVT_MENU( idRefresh, cbvcs::OnRefresh )
+    EVT_MENU( idNextChanged, cbvcs::OnNextChanged )
+    EVT_MENU( idStageHunk, cbvcs::OnStageLines )
+    EVT_MENU( idStageLines, cbvcs::OnStageLines )
+    EVT_MENU( idHistory, cbvcs::OnHistory )
+    EVT_MENU( idBlame, cbvcs::OnBlame )
+    EVT_MENU( idResolveConflict, cbvcs::OnResolveConflict )
+    EVT_MENU( idBranchCreate, cbvcs::OnBranchCreate )
+    EVT_MENU( idBranchCheckout, cbvcs::OnBranchCheckout )
+    EVT_MENU( idBranchMerge, cbvcs::OnBranchMerge )
+    EVT_MENU( idFetch, cbvcs::OnFetch )
+    EVT_MENU( idPull, cbvcs::OnFetch )
+    EVT_MENU( idStashSave, cbvcs::OnStashSave )
+    EVT_MENU( idStashApply, cbvcs::OnStashApply )
+    EVT_MENU( idStashPop, cbvcs::OnStashApply )
+    EVT_MENU( idTagCreate, cbvcs::OnTagCreate )
+    EVT_MENU( idTagCheckout, cbvcs::OnTagCheckout )
 END_EVENT_TABLE()
 
 // constructor
-cbvcs::cbvcs()
+cbvcs::cbvcs() :
+    m_ChangeMarkers(m_ProjectTrackers),
+    m_BlameGutter(m_ProjectTrackers),
+    m_DiffTarget(VcsDiff_Index),
+    m_RestoreSource(VcsRestore_Head),
+    m_HistoryPanel(0)
 {
     // Make sure our resources are available.
     // In the generated boilerplate code we have no resources but when
@@ -93,6 +137,20 @@ void cbvcs::OnAttach()
     Manager::Get()->RegisterEventSink(cbEVT_EDITOR_SAVE, new cbEventFunctor<cbvcs, CodeBlocksEvent>(this, &cbvcs::OnEditorUpdate));
     Manager::Get()->RegisterEventSink(cbEVT_EDITOR_MODIFIED, new cbEventFunctor<cbvcs, CodeBlocksEvent>(this, &cbvcs::OnEditorUpdate));
     Manager::Get()->RegisterEventSink(cbEVT_EDITOR_ACTIVATED, new cbEventFunctor<cbvcs, CodeBlocksEvent>(this, &cbvcs::OnEditorActivated));
+    Manager::Get()->RegisterEventSink(cbEVT_EDITOR_CLOSE, new cbEventFunctor<cbvcs, CodeBlocksEvent>(this, &cbvcs::OnEditorClose));
+    m_ChangeMarkers.Attach();
+    m_BlameGutter.Attach();
+
+    m_HistoryPanel = new VcsHistoryPanel(Manager::Get()->GetAppWindow());
+    CodeBlocksDockEvent evt(cbEVT_ADD_DOCK_WINDOW);
+    evt.name = _T("VcsHistoryPane");
+    evt.title = _("Git history");
+    evt.pWindow = m_HistoryPanel;
+    evt.dockSide = CodeBlocksDockEvent::dsBottom;
+    evt.desiredSize.Set(800, 250);
+    evt.floatingSize.Set(800, 400);
+    evt.minimumSize.Set(300, 120);
+    Manager::Get()->ProcessEvent(evt);
 }
 
 void cbvcs::OnRelease(bool appShutDown)
@@ -102,6 +160,17 @@ void cbvcs::OnRelease(bool appShutDown)
     // which means you must not use any of the SDK Managers
     // NOTE: after this function, the inherited member variable
     // m_IsAttached will be FALSE...
+    m_ChangeMarkers.Detach();
+    m_BlameGutter.Detach();
+
+    if(m_HistoryPanel)
+    {
+        CodeBlocksDockEvent evt(cbEVT_REMOVE_DOCK_WINDOW);
+        evt.pWindow = m_HistoryPanel;
+        Manager::Get()->ProcessEvent(evt);
+        m_HistoryPanel->Destroy();
+        m_HistoryPanel = 0;
+    }
 }
 
 int cbvcs::Configure()
@@ -131,7 +200,6 @@ void cbvcs::CreateProjectMenu(wxMenu* menu, const FileTreeData* data)
 {
     wxMenu* VcsMenu = new wxMenu(_("Git"));
 
-#if 0
     wxMenu* branch = new wxMenu(_("Branch"));
     branch->Append(idBranchCreate, _("Create"), _("Create branch"));
     branch->Append(idBranchCheckout, _("Checkout"), _("Checkout branch"));
@@ -140,34 +208,103 @@ void cbvcs::CreateProjectMenu(wxMenu* menu, const FileTreeData* data)
     wxMenu* tag = new wxMenu(_("Tag"));
     tag->Append(idTagCreate, _("Create"), _("Create a new tag"));
     tag->Append(idTagCheckout, _("Checkout"), _("Checkout a tag"));
-#endif
+
+    wxMenu* stash = new wxMenu(_("Stash"));
+    stash->Append(idStashSave, _("Save..."), _("Save local changes to the stash and reset them"));
+    stash->Append(idStashApply, _("Apply..."), _("Apply a stash entry to the working tree"));
+    stash->Append(idStashPop, _("Pop..."), _("Apply a stash entry and drop it"));
 
     VcsMenu->Append(idCommit, _("Commit"), _("Commit this file"));
-    VcsMenu->Append(idDiff, _("Diff"), _("View diff"));
-    VcsMenu->Append(idRestore, _("Restore"), _("Restore changes"));
+    AppendDiffMenu(VcsMenu);
+    AppendRestoreMenu(VcsMenu);
+    VcsMenu->Append(idHistory, _("History"), _("Show the commits of this project"));
     VcsMenu->Append(idRefresh, _("Refresh"), _("Refresh VCS status"));
+    AppendChangeSummary(VcsMenu, data, wxEmptyString);
+    VcsMenu->Append(idFetch, _("Fetch"), _("Fetch from the remote of the current branch"));
+    VcsMenu->Append(idPull, _("Pull"), _("Fetch and fast-forward the current branch to its upstream"));
 
-#if 0
     VcsMenu->AppendSubMenu(branch, _("Branch"));
     VcsMenu->AppendSubMenu(tag, _("Tag"));
-#endif
+    VcsMenu->AppendSubMenu(stash, _("Stash"));
     menu->AppendSubMenu(VcsMenu, _("Git"));
 }
 
-void cbvcs::CreateFolderMenu(wxMenu* menu)
+void cbvcs::CreateFolderMenu(wxMenu* menu, const FileTreeData* data)
 {
     wxMenu* VcsMenu = new wxMenu(_("Git"));
 
     VcsMenu->Append(idAdd, _("Add"), _("Add this file"));
     VcsMenu->Append(idRemove, _("Remove"), _("Remove this file"));
     VcsMenu->Append(idCommit, _("Commit"), _("Commit this file"));
-    VcsMenu->Append(idDiff, _("Diff"), _("View diff"));
-    VcsMenu->Append(idRestore, _("Restore"), _("Restore changes"));
+    AppendDiffMenu(VcsMenu);
+    AppendRestoreMenu(VcsMenu);
+    VcsMenu->Append(idHistory, _("History"), _("Show the commits changing this folder"));
     VcsMenu->Append(idRefresh, _("Refresh"), _("Refresh VCS status"));
 
+    vcsProjectTracker* prjTracker = GetVcsInstance(data);
+    if(prjTracker)
+    {
+        AppendChangeSummary(VcsMenu, data, GetFolderRelativePath(prjTracker->GetVcs(), *data));
+    }
+
     menu->AppendSubMenu(VcsMenu, _("Git"));
 }
 
+void cbvcs::AppendDiffMenu(wxMenu* menu)
+{
+    wxMenu* diff = new wxMenu();
+    diff->Append(idDiff, _("Unstaged changes"), _("Diff working copy against index"));
+    diff->Append(idDiffStaged, _("Staged changes"), _("Diff index against HEAD"));
+    diff->Append(idDiffHead, _("Against HEAD"), _("Diff working copy against HEAD"));
+    diff->Append(idDiffRevision, _("Against revision..."), _("Diff working copy against a commit, branch or tag"));
+    menu->AppendSubMenu(diff, _("Diff"));
+}
+
+void cbvcs::AppendRestoreMenu(wxMenu* menu)
+{
+    wxMenu* restore = new wxMenu();
+    restore->Append(idRestore, _("From HEAD"), _("Discard staged and unstaged changes"));
+    restore->Append(idRestoreIndex, _("From index"), _("Discard unstaged changes"));
+    restore->Append(idRestoreRevision, _("From revision..."), _("Restore and stage the files of a commit, branch or tag"));
+    menu->AppendSubMenu(restore, _("Restore"));
+}
+
+void cbvcs::AppendChangeSummary(wxMenu* menu, const FileTreeData* data, const wxString& folder)
+{
+    vcsProjectTracker* prjTracker = GetVcsInstance(data);
+    if(!prjTracker)
+    {
+        return;
+    }
+
+    const VcsStatusTable& table = prjTracker->GetVcs().GetStatusTable();
+    const VcsStateCounts counts = table.GetCounts(folder);
+    if(counts.IsEmpty())
+    {
+        return;
+    }
+
+    menu->AppendSeparator();
+    menu->Append(idChangeSummary, wxString::Format(_("%u modified, %u added, %u conflicted, %u untracked"),
+                                                   counts.modified, counts.added, counts.conflicted, counts.untracked));
+    menu->Enable(idChangeSummary, false);
+    if(table.HasChanged(folder))
+    {
+        menu->Append(idNextChanged, _("Next modified file"), _("Open the next modified file"));
+    }
+}
+
+wxString cbvcs::GetFolderRelativePath(IVersionControlSystem& vcs, const FileTreeData& data)
+{
+    wxFileName folder = wxFileName::DirName(data.GetFolder());
+    if(!folder.IsAbsolute())
+    {
+        folder.MakeAbsolute(data.GetProject()->GetCommonTopLevelPath());
+    }
+    folder.MakeRelativeTo(vcs.GetRoot());
+    return folder.GetPath();
+}
+
 void cbvcs::CreateFileMenu(wxMenu* menu, const FileTreeData* data)
 {
     ProjectFile* file = data->GetProjectFile();
@@ -188,6 +325,7 @@ void cbvcs::CreateFileMenu(wxMenu* menu, const FileTreeData* data)
     {
         VcsMenu->Append(idCommit, _("Commit"), _("Commit this file"));
         VcsMenu->Append(idRestore, _("Restore"), _("Restore changes"));
+        VcsMenu->Append(idDiffStaged, _("Diff staged"), _("Diff index against HEAD"));
     }
     else if(file->GetFileState() == (FileVisualState)Item_UpToDate
        || file->GetFileState() == (FileVisualState)Item_Modified)
@@ -197,22 +335,60 @@ void cbvcs::CreateFileMenu(wxMenu* menu, const FileTreeData* data)
         if(file->GetFileState() == (FileVisualState)Item_Modified)
         {
             VcsMenu->Append(idCommit, _("Commit"), _("Commit this file"));
-            VcsMenu->Append(idRestore, _("Restore"), _("Restore changes"));
-            VcsMenu->Append(idDiff, _("Diff"), _("View diff"));
+            AppendRestoreMenu(VcsMenu);
+            AppendDiffMenu(VcsMenu);
         }
+        else
+        {
+            VcsMenu->Append(idDiffRevision, _("Diff against revision..."), _("Diff working copy against a commit, branch or tag"));
+        }
+        VcsMenu->Append(idHistory, _("History"), _("Show the commits changing this file"));
     }
     else if(file->GetFileState() == (FileVisualState)Item_Missing)
     {
         VcsMenu->Append(idRemove, _("Remove"), _("Remove this file"));
-        VcsMenu->Append(idRestore, _("Restore"), _("Restore changes"));
+        AppendRestoreMenu(VcsMenu);
+    }
+    else if(file->GetFileState() == (FileVisualState)Item_Conflicted)
+    {
+        VcsMenu->Append(idResolveConflict, _("Resolve conflicts..."), _("Pick the side to keep for each conflict in this file"));
     }
     VcsMenu->Append(idRefresh, _("Refresh"), _("Refresh VCS status"));
+    vcsProjectTracker* prjTracker = GetVcsInstance(data);
+    if(prjTracker && prjTracker->GetVcs().GetStatusTable().HasChanged(wxEmptyString))
+    {
+        VcsMenu->Append(idNextChanged, _("Next modified file"), _("Open the next modified file"));
+    }
 
     menu->AppendSubMenu(VcsMenu, _("Git"));
 }
 
+void cbvcs::CreateEditorMenu(wxMenu* menu)
+{
+    cbEditor* ed = Manager::Get()->GetEditorManager()->GetBuiltinActiveEditor();
+    wxString relativePath;
+    if(!ed || !GetEditorVcs(ed, relativePath))
+    {
+        return;
+    }
+
+    wxMenu* VcsMenu = new wxMenu(_("Git"));
+    VcsMenu->Append(idStageHunk, _("Stage hunk"), _("Stage the changes around the selection"));
+    VcsMenu->Append(idStageLines, _("Stage selected lines"), _("Stage only the selected changed lines"));
+    VcsMenu->AppendSeparator();
+    VcsMenu->AppendCheckItem(idBlame, _("Blame"), _("Show the commit that last changed each line"));
+    VcsMenu->Check(idBlame, m_BlameGutter.IsShown(ed));
+    menu->AppendSubMenu(VcsMenu, _("Git"));
+}
+
 void cbvcs::BuildModuleMenu(const ModuleType type, wxMenu* menu, const FileTreeData* data)
 {
+    if(menu && IsAttached() && type == mtEditorManager)
+    {
+        CreateEditorMenu(menu);
+        return;
+    }
+
     if ( !menu || !IsAttached() || !data)
         return;
 
@@ -227,7 +403,7 @@ void cbvcs::BuildModuleMenu(const ModuleType type, wxMenu* menu, const FileTreeD
     }
     else if(data->GetKind() == FileTreeData::ftdkFolder)
     {
-        CreateFolderMenu(menu);
+        CreateFolderMenu(menu, data);
         // same menu as File but maybe traverse the tree
     }
     else if(data->GetKind() == FileTreeData::ftdkProject)
@@ -371,26 +547,37 @@ void cbvcs::PerformGroupActionOnSelection(VcsAction action)
     }
 
     IVersionControlSystem& vcs = selectedProjectTracker->GetVcs();
+    VcsFileOp* op = nullptr;
     switch (action)
     {
     case VcsAction_Add:
-        vcs.AddOp->execute(files);
+        op = vcs.AddOp;
         break;
     case VcsAction_Remove:
-        vcs.RemoveOp->execute(files);
+        op = vcs.RemoveOp;
         break;
     case VcsAction_Commit:
-        vcs.CommitOp->execute(files);
+        op = vcs.CommitOp;
         break;
     case VcsAction_Diff:
-        vcs.DiffOp->execute(files);
+        vcs.SetDiffTarget(m_DiffTarget, m_DiffRevision);
+        op = vcs.DiffOp;
         break;
     case VcsAction_Restore:
-        vcs.RestoreOp->execute(files);
+        vcs.SetRestoreSource(m_RestoreSource, m_RestoreRevision);
+        op = vcs.RestoreOp;
         break;
     case VcsAction_Refresh:
         break;
     }
+    if (op)
+    {
+        op->execute(files);
+        if (op->SetsStates())
+        {
+            return;
+        }
+    }
     vcs.UpdateOp->execute(std::move( files));
 }
 
@@ -409,13 +596,59 @@ void cbvcs::OnCommit( wxCommandEvent& /*event*/ )
     PerformGroupActionOnSelection(VcsAction_Commit);
 }
 
-void cbvcs::OnDiff( wxCommandEvent& /*event*/ )
+void cbvcs::OnDiff( wxCommandEvent& event )
 {
+    const int id = event.GetId();
+    if(id == idDiffHead)
+    {
+        m_DiffTarget = VcsDiff_Head;
+    }
+    else if(id == idDiffStaged)
+    {
+        m_DiffTarget = VcsDiff_Staged;
+    }
+    else if(id == idDiffRevision)
+    {
+        wxString revision = wxGetTextFromUser(_("Commit, branch or tag to diff against:"), _("Diff against revision"),
+                                              m_DiffRevision.IsEmpty() ? wxString(_T("HEAD~1")) : m_DiffRevision);
+        revision.Trim(true).Trim(false);
+        if(revision.IsEmpty())
+        {
+            return;
+        }
+        m_DiffTarget = VcsDiff_Revision;
+        m_DiffRevision = revision;
+    }
+    else
+    {
+        m_DiffTarget = VcsDiff_Index;
+    }
     PerformGroupActionOnSelection(VcsAction_Diff);
 }
 
-void cbvcs::OnRestore( wxCommandEvent& /*event*/ )
+void cbvcs::OnRestore( wxCommandEvent& event )
 {
+    const int id = event.GetId();
+    if(id == idRestoreIndex)
+    {
+        m_RestoreSource = VcsRestore_Index;
+    }
+    else if(id == idRestoreRevision)
+    {
+        wxString revision = wxGetTextFromUser(_("Commit, branch or tag to restore from:"), _("Restore from revision"),
+                                              m_RestoreRevision.IsEmpty() ? wxString(_T("HEAD~1")) : m_RestoreRevision);
+        revision.Trim(true).Trim(false);
+        if(revision.IsEmpty())
+        {
+            return;
+        }
+        m_RestoreSource = VcsRestore_Revision;
+        m_RestoreRevision = revision;
+    }
+    else
+    {
+        m_RestoreSource = VcsRestore_Head;
+    }
     PerformGroupActionOnSelection(VcsAction_Restore);
 }
 
@@ -424,6 +657,428 @@ void cbvcs::OnRefresh( wxCommandEvent& /*event*/ )
     PerformGroupActionOnSelection(VcsAction_Refresh);
 }
 
+void cbvcs::OnNextChanged( wxCommandEvent& /*event*/ )
+{
+    const wxTreeCtrl* tree = Manager::Get()->GetProjectManager()->GetUI().GetTree();
+    if(!tree)
+    {
+        return;
+    }
+
+    wxArrayTreeItemIds treeItems;
+    if(!tree->GetSelections(treeItems))
+    {
+        return;
+    }
+
+    FileTreeData* fileTreeData = static_cast<FileTreeData*>( tree->GetItemData( treeItems[0] ) );
+    vcsProjectTracker* prjTracker = GetVcsInstance(fileTreeData);
+    if(!prjTracker)
+    {
+        return;
+    }
+
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    wxString folder;
+    wxString current;
+    if(fileTreeData->GetKind() == FileTreeData::ftdkFolder)
+    {
+        folder = GetFolderRelativePath(vcs, *fileTreeData);
+    }
+    else if(fileTreeData->GetKind() == FileTreeData::ftdkFile)
+    {
+        current = fileTreeData->GetProjectFile()->file.GetFullPath();
+    }
+
+    if(current.empty())
+    {
+        // carry on from the file being edited
+        cbEditor* ed = Manager::Get()->GetEditorManager()->GetBuiltinActiveEditor();
+        if(ed)
+        {
+            current = ed->GetFilename();
+        }
+    }
+
+    wxString after;
+    if(!current.empty())
+    {
+        wxFileName currentFileName(current);
+        currentFileName.MakeRelativeTo(vcs.GetRoot());
+        after = currentFileName.GetFullPath();
+    }
+
+    wxString next;
+    if(!vcs.GetStatusTable().GetNextChanged(folder, after, next))
+    {
+        Manager::Get()->GetLogManager()->Log(_("cbvcs: no modified files"));
+        return;
+    }
+
+    wxFileName nextFileName(next, wxPATH_UNIX);
+    nextFileName.MakeAbsolute(vcs.GetRoot());
+    Manager::Get()->GetEditorManager()->Open(nextFileName.GetFullPath());
+}
+
+IVersionControlSystem* cbvcs::GetEditorVcs(cbEditor* ed, wxString& relativePath)
+{
+    ProjectFile* pf = ed->GetProjectFile();
+    if(!pf || !pf->GetParentProject())
+    {
+        return 0;
+    }
+    vcsProjectTracker* prjTracker = m_ProjectTrackers.GetTracker(pf->GetParentProject()->GetFilename());
+    if(!prjTracker)
+    {
+        return 0;
+    }
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    relativePath = VcsFileItem(pf).GetRelativeName(vcs.GetRoot());
+    if(relativePath.IsEmpty())
+    {
+        return 0;
+    }
+    return &vcs;
+}
+
+void cbvcs::OnStageLines( wxCommandEvent& event )
+{
+    cbEditor* ed = Manager::Get()->GetEditorManager()->GetBuiltinActiveEditor();
+    wxString relativePath;
+    IVersionControlSystem* vcs = ed ? GetEditorVcs(ed, relativePath) : 0;
+    if(!vcs)
+    {
+        return;
+    }
+    // The changes are taken from the file on disk
+    if(ed->GetModified())
+    {
+        cbMessageBox(_("Save the file before staging part of it."), _("Stage"), wxICON_INFORMATION);
+        return;
+    }
+
+    cbStyledTextCtrl* ctrl = ed->GetControl();
+    const int first = ctrl->LineFromPosition(ctrl->GetSelectionStart());
+    int last = ctrl->LineFromPosition(ctrl->GetSelectionEnd());
+    // A selection of whole lines ends at the start of the line after them
+    if(last > first && ctrl->PositionFromLine(last) == ctrl->GetSelectionEnd())
+    {
+        last--;
+    }
+
+    if(!vcs->StageLines(relativePath, first, last, event.GetId() == idStageHunk))
+    {
+        Manager::Get()->GetLogManager()->Log(_("cbvcs: nothing staged from ") + relativePath);
+        return;
+    }
+
+    m_ChangeMarkers.ReloadBase(ed);
+    std::vector<std::shared_ptr<VcsTreeItem>> UpdateList;
+    UpdateList.emplace_back(new VcsFileItem(ed->GetProjectFile()));
+    vcs->UpdateOp->execute(std::move(UpdateList));
+}
+
+void cbvcs::OnResolveConflict( wxCommandEvent& /*event*/ )
+{
+    const wxTreeCtrl* tree = Manager::Get()->GetProjectManager()->GetUI().GetTree();
+    wxArrayTreeItemIds treeItems;
+    if(!tree || !tree->GetSelections(treeItems))
+    {
+        return;
+    }
+    FileTreeData* fileTreeData = static_cast<FileTreeData*>( tree->GetItemData( treeItems[0] ) );
+    vcsProjectTracker* prjTracker = GetVcsInstance(fileTreeData);
+    if(!prjTracker || fileTreeData->GetKind() != FileTreeData::ftdkFile)
+    {
+        return;
+    }
+
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    std::shared_ptr<VcsTreeItem> item(new VcsFileItem(fileTreeData->GetProjectFile()));
+    const wxString path = item->GetRelativeName(vcs.GetRoot());
+    // The conflicts are read from the file on disk, and the resolution is written over it
+    cbEditor* ed = Manager::Get()->GetEditorManager()->GetBuiltinEditor(item->GetName());
+    if(ed && ed->GetModified())
+    {
+        cbMessageBox(_("Save the file before resolving its conflicts."), _("Resolve conflicts"), wxICON_INFORMATION);
+        return;
+    }
+    VcsConflictView view(Manager::Get()->GetAppWindow(), vcs, path);
+    if(view.ShowModal() != wxID_OK || !vcs.ResolveConflict(path, view.GetFile().Compose()))
+    {
+        return;
+    }
+    if(ed)
+    {
+        ed->Reload();
+    }
+    std::vector<std::shared_ptr<VcsTreeItem>> UpdateList;
+    UpdateList.push_back(item);
+    vcs.UpdateOp->execute(std::move(UpdateList));
+}
+
+void cbvcs::OnBlame( wxCommandEvent& /*event*/ )
+{
+    m_BlameGutter.Toggle(Manager::Get()->GetEditorManager()->GetBuiltinActiveEditor());
+}
+
+std::vector<std::shared_ptr<VcsTreeItem>> cbvcs::GetProjectFiles(cbProject* prj)
+{
+    std::vector<std::shared_ptr<VcsTreeItem>> files;
+    for(int i = 0; i < prj->GetFilesCount(); ++i)
+    {
+        files.emplace_back(new VcsFileItem(prj->GetFile(i)));
+    }
+    return files;
+}
+
+vcsProjectTracker* cbvcs::GetSelectedProject(cbProject*& prj)
+{
+    const wxTreeCtrl* tree = Manager::Get()->GetProjectManager()->GetUI().GetTree();
+    wxArrayTreeItemIds treeItems;
+    if(!tree || !tree->GetSelections(treeItems))
+    {
+        return 0;
+    }
+    FileTreeData* fileTreeData = static_cast<FileTreeData*>( tree->GetItemData( treeItems[0] ) );
+    vcsProjectTracker* prjTracker = GetVcsInstance(fileTreeData);
+    prj = prjTracker ? fileTreeData->GetProject() : 0;
+    return prj ? prjTracker : 0;
+}
+
+void cbvcs::OnBranchCreate( wxCommandEvent& /*event*/ )
+{
+    cbProject* prj;
+    vcsProjectTracker* prjTracker = GetSelectedProject(prj);
+    if(!prjTracker)
+    {
+        return;
+    }
+    const wxString name = wxGetTextFromUser(_("Name of the new branch, starting at HEAD"), _("Create branch"));
+    if(name.IsEmpty())
+    {
+        return;
+    }
+    const bool checkout = cbMessageBox(wxString::Format(_("Switch to %s?"), name), _("Create branch"), wxYES_NO | wxICON_QUESTION) == wxID_YES;
+    prjTracker->GetVcs().CreateBranch(name, checkout);
+}
+
+void cbvcs::OnBranchCheckout( wxCommandEvent& /*event*/ )
+{
+    CheckoutRef(VcsRef_Branch, _("Checkout branch"));
+}
+
+void cbvcs::OnBranchMerge( wxCommandEvent& /*event*/ )
+{
+    cbProject* prj;
+    vcsProjectTracker* prjTracker = GetSelectedProject(prj);
+    if(!prjTracker)
+    {
+        return;
+    }
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    VcsRefPicker picker(Manager::Get()->GetAppWindow(), vcs, VcsRef_Branch, _("Merge branch into HEAD"));
+    if(picker.ShowModal() != wxID_OK)
+    {
+        return;
+    }
+    vcs.SetMergeSource(picker.GetName());
+    vcs.MergeOp->execute(GetProjectFiles(prj));
+}
+
+void cbvcs::OnFetch( wxCommandEvent& event )
+{
+    cbProject* prj;
+    vcsProjectTracker* prjTracker = GetSelectedProject(prj);
+    if(!prjTracker)
+    {
+        return;
+    }
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    vcs.SetPull(event.GetId() == idPull);
+    vcs.FetchOp->execute(GetProjectFiles(prj));
+}
+
+void cbvcs::OnStashSave( wxCommandEvent& /*event*/ )
+{
+    cbProject* prj;
+    vcsProjectTracker* prjTracker = GetSelectedProject(prj);
+    if(!prjTracker)
+    {
+        return;
+    }
+    // An empty message is a valid answer, so Cancel has to be told apart from it
+    wxTextEntryDialog messageDlg(Manager::Get()->GetAppWindow(), _("Stash message, leave empty for the default one"), _("Stash"));
+    if(messageDlg.ShowModal() != wxID_OK)
+    {
+        return;
+    }
+    const int keepIndex = cbMessageBox(_("Keep the staged changes in the index?"), _("Stash"), wxYES_NO | wxCANCEL | wxICON_QUESTION);
+    if(keepIndex == wxID_CANCEL)
+    {
+        return;
+    }
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    vcs.SetStashAction(VcsStash_Save, 0, messageDlg.GetValue(), keepIndex == wxID_YES);
+    vcs.StashOp->execute(GetProjectFiles(prj));
+}
+
+void cbvcs::OnStashApply( wxCommandEvent& event )
+{
+    cbProject* prj;
+    vcsProjectTracker* prjTracker = GetSelectedProject(prj);
+    if(!prjTracker)
+    {
+        return;
+    }
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    const bool pop = event.GetId() == idStashPop;
+    VcsRefPicker picker(Manager::Get()->GetAppWindow(), vcs, VcsRef_Stash, pop ? _("Pop stash entry") : _("Apply stash entry"));
+    if(picker.ShowModal() != wxID_OK)
+    {
+        return;
+    }
+    // Entries are listed as stash@{n}: message
+    unsigned long entry;
+    if(!picker.GetName().AfterFirst(wxT('{')).BeforeFirst(wxT('}')).ToULong(&entry))
+    {
+        return;
+    }
+    vcs.SetStashAction(pop ? VcsStash_Pop : VcsStash_Apply, entry, wxEmptyString, false);
+    vcs.StashOp->execute(GetProjectFiles(prj));
+}
+
+void cbvcs::OnTagCreate( wxCommandEvent& /*event*/ )
+{
+    cbProject* prj;
+    vcsProjectTracker* prjTracker = GetSelectedProject(prj);
+    if(!prjTracker)
+    {
+        return;
+    }
+    const wxString name = wxGetTextFromUser(_("Name of the new tag, on HEAD"), _("Create tag"));
+    if(name.IsEmpty())
+    {
+        return;
+    }
+    const wxString message = wxGetTextFromUser(_("Tag message, leave empty for a lightweight tag"), _("Create tag"));
+    prjTracker->GetVcs().CreateTag(name, message);
+}
+
+void cbvcs::OnTagCheckout( wxCommandEvent& /*event*/ )
+{
+    CheckoutRef(VcsRef_Tag, _("Checkout tag"));
+}
+
+void cbvcs::CheckoutRef(VcsRefKind kind, const wxString& title)
+{
+    cbProject* prj;
+    vcsProjectTracker* prjTracker = GetSelectedProject(prj);
+    if(!prjTracker)
+    {
+        return;
+    }
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    VcsRefPicker picker(Manager::Get()->GetAppWindow(), vcs, kind, title);
+    if(picker.ShowModal() != wxID_OK)
+    {
+        return;
+    }
+
+    // The op sets the states of the project files the checkout writes, no full update follows
+    vcs.SetCheckoutTarget(kind, picker.GetName());
+    vcs.CheckoutOp->execute(GetProjectFiles(prj));
+}
+
+void cbvcs::OnHistory( wxCommandEvent& /*event*/ )
+{
+    const wxTreeCtrl* tree = Manager::Get()->GetProjectManager()->GetUI().GetTree();
+    wxArrayTreeItemIds treeItems;
+    if(!tree || !m_HistoryPanel || !tree->GetSelections(treeItems))
+    {
+        return;
+    }
+
+    FileTreeData* fileTreeData = static_cast<FileTreeData*>( tree->GetItemData( treeItems[0] ) );
+    vcsProjectTracker* prjTracker = GetVcsInstance(fileTreeData);
+    if(!prjTracker)
+    {
+        return;
+    }
+
+    IVersionControlSystem& vcs = prjTracker->GetVcs();
+    wxString path;
+    wxString title;
+    if(fileTreeData->GetKind() == FileTreeData::ftdkFile)
+    {
+        path = VcsFileItem(fileTreeData->GetProjectFile()).GetRelativeName(vcs.GetRoot());
+        title = path;
+    }
+    else if(fileTreeData->GetKind() == FileTreeData::ftdkFolder)
+    {
+        path = GetFolderRelativePath(vcs, *fileTreeData);
+        title = path;
+    }
+    else
+    {
+        wxFileName projectFolder = wxFileName::DirName(fileTreeData->GetProject()->GetBasePath());
+        projectFolder.MakeRelativeTo(vcs.GetRoot());
+        path = projectFolder.GetPath();
+        title = fileTreeData->GetProject()->GetTitle();
+    }
+    // The VCS looks paths up in its trees, which always separate them with '/'
+    if(!path.IsEmpty())
+    {
+        path = wxFileName(path).GetFullPath(wxPATH_UNIX);
+    }
+
+    m_HistoryPanel->ShowHistory(vcs, path, title.IsEmpty() ? wxString(_("Repository")) : title);
+    CodeBlocksDockEvent evt(cbEVT_SHOW_DOCK_WINDOW);
+    evt.pWindow = m_HistoryPanel;
+    Manager::Get()->ProcessEvent(evt);
+}
+
+void cbvcs::UpdateVcsInfo(cbProject* prj, vcsProjectTracker& prjTracker)
+{
+#ifdef PROJECTMANAGER_VCSINFO_SUPPORT
+    IVersionControlSystem& vcs = prjTracker.GetVcs();
+    wxString info;
+    // Cached by the VCS until HEAD or the refs change, editor activation asks for it all the time
+    VcsBranchInfo branch;
+    if (!vcs.GetBranchInfo(branch))
+    {
+        branch.branch = vcs.GetBranch();
+    }
+    if (!branch.branch.IsEmpty())
+    {
+        info = "br: " + branch.branch;
+    }
+    else if (branch.detached && !branch.head.IsEmpty())
+    {
+        info = "detached: " + branch.head;
+    }
+    else
+    {
+        fprintf(stderr, "cbvcs::%s:%d branch empty\n", __FUNCTION__, __LINE__);
+    }
+    if (branch.countsKnown && (branch.ahead || branch.behind))
+    {
+        info += wxString::Format(" +%lu -%lu", (unsigned long)branch.ahead, (unsigned long)branch.behind);
+    }
+
+    const VcsStateCounts counts = vcs.GetStatusTable().GetCounts(wxEmptyString);
+    if (!counts.IsEmpty())
+    {
+        info += wxString::Format(" M%u A%u C%u ?%u", counts.modified, counts.added, counts.conflicted, counts.untracked);
+    }
+
+    if (!info.IsEmpty())
+    {
+        prj->SetVcsInfo(info);
+    }
+#endif
+}
+
 void cbvcs::OnProjectActivate(CodeBlocksEvent& event)
 {
     cbProject* prj = event.GetProject();
@@ -447,6 +1102,38 @@ void cbvcs::OnProjectActivate(CodeBlocksEvent& event)
     }
 
     IVersionControlSystem& vcs = prjTracker->GetVcs();
+    VcsBranchInfo branch;
+    vcs.GetBranchInfo(branch);
+    // HEAD as the blames were last made against
+    wxString head = branch.head;
+    vcs.SetStatesChangedHandler([this, prjFilename, head](const std::vector<wxString>& paths) mutable
+    {
+        cbProject* project = Manager::Get()->GetProjectManager()->IsOpen(prjFilename);
+        vcsProjectTracker* tracker = m_ProjectTrackers.GetTracker(prjFilename);
+        if (!project || !tracker)
+        {
+            return;
+        }
+        UpdateVcsInfo(project, *tracker);
+        IVersionControlSystem& trackedVcs = tracker->GetVcs();
+        // Add, commit and restore change what the editors of these files are compared with
+        m_ChangeMarkers.ReloadBases(trackedVcs, paths);
+        VcsBranchInfo current;
+        trackedVcs.GetBranchInfo(current);
+        const bool headMoved = current.head != head;
+        head = current.head;
+        m_BlameGutter.Refresh(trackedVcs, paths, headMoved);
+    });
+    // The files are as they were, only the label needs updating
+    vcs.SetBranchChangedHandler([this, prjFilename]()
+    {
+        cbProject* project = Manager::Get()->GetProjectManager()->IsOpen(prjFilename);
+        vcsProjectTracker* tracker = m_ProjectTrackers.GetTracker(prjFilename);
+        if (project && tracker)
+        {
+            UpdateVcsInfo(project, *tracker);
+        }
+    });
 
     std::vector<std::shared_ptr<VcsTreeItem>>files;
     for ( int i = 0; i < prj->GetFilesCount(); ++i )
@@ -473,6 +1160,11 @@ void cbvcs::OnProjectClose( CodeBlocksEvent& event )
     {
         IVersionControlSystem& vcs = prjTracker->GetVcs();
         vcs.UpdateFullOp->stopExecution();
+        if(m_HistoryPanel)
+        {
+            m_HistoryPanel->Forget(vcs);
+        }
+        m_BlameGutter.Forget(vcs);
         m_ProjectTrackers.RemoveTracker(prj_file);
     }
     else
@@ -515,6 +1207,12 @@ void cbvcs::OnEditorUpdate(CodeBlocksEvent& event)
         return;
     }
 
+    // While the buffer has unsaved edits its state is worked out in memory, the file on disk is stale anyway
+    if(event.GetEventType() == cbEVT_EDITOR_MODIFIED && ed->GetModified() && m_ChangeMarkers.UpdateBufferState(ed))
+    {
+        return;
+    }
+
     cbProject* prj = Manager::Get()->GetProjectManager()->GetActiveProject();
 
     if(!prj)
@@ -547,7 +1245,6 @@ void cbvcs::OnEditorUpdate(CodeBlocksEvent& event)
 
 void cbvcs::OnEditorActivated(CodeBlocksEvent& event)
 {
-#ifdef PROJECTMANAGER_VCSINFO_SUPPORT
     cbEditor* ed = (cbEditor*)event.GetEditor();
 
     if (!ed)
@@ -557,6 +1254,11 @@ void cbvcs::OnEditorActivated(CodeBlocksEvent& event)
         return;
     }
 
+    // Not every editor is a text editor
+    m_ChangeMarkers.ReloadBase(Manager::Get()->GetEditorManager()->GetBuiltinEditor(event.GetEditor()));
+
+#ifdef PROJECTMANAGER_VCSINFO_SUPPORT
+
     cbProject* prj = Manager::Get()->GetProjectManager()->GetActiveProject();
 
     if (!prj)
@@ -573,14 +1275,12 @@ void cbvcs::OnEditorActivated(CodeBlocksEvent& event)
         // Project not tracked
         return;
     }
-    wxString branch = prjTracker->GetVcs().GetBranch();
-    if (branch.IsEmpty())
-    {
-        fprintf(stderr, "cbvcs::%s:%d branch empty\n", __FUNCTION__, __LINE__);
-    }
-    else
-    {
-        prj->SetVcsInfo("br: " + branch);
-    }
+    UpdateVcsInfo(prj, *prjTracker);
 #endif
 }
+
+void cbvcs::OnEditorClose(CodeBlocksEvent& event)
+{
+    m_ChangeMarkers.Remove((cbEditor*)event.GetEditor());
+    m_BlameGutter.Remove((cbEditor*)event.GetEditor());
+}
@@ -30,11 +30,16 @@
 #include <cbplugin.h> // for "class cbPlugin"
 
 #include "vcstrackermap.h"
+#include "VcsBlameGutter.h"
+#include "VcsChangeMarkers.h"
+#include "VcsFileOp.h"
 
 class VcsFileOp;
 class VcsTreeItem;
 class TreeItemVector;
 class vcsProjectTracker;
+class IVersionControlSystem;
+class VcsHistoryPanel;
 class ShellUtilImpl;
 
 class cbvcs : public cbPlugin
@@ -139,14 +144,35 @@ class cbvcs : public cbPlugin
         DECLARE_EVENT_TABLE();
 
         VcsTrackerMap m_ProjectTrackers;
+        VcsChangeMarkers m_ChangeMarkers;
+        VcsBlameGutter m_BlameGutter;
         ShellUtilImpl m_ShellUtils;
+        VcsDiffTarget m_DiffTarget;
+        wxString m_DiffRevision;
+        VcsRestoreSource m_RestoreSource;
+        wxString m_RestoreRevision;
+        VcsHistoryPanel* m_HistoryPanel;
 
         vcsProjectTracker* GetVcsInstance(const FileTreeData*);
         void GetFileItem(std::vector<std::shared_ptr<VcsTreeItem>>& treeVector, const wxTreeCtrl&, const wxTreeItemId&);
         void GetDescendents(std::vector<std::shared_ptr<VcsTreeItem>>& treeVector, const wxTreeCtrl&, const wxTreeItemId&);
         void CreateProjectMenu(wxMenu* menu, const FileTreeData* data);
         void CreateFileMenu(wxMenu* menu, const FileTreeData* data);
-        void CreateFolderMenu(wxMenu* menu);
+        void CreateFolderMenu(wxMenu* menu, const FileTreeData* data);
+        void CreateEditorMenu(wxMenu* menu);
+        void AppendChangeSummary(wxMenu* menu, const FileTreeData* data, const wxString& folder);
+        void AppendDiffMenu(wxMenu* menu);
+        void AppendRestoreMenu(wxMenu* menu);
+        wxString GetFolderRelativePath(IVersionControlSystem& vcs, const FileTreeData& data);
+        void UpdateVcsInfo(cbProject* prj, vcsProjectTracker& prjTracker);
+        /** VCS tracking the file of ed, or 0 */
+        IVersionControlSystem* GetEditorVcs(cbEditor* ed, wxString& relativePath);
+        /** Tracker and project of the project tree selection, or 0 */
+        vcsProjectTracker* GetSelectedProject(cbProject*& prj);
+        /** Every file of prj, for the ops that work out which of them they touch */
+        std::vector<std::shared_ptr<VcsTreeItem>> GetProjectFiles(cbProject* prj);
+        /** Pick a ref of kind and check it out over the selected project */
+        void CheckoutRef(VcsRefKind kind, const wxString& title);
 
         void PerformGroupAction(vcsProjectTracker&, VcsFileOp&, const wxTreeCtrl&, wxTreeItemId&, const FileTreeData&);
         void OnAdd( wxCommandEvent& event );
@@ -155,11 +181,25 @@ class cbvcs : public cbPlugin
         void OnDiff( wxCommandEvent& event );
         void OnRestore( wxCommandEvent& event );
         void OnRefresh( wxCommandEvent& event );
+        void OnNextChanged( wxCommandEvent& event );
+        void OnStageLines( wxCommandEvent& event );
+        void OnHistory( wxCommandEvent& event );
+        void OnBlame( wxCommandEvent& event );
+        void OnResolveConflict( wxCommandEvent& event );
+        void OnBranchCreate( wxCommandEvent& event );
+        void OnBranchCheckout( wxCommandEvent& event );
+        void OnBranchMerge( wxCommandEvent& event );
+        void OnFetch( wxCommandEvent& event );
+        void OnStashSave( wxCommandEvent& event );
+        void OnStashApply( wxCommandEvent& event );
+        void OnTagCreate( wxCommandEvent& event );
+        void OnTagCheckout( wxCommandEvent& event );
         void OnProjectActivate(CodeBlocksEvent&);
         void OnProjectSave( CodeBlocksEvent& );
         void OnProjectClose( CodeBlocksEvent& );
         void OnEditorUpdate(CodeBlocksEvent&);
         void OnEditorActivated(CodeBlocksEvent&);
+        void OnEditorClose(CodeBlocksEvent&);
         enum  VcsAction : unsigned int;
         void PerformGroupActionOnSelection(VcsAction);
 };
@@ -0,0 +1,227 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "git_branch_info.h"
+#include "git_libgit2_wrapper.h"
+#include <cstring>
+#include <wx/filefn.h>
+
+namespace
+{
+const char kBranchPrefix[] = "refs/heads/";
+const size_t kShortIdSize = 7;
+} // namespace
+
+const VcsBranchInfo &GitBranchInfo::Get()
+{
+    const wxString signature = Signature();
+    if (!m_read || signature != m_signature)
+    {
+        const std::vector<wxString> watched = m_watched;
+        Read();
+        // Taken before reading, so that a ref moving meanwhile is read again next time. It only covers the files
+        // watched before; if Read() watches others, the next call reads again.
+        m_signature = (watched == m_watched) ? signature : wxString();
+        m_read = true;
+    }
+    return m_info;
+}
+
+void GitBranchInfo::Stop()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_countMutex);
+        m_abort = true;
+        m_countWanted.notify_one();
+    }
+    if (m_countThread.joinable())
+    {
+        m_countThread.join();
+    }
+    m_abort = false;
+}
+
+// Git replaces refs by renaming a new file over them, so the inode changes even when size and time do not
+wxString GitBranchInfo::Signature() const
+{
+    wxString signature;
+    for (const wxString &path : m_watched)
+    {
+        wxStructStat st;
+        if (wxStat(path, &st) == 0)
+        {
+            signature += wxString::Format(wxT("%lld:%lld:%lld;"), (long long)st.st_ino, (long long)st.st_size, (long long)st.st_mtime);
+        }
+        else
+        {
+            signature += wxT("-;");
+        }
+    }
+    return signature;
+}
+
+void GitBranchInfo::Read()
+{
+    VcsBranchInfo info;
+    m_watched.clear();
+    GitRepo gitRepo(m_vcsRootDir);
+    git_repository *repo = gitRepo.m_repo;
+    if (!repo)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        m_info = info;
+        return;
+    }
+    const wxString gitDir = wxString::FromUTF8(git_repository_path(repo));
+    const wxString commonDir = wxString::FromUTF8(git_repository_commondir(repo));
+    m_watched.push_back(gitDir + wxT("HEAD"));
+    m_watched.push_back(commonDir + wxT("packed-refs"));
+    m_watched.push_back(commonDir + wxT("config"));
+
+    // HEAD is looked up rather than resolved, so that an unborn branch still has its name
+    git_reference *head = nullptr;
+    std::string branchRef;
+    if (0 == git_reference_lookup(&head, repo, "HEAD"))
+    {
+        if (GIT_REFERENCE_SYMBOLIC == git_reference_type(head))
+        {
+            branchRef = git_reference_symbolic_target(head);
+            m_watched.push_back(commonDir + wxString::FromUTF8(branchRef.c_str()));
+            if (0 == branchRef.compare(0, sizeof(kBranchPrefix) - 1, kBranchPrefix))
+            {
+                info.branch = wxString::FromUTF8(branchRef.c_str() + sizeof(kBranchPrefix) - 1);
+            }
+        }
+        else
+        {
+            info.detached = true;
+        }
+        git_reference_free(head);
+    }
+
+    char hex[GIT_OID_HEXSZ + 1];
+    git_oid headId;
+    if (0 != git_reference_name_to_id(&headId, repo, "HEAD"))
+    {
+        // Unborn, there is nothing to count either
+        m_info = info;
+        return;
+    }
+    git_oid_tostr(hex, sizeof(hex), &headId);
+    info.head = wxString::FromUTF8(std::string(hex, kShortIdSize).c_str());
+    const std::string local(hex);
+
+    std::string upstream;
+    git_reference *branch = nullptr;
+    git_reference *upstreamRef = nullptr;
+    if (!branchRef.empty() && 0 == git_reference_lookup(&branch, repo, branchRef.c_str()) &&
+        0 == git_branch_upstream(&upstreamRef, branch))
+    {
+        info.upstream = wxString::FromUTF8(git_reference_shorthand(upstreamRef));
+        m_watched.push_back(commonDir + wxString::FromUTF8(git_reference_name(upstreamRef)));
+        const git_oid *upstreamId = git_reference_target(upstreamRef);
+        if (upstreamId)
+        {
+            upstream = git_oid_tostr(hex, sizeof(hex), upstreamId);
+        }
+    }
+    git_reference_free(upstreamRef);
+    git_reference_free(branch);
+
+    if (!upstream.empty())
+    {
+        std::lock_guard<std::mutex> lock(m_countMutex);
+        if (m_count.local == local && m_count.upstream == upstream)
+        {
+            // Only the config or an unrelated ref changed
+            info.countsKnown = m_count.counted;
+            info.ahead = m_count.ahead;
+            info.behind = m_count.behind;
+        }
+        else
+        {
+            m_count = Count();
+            m_count.local = local;
+            m_count.upstream = upstream;
+            if (!m_countThread.joinable())
+            {
+                m_countThread = std::thread(&GitBranchInfo::CountAheadBehind, this);
+            }
+            m_countWanted.notify_one();
+        }
+    }
+    m_info = info;
+}
+
+void GitBranchInfo::CountAheadBehind()
+{
+    std::unique_lock<std::mutex> lock(m_countMutex);
+    for (;;)
+    {
+        m_countWanted.wait(lock, [this]() { return m_abort || (!m_count.done && !m_count.local.empty()); });
+        if (m_abort)
+        {
+            return;
+        }
+        const Count wanted = m_count;
+        lock.unlock();
+
+        Count counted = wanted;
+        git_oid local, upstream;
+        GitRepo gitRepo(m_vcsRootDir);
+        int error = -1;
+        if (gitRepo.m_repo && 0 == git_oid_fromstr(&local, wanted.local.c_str()) && 0 == git_oid_fromstr(&upstream, wanted.upstream.c_str()))
+        {
+            error = git_graph_ahead_behind(&counted.ahead, &counted.behind, gitRepo.m_repo, &local, &upstream);
+        }
+        if (0 != error)
+        {
+            const git_error *e = git_error_last();
+            fprintf(stderr, "LibGit2::%s:%d git_graph_ahead_behind failed : %d: %s\n", __FUNCTION__, __LINE__, error, e ? e->message : "");
+        }
+
+        lock.lock();
+        // Keep the count only if HEAD and the upstream did not move meanwhile; otherwise count again
+        if (m_count.local == wanted.local && m_count.upstream == wanted.upstream)
+        {
+            m_count.done = true;
+            m_count.counted = 0 == error;
+            m_count.ahead = counted.ahead;
+            m_count.behind = counted.behind;
+            if (m_count.counted)
+            {
+                CallAfter(&GitBranchInfo::OnCounted);
+            }
+        }
+    }
+}
+
+void GitBranchInfo::OnCounted()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_countMutex);
+        if (!m_count.counted)
+        {
+            return;
+        }
+        m_info.countsKnown = true;
+        m_info.ahead = m_count.ahead;
+        m_info.behind = m_count.behind;
+    }
+    m_vcs.NotifyBranchChanged();
+}
@@ -0,0 +1,71 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GIT_BRANCH_INFO_H_INCLUDED
+#define GIT_BRANCH_INFO_H_INCLUDED
+
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <wx/event.h>
+#include "IVersionControlSystem.h"
+
+// Branch, HEAD and upstream of a repository, read once and then only when HEAD, the refs it follows or the
+// config change on disk. Ahead and behind counts are worked out on a worker, as walking diverged histories
+// can take a while; the branch changed handler is called when they arrive.
+class GitBranchInfo : public wxEvtHandler
+{
+  public:
+    GitBranchInfo(IVersionControlSystem &vcs, const wxString &vcsRootDir) : m_vcs(vcs), m_vcsRootDir(vcsRootDir) {}
+    ~GitBranchInfo() { Stop(); }
+    const VcsBranchInfo &Get();
+    void Stop();
+
+  private:
+    struct Count
+    {
+        // Hex ids of HEAD and the upstream
+        std::string local;
+        std::string upstream;
+        size_t ahead{0};
+        size_t behind{0};
+        // Done is set once the worker tried, counted once it succeeded
+        bool done{false};
+        bool counted{false};
+    };
+    void Read();
+    wxString Signature() const;
+    void CountAheadBehind();
+    void OnCounted();
+    IVersionControlSystem &m_vcs;
+    const wxString &m_vcsRootDir;
+    VcsBranchInfo m_info;
+    // Files whose change makes m_info stale, and their state when it was read
+    std::vector<wxString> m_watched;
+    wxString m_signature;
+    bool m_read{false};
+    // The last count asked for; the worker takes it when it is not done yet
+    Count m_count;
+    std::mutex m_countMutex;
+    std::condition_variable m_countWanted;
+    bool m_abort{false};
+    std::thread m_countThread;
+};
+
+#endif // GIT_BRANCH_INFO_H_INCLUDED
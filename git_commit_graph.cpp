@@ -0,0 +1,412 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "git_commit_graph.h"
+
+#include <algorithm>
+#include <cstring>
+#include <wx/ffile.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/textfile.h>
+
+namespace
+{
+const size_t kIdSize = 20;
+const size_t kBloomHeaderSize = 12;
+const char kCacheMagic[] = "CBVCSCP1";
+// The cache file is rewritten at this size, keeping the newest filters up to half of it
+const size_t kMaxCacheSize = 16 * 1024 * 1024;
+
+uint32_t Get32(const unsigned char *p)
+{
+    return ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | (uint32_t)p[3];
+}
+
+uint64_t Get64(const unsigned char *p)
+{
+    return ((uint64_t)Get32(p) << 32) | Get32(p + 4);
+}
+
+void Put32(unsigned char *p, uint32_t value)
+{
+    p[0] = (unsigned char)(value >> 24);
+    p[1] = (unsigned char)(value >> 16);
+    p[2] = (unsigned char)(value >> 8);
+    p[3] = (unsigned char)value;
+}
+
+bool ReadFile(const wxString &path, std::vector<unsigned char> &data)
+{
+    wxFFile file;
+    if (!wxFileExists(path) || !file.Open(path, "rb"))
+    {
+        return false;
+    }
+    data.resize((size_t)file.Length());
+    return data.empty() || file.Read(&data[0], data.size()) == data.size();
+}
+
+// Changes whenever git rewrites one of the files
+wxString FileSignature(const wxString &path)
+{
+    wxStructStat st;
+    if (wxStat(path, &st) != 0)
+    {
+        return wxEmptyString;
+    }
+    return wxString::Format(wxT("%s:%lld:%lld;"), path, (long long)st.st_size, (long long)st.st_mtime);
+}
+} // namespace
+
+void GitCommitGraph::Load(const wxString &objectsDir)
+{
+    // Like git, a single commit-graph file wins over a chain of split graphs
+    std::vector<wxString> files;
+    const wxString single = objectsDir + wxT("/info/commit-graph");
+    if (wxFileExists(single))
+    {
+        files.push_back(single);
+    }
+    else
+    {
+        const wxString chainDir = objectsDir + wxT("/info/commit-graphs/");
+        wxTextFile chain;
+        if (wxFileExists(chainDir + wxT("commit-graph-chain")) && chain.Open(chainDir + wxT("commit-graph-chain")))
+        {
+            for (size_t i = 0; i < chain.GetLineCount(); ++i)
+            {
+                wxString line = chain.GetLine(i);
+                line.Trim();
+                if (!line.IsEmpty())
+                {
+                    files.push_back(chainDir + wxT("graph-") + line + wxT(".graph"));
+                }
+            }
+        }
+    }
+
+    wxString signature;
+    for (const wxString &file : files)
+    {
+        signature += FileSignature(file);
+    }
+    if (signature == m_signature)
+    {
+        return;
+    }
+    m_signature = signature;
+    m_layers.clear();
+    for (const wxString &file : files)
+    {
+        std::vector<unsigned char> data;
+        if (!ReadFile(file, data) || !AddLayer(std::move(data)))
+        {
+            fprintf(stderr, "LibGit2::%s:%d ignoring %s\n", __FUNCTION__, __LINE__, file.ToUTF8().data());
+        }
+    }
+}
+
+bool GitCommitGraph::AddLayer(std::vector<unsigned char> data)
+{
+    // Header: signature, version, hash version, chunk count, base graph count
+    if (data.size() < 8 || memcmp(&data[0], "CGPH", 4) != 0 || data[4] != 1 || data[5] != 1)
+    {
+        return false;
+    }
+    const size_t numChunks = data[6];
+    if (data.size() < 8 + (numChunks + 1) * 12)
+    {
+        return false;
+    }
+
+    Layer layer;
+    const unsigned char *base = &data[0];
+    for (size_t i = 0; i < numChunks; ++i)
+    {
+        const unsigned char *entry = base + 8 + i * 12;
+        const uint64_t offset = Get64(entry + 4);
+        const uint64_t end = Get64(entry + 16);
+        if (offset > end || end > data.size())
+        {
+            return false;
+        }
+        const unsigned char *chunk = base + offset;
+        const size_t size = (size_t)(end - offset);
+        switch (Get32(entry))
+        {
+        case 0x4f494446: // OIDF
+            layer.fanout = size == 256 * 4 ? chunk : nullptr;
+            break;
+        case 0x4f49444c: // OIDL
+            layer.ids = chunk;
+            layer.count = (uint32_t)(size / kIdSize);
+            break;
+        case 0x42494458: // BIDX
+            layer.index = chunk;
+            break;
+        case 0x42444154: // BDAT
+            if (size >= kBloomHeaderSize)
+            {
+                layer.filters = chunk;
+                layer.filtersSize = size;
+                layer.settings.hashVersion = Get32(chunk);
+                layer.settings.numHashes = Get32(chunk + 4);
+                layer.settings.bitsPerEntry = Get32(chunk + 8);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+    if (!layer.fanout || !layer.ids || Get32(layer.fanout + 255 * 4) != layer.count)
+    {
+        return false;
+    }
+    if (layer.settings.hashVersion != 1 && layer.settings.hashVersion != 2)
+    {
+        layer.filters = nullptr;
+    }
+    // The pointers stay valid, moving a vector keeps its buffer
+    layer.data = std::move(data);
+    m_layers.push_back(std::move(layer));
+    return true;
+}
+
+bool GitCommitGraph::HasFilters() const
+{
+    for (const Layer &layer : m_layers)
+    {
+        if (layer.index && layer.filters)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+GitCommitGraph::Query GitCommitGraph::MakeQuery(const std::string &path) const
+{
+    Query query;
+    for (const Layer &layer : m_layers)
+    {
+        query.push_back(VcsBloomFilter::MakePathKeys(path, layer.settings));
+    }
+    return query;
+}
+
+VcsBloomFilter::Result GitCommitGraph::Lookup(const unsigned char *id, const Query &query) const
+{
+    for (size_t i = 0; i < m_layers.size() && i < query.size(); ++i)
+    {
+        const Layer &layer = m_layers[i];
+        uint32_t low = id[0] ? Get32(layer.fanout + (id[0] - 1) * 4) : 0;
+        uint32_t high = Get32(layer.fanout + id[0] * 4);
+        while (low < high)
+        {
+            const uint32_t middle = low + (high - low) / 2;
+            const int order = memcmp(layer.ids + (size_t)middle * kIdSize, id, kIdSize);
+            if (order == 0)
+            {
+                if (!layer.index || !layer.filters)
+                {
+                    return VcsBloomFilter::Bloom_Unknown;
+                }
+                const uint32_t start = middle ? Get32(layer.index + (middle - 1) * 4) : 0;
+                const uint32_t end = Get32(layer.index + middle * 4);
+                if (start > end || kBloomHeaderSize + end > layer.filtersSize)
+                {
+                    return VcsBloomFilter::Bloom_Unknown;
+                }
+                return VcsBloomFilter::Lookup(layer.filters + kBloomHeaderSize + start, end - start, query[i]);
+            }
+            if (order < 0)
+            {
+                low = middle + 1;
+            }
+            else
+            {
+                high = middle;
+            }
+        }
+    }
+    return VcsBloomFilter::Bloom_Unknown;
+}
+
+void GitChangedPathCache::Load(const wxString &path)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_loaded && path == m_path)
+    {
+        return;
+    }
+    m_loaded = true;
+    m_path = path;
+    m_filters.clear();
+    m_order.clear();
+    m_unsaved.clear();
+    m_fileSize = 0;
+    m_broken = false;
+
+    // Magic, then records of id, filter length and filter
+    std::vector<unsigned char> data;
+    const size_t magicSize = sizeof(kCacheMagic) - 1;
+    if (!ReadFile(path, data))
+    {
+        return;
+    }
+    if (data.size() < magicSize || memcmp(&data[0], kCacheMagic, magicSize) != 0)
+    {
+        m_broken = true;
+        return;
+    }
+    size_t pos = magicSize;
+    while (pos + kIdSize + 4 <= data.size())
+    {
+        const uint32_t length = Get32(&data[pos + kIdSize]);
+        if (pos + kIdSize + 4 + length > data.size())
+        {
+            break;
+        }
+        const std::string key((const char *)&data[pos], kIdSize);
+        if (m_filters.insert(std::make_pair(key, std::string((const char *)&data[pos + kIdSize + 4], length))).second)
+        {
+            m_order.push_back(key);
+        }
+        pos += kIdSize + 4 + length;
+    }
+    // A save that stopped half way leaves part of a record, which records appended later would be read as
+    m_fileSize = pos;
+    m_broken = pos != data.size();
+}
+
+VcsBloomFilter::Result GitChangedPathCache::Lookup(const unsigned char *id, const std::vector<VcsBloomFilter::Key> &keys) const
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    auto it = m_filters.find(std::string((const char *)id, kIdSize));
+    if (it == m_filters.end())
+    {
+        return VcsBloomFilter::Bloom_Unknown;
+    }
+    return VcsBloomFilter::Lookup((const unsigned char *)it->second.data(), it->second.size(), keys);
+}
+
+void GitChangedPathCache::Add(const unsigned char *id, const std::string &filter)
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    const std::string key((const char *)id, kIdSize);
+    if (m_filters.insert(std::make_pair(key, filter)).second)
+    {
+        m_order.push_back(key);
+        m_unsaved.push_back(key);
+    }
+}
+
+void GitChangedPathCache::Save()
+{
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (m_unsaved.empty() || m_path.IsEmpty())
+    {
+        return;
+    }
+    std::string records;
+    for (const std::string &key : m_unsaved)
+    {
+        records += MakeRecord(key);
+    }
+    if (m_broken || m_fileSize + records.size() > kMaxCacheSize)
+    {
+        Rewrite();
+        return;
+    }
+    const bool exists = wxFileExists(m_path);
+    wxFFile file;
+    if (!file.Open(m_path, "ab"))
+    {
+        fprintf(stderr, "LibGit2::%s:%d opening %s failed\n", __FUNCTION__, __LINE__, m_path.ToUTF8().data());
+        return;
+    }
+    if (!exists)
+    {
+        records.insert(0, kCacheMagic);
+    }
+    if (!file.Write(records.data(), records.size()))
+    {
+        fprintf(stderr, "LibGit2::%s:%d writing %s failed\n", __FUNCTION__, __LINE__, m_path.ToUTF8().data());
+        // Whatever part of it made it to the file is not a record
+        m_broken = true;
+        return;
+    }
+    m_fileSize += records.size();
+    m_unsaved.clear();
+}
+
+std::string GitChangedPathCache::MakeRecord(const std::string &key) const
+{
+    const std::string &filter = m_filters.find(key)->second;
+    unsigned char length[4];
+    Put32(length, (uint32_t)filter.size());
+    std::string record(key);
+    record.append((const char *)length, sizeof(length));
+    record += filter;
+    return record;
+}
+
+void GitChangedPathCache::Rewrite()
+{
+    // The newest filters are those of the histories read last
+    size_t kept = 0;
+    size_t size = sizeof(kCacheMagic) - 1;
+    while (kept < m_order.size())
+    {
+        const size_t recordSize = kIdSize + 4 + m_filters[m_order[m_order.size() - kept - 1]].size();
+        if (size + recordSize > kMaxCacheSize / 2)
+        {
+            break;
+        }
+        size += recordSize;
+        ++kept;
+    }
+    const size_t dropped = m_order.size() - kept;
+    for (size_t i = 0; i < dropped; ++i)
+    {
+        m_filters.erase(m_order[i]);
+    }
+    m_order.erase(m_order.begin(), m_order.begin() + dropped);
+
+    std::string content(kCacheMagic);
+    content.reserve(size);
+    for (const std::string &key : m_order)
+    {
+        content += MakeRecord(key);
+    }
+    // Written next to the file and renamed over it, so that it is never seen half written
+    const wxString newPath = m_path + wxT(".new");
+    wxFFile file;
+    bool written = file.Open(newPath, "wb") && file.Write(content.data(), content.size()) && file.Close();
+    written = written && wxRenameFile(newPath, m_path, true);
+    if (!written)
+    {
+        fprintf(stderr, "LibGit2::%s:%d rewriting %s failed\n", __FUNCTION__, __LINE__, m_path.ToUTF8().data());
+        wxRemoveFile(newPath);
+        return;
+    }
+    fprintf(stderr, "LibGit2::%s:%d kept %zu filters, dropped %zu\n", __FUNCTION__, __LINE__, kept, dropped);
+    m_fileSize = content.size();
+    m_broken = false;
+    m_unsaved.clear();
+}
@@ -0,0 +1,97 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GIT_COMMIT_GRAPH_H_INCLUDED
+#define GIT_COMMIT_GRAPH_H_INCLUDED
+
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <wx/string.h>
+#include "VcsBloomFilter.h"
+
+// Changed-path filters of the commit-graph git writes with `git commit-graph write --changed-paths`.
+// libgit2 reads the commit-graph but does not expose the filters, so the file, or the chain of split
+// graphs, is read here. Commit ids are the 20 raw bytes of a SHA-1.
+class GitCommitGraph
+{
+  public:
+    // Keys of one path, for each graph layer
+    typedef std::vector<std::vector<VcsBloomFilter::Key>> Query;
+
+    // Loads the graph of the objects folder, unless the files are unchanged since the last load
+    void Load(const wxString &objectsDir);
+    bool HasFilters() const;
+    Query MakeQuery(const std::string &path) const;
+    // Bloom_Unknown for commits the graph does not hold, or holds without a filter
+    VcsBloomFilter::Result Lookup(const unsigned char *id, const Query &query) const;
+    // Adds a graph file read into memory, returns false if it is not one
+    bool AddLayer(std::vector<unsigned char> data);
+
+  private:
+    struct Layer
+    {
+        std::vector<unsigned char> data;
+        const unsigned char *fanout{nullptr};
+        const unsigned char *ids{nullptr};
+        const unsigned char *index{nullptr};
+        const unsigned char *filters{nullptr};
+        size_t filtersSize{0};
+        uint32_t count{0};
+        VcsBloomFilter::Settings settings;
+    };
+    std::vector<Layer> m_layers;
+    // Names, sizes and times of the files last loaded
+    wxString m_signature;
+};
+
+// Changed-path filters the plugin made itself, for commits the commit-graph has no filter for.
+// They are kept in a file in the git folder, which grows as histories are read until it is rewritten
+// with only the newest filters.
+class GitChangedPathCache
+{
+  public:
+    // Reads the cache file once
+    void Load(const wxString &path);
+    VcsBloomFilter::Result Lookup(const unsigned char *id, const std::vector<VcsBloomFilter::Key> &keys) const;
+    void Add(const unsigned char *id, const std::string &filter);
+    // Appends the filters added since the last save to the file, or rewrites it if it got too big or
+    // ends in a broken record
+    void Save();
+    const VcsBloomFilter::Settings &GetSettings() const { return m_settings; }
+
+  private:
+    mutable std::mutex m_mutex;
+    wxString m_path;
+    bool m_loaded{false};
+    VcsBloomFilter::Settings m_settings;
+    std::map<std::string, std::string> m_filters;
+    // Keys of m_filters, oldest first
+    std::vector<std::string> m_order;
+    std::vector<std::string> m_unsaved;
+    // Bytes of the file up to the end of its last good record
+    size_t m_fileSize{0};
+    // Whether anything but good records follows the magic, or the magic itself is wrong
+    bool m_broken{false};
+
+    std::string MakeRecord(const std::string &key) const;
+    // Writes the newest filters to a new file, and forgets the others
+    void Rewrite();
+};
+
+#endif // GIT_COMMIT_GRAPH_H_INCLUDED
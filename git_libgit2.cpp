@@ -18,15 +18,22 @@
 */
 
 #include "git_libgit2.h"
+#include "VcsBlameTable.h"
+#include "VcsCommitTable.h"
+#include "VcsConflictFile.h"
+#include "VcsHunkStaging.h"
 #include "git_libgit2_wrapper.h"
 #include "icommandexecuter.h"
+#include <algorithm>
 #include <git2.h>
 #include <manager.h>
 #include <wx/dir.h>
+#include <wx/ffile.h>
 #include <wx/string.h>
 
 LibGit2::LibGit2(const wxString &project, ICommandExecuter &cmdExecutor, wxString workDirectory)
-    : IVersionControlSystem(project, &m_GitUpdate, &m_GitAdd, &m_GitRemove, &m_GitCommit, &m_GitDiff, &m_GitRestore, &m_GitUpdateFull),
+    : IVersionControlSystem(project, &m_GitUpdate, &m_GitAdd, &m_GitRemove, &m_GitCommit, &m_GitDiff, &m_GitRestore, &m_GitUpdateFull,
+                            &m_GitCheckout, &m_GitMerge, &m_GitStash, &m_GitFetch),
       m_workDirectory(std::move(workDirectory)),
       m_CmdExecutor(cmdExecutor),
       m_GitUpdate(*this, m_GitRoot, m_CmdExecutor),
@@ -35,13 +42,36 @@ LibGit2::LibGit2(const wxString &project, ICommandExecuter &cmdExecutor, wxStrin
       m_GitCommit(*this, m_GitRoot, m_CmdExecutor),
       m_GitDiff(*this, m_GitRoot, m_CmdExecutor),
       m_GitRestore(*this, m_GitRoot, m_CmdExecutor),
-      m_GitUpdateFull(*this, m_GitRoot, m_CmdExecutor)
+      m_GitUpdateFull(*this, m_GitRoot, m_CmdExecutor),
+      m_GitCheckout(*this, m_GitRoot, m_CmdExecutor),
+      m_GitMerge(*this, m_GitRoot, m_CmdExecutor),
+      m_GitStash(*this, m_GitRoot, m_CmdExecutor),
+      m_GitFetch(*this, m_GitRoot, m_CmdExecutor),
+      m_Blames(new GitBlameCache),
+      m_BranchInfo(*this, m_GitRoot)
 {
     git_libgit2_init();
     m_GitRoot = QueryRoot(m_workDirectory.ToUTF8().data());
 }
 
-LibGit2::~LibGit2() { git_libgit2_shutdown(); }
+LibGit2::~LibGit2()
+{
+    // Background workers must be done with libgit2 before it is shut down
+    m_GitUpdateFull.stopExecution();
+    m_GitAdd.stopExecution();
+    m_GitRemove.stopExecution();
+    m_GitDiff.stopExecution();
+    m_GitCommit.stopExecution();
+    m_GitRestore.stopExecution();
+    m_GitCheckout.stopExecution();
+    m_GitMerge.stopExecution();
+    m_GitStash.stopExecution();
+    m_GitFetch.stopExecution();
+    m_BranchInfo.Stop();
+    m_Blames.reset();
+    m_IndexPass.reset();
+    git_libgit2_shutdown();
+}
 
 wxString LibGit2::QueryRoot(const char *gitWorkDirInProject)
 {
@@ -155,38 +185,980 @@ wxString LibGit2::QueryRoot(const char *gitWorkDirInProject)
 
 wxString LibGit2::GetBranch()
 {
+    return m_BranchInfo.Get().branch;
+}
+
+bool LibGit2::GetBranchInfo(VcsBranchInfo &info)
+{
+    info = m_BranchInfo.Get();
+    return true;
+}
+
+void LibGit2::BeginIndexPass()
+{
+    m_IndexPass.reset(new GitRepoIndex(m_GitRoot));
+}
+
+void LibGit2::EndIndexPass()
+{
+    m_IndexPass.reset();
+}
+
+GitRepoIndex &LibGit2::IndexForRead(std::unique_ptr<GitRepoIndex> &own)
+{
+    if (m_IndexPass)
+    {
+        return *m_IndexPass;
+    }
+    own.reset(new GitRepoIndex(m_GitRoot));
+    return *own;
+}
+
+bool LibGit2::GetIndexedFile(const wxString &path, std::string &id, std::string &content)
+{
+    // Only read, so the index is used as it was loaded for this call or pass
+    std::unique_ptr<GitRepoIndex> own;
+    GitRepoIndex &gitRepoIndex = IndexForRead(own);
+    git_repository *repo = gitRepoIndex.m_gitRepo.m_repo;
+    git_index *index = gitRepoIndex.m_idx;
+    if (!index)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    const wxScopedCharBuffer relativePath = path.ToUTF8();
+    const git_index_entry *entry = git_index_get_bypath(index, relativePath.data(), 0);
+    if (!entry)
+    {
+        return false;
+    }
+    char hex[GIT_OID_HEXSZ + 1];
+    const std::string entryId = git_oid_tostr(hex, sizeof(hex), &entry->id);
+    if (entryId == id)
+    {
+        return true;
+    }
+
+    git_blob *blob;
+    int error = git_blob_lookup(&blob, repo, &entry->id);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_blob_lookup failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    // Apply the checkout filters so that line endings match what the editor loaded
+    git_buf filtered = {0};
+    git_blob_filter_options opts = GIT_BLOB_FILTER_OPTIONS_INIT;
+    error = git_blob_filter(&filtered, blob, relativePath.data(), &opts);
+    if (0 == error)
+    {
+        content.assign(filtered.ptr, filtered.size);
+        id = entryId;
+    }
+    else
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_blob_filter failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+    }
+    git_buf_free(&filtered);
+    git_blob_free(blob);
+    return 0 == error;
+}
+
+bool LibGit2::GetIndexedStates(const wxString &path, ItemState &unchanged, ItemState &changed)
+{
+    std::unique_ptr<GitRepoIndex> own;
+    GitRepo &gitRepo = IndexForRead(own).m_gitRepo;
+    if (!gitRepo.m_repo)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    std::string relativePath(path.ToUTF8().data());
+    char *pathspec = &relativePath[0];
+    git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+    opts.show = GIT_STATUS_SHOW_INDEX_ONLY;
+    opts.flags = GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+    opts.pathspec.strings = &pathspec;
+    opts.pathspec.count = 1;
+    git_status_list *statusList;
+    int error = git_status_list_new(&statusList, gitRepo.m_repo, &opts);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_status_list_new failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    unsigned int statusFlags = 0;
+    if (git_status_list_entrycount(statusList) > 0)
+    {
+        statusFlags = git_status_byindex(statusList, 0)->status;
+    }
+    git_status_list_free(statusList);
+    unchanged = getItemStateFromLibGit2StatusFlag(statusFlags);
+    changed = getItemStateFromLibGit2StatusFlag(statusFlags | GIT_STATUS_WT_MODIFIED);
+    return true;
+}
+
+bool LibGit2::HashBuffer(const char *data, size_t length, std::string &id)
+{
+    git_oid oid;
+    int error = git_odb_hash(&oid, data, length, GIT_OBJECT_BLOB);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_odb_hash failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    char hex[GIT_OID_HEXSZ + 1];
+    id = git_oid_tostr(hex, sizeof(hex), &oid);
+    return true;
+}
+
+static int line_hunk_cb(const git_diff_delta *delta, const git_diff_hunk *hunk, void *payload)
+{
+    (void)delta;
+    std::vector<VcsLineHunk> &hunks = *(std::vector<VcsLineHunk> *)payload;
+    // git numbers lines from 1, and an empty side starts at the line before
+    VcsLineHunk lineHunk = {hunk->old_lines ? hunk->old_start - 1 : hunk->old_start, hunk->old_lines,
+                            hunk->new_lines ? hunk->new_start - 1 : hunk->new_start, hunk->new_lines};
+    hunks.push_back(lineHunk);
+    return 0;
+}
+
+bool LibGit2::DiffBuffers(const std::string &base, const std::string &buffer, std::vector<VcsLineHunk> &hunks)
+{
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    opts.flags = GIT_DIFF_FORCE_TEXT;
+    opts.context_lines = 0;
+    opts.interhunk_lines = 0;
+    int error = git_diff_buffers(base.data(), base.size(), NULL, buffer.data(), buffer.size(), NULL, &opts, NULL, NULL, line_hunk_cb, NULL, &hunks);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_diff_buffers failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    return true;
+}
+
+bool LibGit2::GetCommitPatch(const wxString &path, std::string &patch)
+{
+    GitRepo gitRepo(m_GitRoot);
+    git_repository *repo = gitRepo.m_repo;
+    if (!repo)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    // The commit stages the working copy, so HEAD is diffed against the file on disk.
+    // An unborn HEAD has no tree yet, the file is diffed against the empty tree.
+    git_object *tree = nullptr;
+    if (0 != git_revparse_single(&tree, repo, "HEAD^{tree}"))
+    {
+        tree = nullptr;
+    }
+    std::string relativePath(path.ToUTF8().data());
+    char *pathspec = &relativePath[0];
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    opts.flags = GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+    opts.pathspec.strings = &pathspec;
+    opts.pathspec.count = 1;
+    git_diff *diff;
+    int error = git_diff_tree_to_workdir_with_index(&diff, repo, (git_tree *)tree, &opts);
+    git_object_free(tree);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_diff_tree_to_workdir_with_index failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass,
+                e->message);
+        return false;
+    }
+
+    patch.clear();
+    git_buf buf = {0};
+    for (size_t i = 0; i < git_diff_num_deltas(diff) && 0 == error; ++i)
+    {
+        git_patch *gitPatch;
+        error = git_patch_from_diff(&gitPatch, diff, i);
+        if (0 == error && gitPatch)
+        {
+            error = git_patch_to_buf(&buf, gitPatch);
+            git_patch_free(gitPatch);
+            if (0 == error)
+            {
+                patch.append(buf.ptr, buf.size);
+            }
+            git_buf_free(&buf);
+        }
+    }
+    git_diff_free(diff);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d patch failed for %s : %d/%d: %s\n", __FUNCTION__, __LINE__, relativePath.c_str(), error, e->klass, e->message);
+        return false;
+    }
+    return true;
+}
+
+// Hunks of the only patch in diff, with the line numbers made 0 based
+static bool GetPatchHunks(git_diff *diff, std::vector<VcsPatchHunk> &hunks)
+{
+    git_patch *patch;
+    int error = git_patch_from_diff(&patch, diff, 0);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_patch_from_diff failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    if (!patch)
+    {
+        // Binary files have no lines to pick from
+        return false;
+    }
+    const size_t numHunks = git_patch_num_hunks(patch);
+    hunks.resize(numHunks);
+    for (size_t i = 0; i < numHunks && 0 == error; ++i)
+    {
+        const git_diff_hunk *gitHunk;
+        size_t numLines;
+        error = git_patch_get_hunk(&gitHunk, &numLines, patch, i);
+        if (0 != error)
+        {
+            break;
+        }
+        // A hunk that adds or removes lines only is numbered after the line it follows
+        hunks[i].oldStart = gitHunk->old_lines ? gitHunk->old_start - 1 : gitHunk->old_start;
+        hunks[i].newStart = gitHunk->new_lines ? gitHunk->new_start - 1 : gitHunk->new_start;
+        for (size_t j = 0; j < numLines; ++j)
+        {
+            const git_diff_line *line;
+            error = git_patch_get_line_in_hunk(&line, patch, i, j);
+            if (0 != error)
+            {
+                break;
+            }
+            // The end of file markers only tell about a missing line end, which the content already shows
+            if (line->origin == GIT_DIFF_LINE_CONTEXT || line->origin == GIT_DIFF_LINE_ADDITION || line->origin == GIT_DIFF_LINE_DELETION)
+            {
+                VcsPatchLine patchLine = {line->origin, std::string(line->content, line->content_len)};
+                hunks[i].lines.push_back(patchLine);
+            }
+        }
+    }
+    git_patch_free(patch);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d reading hunks failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    return true;
+}
+
+bool LibGit2::StageLines(const wxString &path, int first, int last, bool wholeHunks)
+{
+    GitRepoIndex gitRepoIndex(m_GitRoot);
+    git_repository *repo = gitRepoIndex.m_gitRepo.m_repo;
+    if (!gitRepoIndex.m_idx)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    std::string relativePath(path.ToUTF8().data());
+    const git_index_entry *entry = git_index_get_bypath(gitRepoIndex.m_idx, relativePath.c_str(), 0);
+    if (!entry)
+    {
+        // New files are staged as a whole
+        fprintf(stderr, "LibGit2::%s:%d %s is not in the index\n", __FUNCTION__, __LINE__, relativePath.c_str());
+        return false;
+    }
+
+    // Only this file is diffed, and only when a part of it is staged.
+    // Without context lines the hunks are the ones the change markers show.
+    char *pathspec = &relativePath[0];
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    opts.flags = GIT_DIFF_DISABLE_PATHSPEC_MATCH;
+    opts.context_lines = 0;
+    opts.interhunk_lines = 0;
+    opts.pathspec.strings = &pathspec;
+    opts.pathspec.count = 1;
+    git_diff *diff;
+    int error = git_diff_index_to_workdir(&diff, repo, gitRepoIndex.m_idx, &opts);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_diff_index_to_workdir failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    std::vector<VcsPatchHunk> hunks;
+    bool hasHunks = git_diff_num_deltas(diff) == 1 && GetPatchHunks(diff, hunks);
+    git_diff_free(diff);
+    if (!hasHunks || hunks.empty())
+    {
+        return false;
+    }
+
+    git_blob *blob;
+    error = git_blob_lookup(&blob, repo, &entry->id);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_blob_lookup failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    // The patch is made from the working copy after the clean filters, so it applies to the blob as stored
+    const std::string base((const char *)git_blob_rawcontent(blob), (size_t)git_blob_rawsize(blob));
+    git_blob_free(blob);
+    const std::string staged = VcsApplyHunks(base, hunks, first, last, wholeHunks);
+    if (staged == base)
+    {
+        return false;
+    }
+
+    git_index_entry stagedEntry = *entry;
+    error = git_blob_create_from_buffer(&stagedEntry.id, repo, staged.data(), staged.size());
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_blob_create_from_buffer failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    // The entry no longer matches the file on disk, so its stat data must not vouch for it
+    stagedEntry.file_size = (uint32_t)staged.size();
+    stagedEntry.ctime.seconds = stagedEntry.ctime.nanoseconds = 0;
+    stagedEntry.mtime.seconds = stagedEntry.mtime.nanoseconds = 0;
+    stagedEntry.dev = stagedEntry.ino = 0;
+    error = git_index_add(gitRepoIndex.m_idx, &stagedEntry);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_index_add failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    gitRepoIndex.SetModified();
+    return 0 == gitRepoIndex.Write();
+}
+
+namespace
+{
+// Commits read between two looks at whether the history panel wants more
+const size_t kHistoryPageSize = 500;
+// Commits walked between two looks while none of them is listed
+const size_t kHistorySkipSize = 10000;
+} // namespace
+
+// Id of the tree or blob at path in the tree of commit
+static bool GetPathId(git_commit *commit, const char *path, git_oid &id)
+{
+    git_tree *tree;
+    if (0 != git_commit_tree(&tree, commit))
+    {
+        return false;
+    }
+    git_tree_entry *entry;
+    bool found = 0 == git_tree_entry_bypath(&entry, tree, path);
+    if (found)
+    {
+        git_oid_cpy(&id, git_tree_entry_id(entry));
+        git_tree_entry_free(entry);
+    }
+    git_tree_free(tree);
+    return found;
+}
+
+// Whether commit changed path against its first parent. Only the entries along path are looked up, no trees are diffed.
+static bool ChangesPath(git_commit *commit, const char *path)
+{
+    git_oid id;
+    const bool found = GetPathId(commit, path, id);
+    git_commit *parent;
+    if (0 == git_commit_parentcount(commit) || 0 != git_commit_parent(&parent, commit, 0))
+    {
+        return found;
+    }
+    git_oid parentId;
+    const bool parentFound = GetPathId(parent, path, parentId);
+    git_commit_free(parent);
+    if (found != parentFound)
+    {
+        return true;
+    }
+    return found && !git_oid_equal(&id, &parentId);
+}
+
+// Paths commit changed against its first parent, the way git makes its changed-path filters
+static bool GetChangedPaths(git_repository *repo, git_commit *commit, std::vector<std::string> &paths)
+{
+    git_tree *tree;
+    if (0 != git_commit_tree(&tree, commit))
+    {
+        return false;
+    }
+    git_commit *parent = nullptr;
+    git_tree *parentTree = nullptr;
+    if (0 < git_commit_parentcount(commit) && 0 == git_commit_parent(&parent, commit, 0))
+    {
+        git_commit_tree(&parentTree, parent);
+    }
+    git_diff *diff;
+    const int error = git_diff_tree_to_tree(&diff, repo, parentTree, tree, nullptr);
+    if (0 == error)
+    {
+        for (size_t i = 0; i < git_diff_num_deltas(diff); ++i)
+        {
+            const git_diff_delta *delta = git_diff_get_delta(diff, i);
+            paths.push_back(delta->new_file.path);
+            if (0 != strcmp(delta->old_file.path, delta->new_file.path))
+            {
+                paths.push_back(delta->old_file.path);
+            }
+        }
+        git_diff_free(diff);
+    }
+    git_tree_free(parentTree);
+    git_commit_free(parent);
+    git_tree_free(tree);
+    return 0 == error;
+}
+
+bool LibGit2::ReadHistory(const wxString &path, VcsCommitTable &table, const HistoryPageHandler &pageRead)
+{
+    wxStopWatch sw;
+    GitRepo gitRepo(m_GitRoot);
+    git_repository *repo = gitRepo.m_repo;
+    if (!repo)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    git_revwalk *walk;
+    int error = git_revwalk_new(&walk, repo);
+    if (0 == error)
+    {
+        git_revwalk_sorting(walk, GIT_SORT_TIME);
+        error = git_revwalk_push_head(walk);
+    }
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d starting the walk failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        git_revwalk_free(walk);
+        // An unborn HEAD has no history yet
+        return GIT_EUNBORNBRANCH == error || GIT_ENOTFOUND == error;
+    }
+
+    std::string filter(path.ToUTF8().data());
+    while (!filter.empty() && '/' == filter.back())
+    {
+        filter.pop_back();
+    }
+
+    // Changed-path filters rule out most commits of a file history before they are even looked up
+    std::unique_lock<std::mutex> lock(m_HistoryMutex, std::defer_lock);
+    GitCommitGraph::Query graphQuery;
+    std::vector<VcsBloomFilter::Key> cacheKeys;
+    const wxString commonDir = wxString::FromUTF8(git_repository_commondir(repo));
+    auto loadFilters = [&]()
+    {
+        m_CommitGraph.Load(commonDir + wxT("objects"));
+        m_ChangedPaths.Load(commonDir + wxT("cbvcs-changed-paths"));
+        graphQuery = m_CommitGraph.MakeQuery(filter);
+        cacheKeys = VcsBloomFilter::MakePathKeys(filter, m_ChangedPaths.GetSettings());
+    };
+    if (!filter.empty())
+    {
+        lock.lock();
+        loadFilters();
+    }
+    // Other history reads get the filters while this one waits for the page to be taken in. One of them may
+    // have loaded a newer commit-graph meanwhile, so the queries are made again.
+    auto waitForPage = [&]()
+    {
+        if (!lock.owns_lock())
+        {
+            return pageRead();
+        }
+        lock.unlock();
+        const bool more = pageRead();
+        lock.lock();
+        loadFilters();
+        return more;
+    };
+
+    size_t walked = 0;
+    size_t skipped = 0;
+    size_t built = 0;
+    size_t inPage = 0;
+    size_t sinceLook = 0;
+    git_oid id;
+    while (0 == git_revwalk_next(&id, walk))
+    {
+        ++walked;
+        if (++sinceLook == kHistorySkipSize)
+        {
+            // Long stretches of commits that do not touch path still give a chance to stop
+            sinceLook = 0;
+            if (!waitForPage())
+            {
+                break;
+            }
+        }
+        VcsBloomFilter::Result mayChange = VcsBloomFilter::Bloom_Maybe;
+        if (!filter.empty())
+        {
+            mayChange = m_CommitGraph.Lookup(id.id, graphQuery);
+            if (VcsBloomFilter::Bloom_Unknown == mayChange)
+            {
+                mayChange = m_ChangedPaths.Lookup(id.id, cacheKeys);
+            }
+            if (VcsBloomFilter::Bloom_No == mayChange)
+            {
+                ++skipped;
+                continue;
+            }
+        }
+        git_commit *commit;
+        if (0 != git_commit_lookup(&commit, repo, &id))
+        {
+            continue;
+        }
+        bool listed = filter.empty();
+        if (VcsBloomFilter::Bloom_Unknown == mayChange)
+        {
+            // Neither filter knows the commit, the diff made for its filter answers exactly
+            std::vector<std::string> changed;
+            if (GetChangedPaths(repo, commit, changed))
+            {
+                m_ChangedPaths.Add(id.id, VcsBloomFilter::Build(changed, m_ChangedPaths.GetSettings()));
+                ++built;
+                for (const std::string &changedPath : changed)
+                {
+                    if (0 == changedPath.compare(0, filter.size(), filter) &&
+                        (changedPath.size() == filter.size() || '/' == changedPath[filter.size()]))
+                    {
+                        listed = true;
+                        break;
+                    }
+                }
+            }
+            else
+            {
+                listed = ChangesPath(commit, filter.c_str());
+            }
+        }
+        else if (!listed)
+        {
+            listed = ChangesPath(commit, filter.c_str());
+        }
+        if (listed)
+        {
+            sinceLook = 0;
+            char hex[GIT_OID_HEXSZ + 1];
+            const git_signature *author = git_commit_author(commit);
+            table.Append(git_oid_tostr(hex, sizeof(hex), &id), author ? author->name : nullptr, git_commit_summary(commit),
+                         (time_t)git_commit_time(commit));
+            ++inPage;
+        }
+        git_commit_free(commit);
+        if (inPage == kHistoryPageSize)
+        {
+            inPage = 0;
+            if (!waitForPage())
+            {
+                break;
+            }
+        }
+    }
+    git_revwalk_free(walk);
+    if (!filter.empty())
+    {
+        m_ChangedPaths.Save();
+    }
+    fprintf(stderr, "LibGit2::%s:%d listed %zu of %zu commits in %ld ms, %zu skipped by filters, %zu filters built\n", __FUNCTION__,
+            __LINE__, table.Count(), walked, sw.Time(), skipped, built);
+    return true;
+}
+
+static int CountLines(const std::string &buffer)
+{
+    const int lines = (int)std::count(buffer.begin(), buffer.end(), '\n');
+    return (buffer.empty() || '\n' == buffer.back()) ? lines : lines + 1;
+}
+
+bool LibGit2::BlameBuffer(const wxString &path, const std::string &buffer, VcsBlameTable &table)
+{
+    std::lock_guard<std::mutex> lock(m_BlameMutex);
+    git_repository *repo = m_Blames->GetRepo(m_GitRoot);
+    if (!repo)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    const std::string relativePath(path.ToUTF8().data());
+    git_oid head;
+    int error = git_reference_name_to_id(&head, repo, "HEAD");
+    if (GIT_ENOTFOUND == error || GIT_EUNBORNBRANCH == error)
+    {
+        // Nothing is committed yet
+        table.Append(0, CountLines(buffer), std::string(), nullptr, 0);
+        return true;
+    }
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_reference_name_to_id failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+
+    // Blaming the committed file walks its history; keyed by HEAD, it is done once per commit
+    char hex[GIT_OID_HEXSZ + 1];
+    std::string key = relativePath;
+    key.push_back('\0');
+    key.append(git_oid_tostr(hex, sizeof(hex), &head));
+    git_blame *committed = m_Blames->Find(key);
+    if (!committed)
+    {
+        wxStopWatch sw;
+        git_blame_options options = GIT_BLAME_OPTIONS_INIT;
+        git_oid_cpy(&options.newest_commit, &head);
+        error = git_blame_file(&committed, repo, relativePath.c_str(), &options);
+        if (GIT_ENOTFOUND == error)
+        {
+            table.Append(0, CountLines(buffer), std::string(), nullptr, 0);
+            return true;
+        }
+        if (0 != error)
+        {
+            const git_error *e = git_error_last();
+            fprintf(stderr, "LibGit2::%s:%d git_blame_file failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+            return false;
+        }
+        m_Blames->Add(key, committed);
+        fprintf(stderr, "LibGit2::%s:%d blamed %s in %ld ms\n", __FUNCTION__, __LINE__, relativePath.c_str(), sw.Time());
+    }
+
+    // The committed blame is of the clean content, so the buffer goes through the same filters, e.g. CRLF conversion
+    git_filter_list *filters = nullptr;
+    git_buf clean = {0};
+    const char *data = buffer.data();
+    size_t length = buffer.size();
+    if (0 == git_filter_list_load(&filters, repo, nullptr, relativePath.c_str(), GIT_FILTER_TO_ODB, GIT_FILTER_DEFAULT) && filters &&
+        0 == git_filter_list_apply_to_buffer(&clean, filters, data, length))
+    {
+        data = clean.ptr;
+        length = clean.size;
+    }
+    git_blame *blame;
+    error = git_blame_buffer(&blame, committed, data, length);
+    git_buf_dispose(&clean);
+    git_filter_list_free(filters);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_blame_buffer failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    const uint32_t count = git_blame_get_hunk_count(blame);
+    for (uint32_t i = 0; i < count; ++i)
+    {
+        const git_blame_hunk *hunk = git_blame_get_hunk_byindex(blame, i);
+        // Lines that are not in the committed file have no commit
+        const bool committedLines = !git_oid_is_zero(&hunk->final_commit_id);
+        const git_signature *author = hunk->final_signature;
+        table.Append((int)hunk->final_start_line_number - 1, (int)hunk->lines_in_hunk,
+                     committedLines ? git_oid_tostr(hex, sizeof(hex), &hunk->final_commit_id) : std::string(),
+                     author ? author->name : nullptr, author ? (time_t)author->when.time : 0);
+    }
+    git_blame_free(blame);
+    return true;
+}
+
+static int CollectStash(size_t index, const char *message, const git_oid * /*stash_id*/, void *payload)
+{
+    const LibGit2::RefHandler &handler = *static_cast<const LibGit2::RefHandler *>(payload);
+    return handler(wxString::Format(wxT("stash@{%lu}: "), (unsigned long)index) + wxString::FromUTF8(message ? message : "")) ? 0 : GIT_EUSER;
+}
+
+bool LibGit2::ListRefs(VcsRefKind kind, const RefHandler &handler)
+{
+    GitRepo gitRepo(m_GitRoot);
+    git_repository *repo = gitRepo.m_repo;
+    if (!repo)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    if (VcsRef_Stash == kind)
+    {
+        // The entries are the reflog of refs/stash, no commit is loaded to list them
+        int error = git_stash_foreach(repo, CollectStash, const_cast<RefHandler *>(&handler));
+        return 0 == error || GIT_EUSER == error;
+    }
+    const std::string prefix = (VcsRef_Tag == kind) ? "refs/tags/" : "refs/heads/";
+    // Only the names are read, from the loose refs and packed-refs; no ref is resolved to its object
+    git_reference_iterator *it;
+    int error = git_reference_iterator_glob_new(&it, repo, (prefix + "*").c_str());
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_reference_iterator_glob_new failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return false;
+    }
+    const char *name;
+    while (0 == (error = git_reference_next_name(&name, it)))
+    {
+        if (!handler(wxString::FromUTF8(name + prefix.size())))
+        {
+            break;
+        }
+    }
+    git_reference_iterator_free(it);
+    return 0 == error || GIT_ITEROVER == error;
+}
+
+bool LibGit2::CreateBranch(const wxString &name, bool checkout)
+{
+    const std::string branch(name.ToUTF8().data());
+    int valid = 0;
+    if (0 != git_branch_name_is_valid(&valid, branch.c_str()) || !valid)
+    {
+        cbMessageBox(wxString::Format(_("'%s' is not a valid branch name"), name), _("Create branch"), wxICON_ERROR);
+        return false;
+    }
     GitRepo gitRepo(m_GitRoot);
-    wxString branch;
-    git_repository* repo = gitRepo.m_repo;
+    git_repository *repo = gitRepo.m_repo;
     if (!repo)
     {
         fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
-        return branch;
+        return false;
     }
-    git_reference* head = nullptr;
-    int error = git_repository_head(&head, repo);
-    if (error == GIT_EUNBORNBRANCH)
+    git_object *head = nullptr;
+    int error = git_revparse_single(&head, repo, "HEAD^{commit}");
+    if (0 != error)
     {
-        fprintf(stderr, "LibGit2::%s:%d Repository has no commits (unborn branch).\n", __FUNCTION__, __LINE__);
+        cbMessageBox(_("A branch needs a commit to start from, the repository has none yet"), _("Create branch"), wxICON_ERROR);
+        return false;
     }
-    else if (error < 0)
+    git_reference *ref = nullptr;
+    error = git_branch_create(&ref, repo, branch.c_str(), (const git_commit *)head, 0);
+    git_object_free(head);
+    if (0 == error && checkout)
     {
-        const git_error* e = git_error_last();
-        fprintf(stderr, "LibGit2::%s:%d Failed to get HEAD: %s\n", __FUNCTION__, __LINE__,
-                e ? e->message : "unknown error");
+        // The new branch is at HEAD, so the working tree and index already match it
+        error = git_repository_set_head(repo, git_reference_name(ref));
     }
-    else if (git_reference_is_branch(head))
+    git_reference_free(ref);
+    if (0 != error)
     {
-        const char* branch_name = nullptr;
-        git_branch_name(&branch_name, head);
-        branch = branch_name;
-        fprintf(stderr, "LibGit2::%s:%d Current branch: %s\n", __FUNCTION__, __LINE__, branch_name);
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d creating branch %s failed : %d: %s\n", __FUNCTION__, __LINE__, branch.c_str(), error, e ? e->message : "");
+        cbMessageBox(GIT_EEXISTS == error ? wxString::Format(_("A branch named '%s' already exists"), name)
+                                          : wxString::Format(_("Creating branch %s failed: %s"), name, e ? wxString::FromUTF8(e->message) : wxString()),
+                     _("Create branch"), wxICON_ERROR);
+        return false;
+    }
+    NotifyBranchChanged();
+    return true;
+}
+
+bool LibGit2::CreateTag(const wxString &name, const wxString &message)
+{
+    const std::string tag(name.ToUTF8().data());
+    int valid = 0;
+    if (0 != git_tag_name_is_valid(&valid, tag.c_str()) || !valid)
+    {
+        cbMessageBox(wxString::Format(_("'%s' is not a valid tag name"), name), _("Create tag"), wxICON_ERROR);
+        return false;
+    }
+    GitRepo gitRepo(m_GitRoot);
+    git_repository *repo = gitRepo.m_repo;
+    if (!repo)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    git_object *head = nullptr;
+    int error = git_revparse_single(&head, repo, "HEAD^{commit}");
+    if (0 != error)
+    {
+        cbMessageBox(_("There is no commit to tag, the repository has none yet"), _("Create tag"), wxICON_ERROR);
+        return false;
+    }
+    git_oid id;
+    if (message.IsEmpty())
+    {
+        error = git_tag_create_lightweight(&id, repo, tag.c_str(), head, 0);
     }
     else
     {
-        fprintf(stderr, "LibGit2::%s:%d Detached HEAD state.\n", __FUNCTION__, __LINE__);
+        git_signature *sig = nullptr;
+        error = git_signature_default(&sig, repo);
+        if (0 == error)
+        {
+            error = git_tag_create(&id, repo, tag.c_str(), head, sig, message.ToUTF8().data(), 0);
+            git_signature_free(sig);
+        }
+    }
+    git_object_free(head);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d creating tag %s failed : %d: %s\n", __FUNCTION__, __LINE__, tag.c_str(), error, e ? e->message : "");
+        cbMessageBox(GIT_EEXISTS == error ? wxString::Format(_("A tag named '%s' already exists"), name)
+                                          : wxString::Format(_("Creating tag %s failed: %s"), name, e ? wxString::FromUTF8(e->message) : wxString()),
+                     _("Create tag"), wxICON_ERROR);
+        return false;
     }
+    return true;
+}
 
-    git_reference_free(head);
-    return branch;
+namespace
+{
+// The file as each side has it, with every conflict region taken from that side. Neither depends on how
+// far the merge grew the regions, on the labels of the markers, or on whether the base was written.
+void SidesOf(const std::string &marked, std::string &ours, std::string &theirs)
+{
+    VcsConflictFile file;
+    const size_t regions = file.Parse(marked);
+    for (size_t i = 0; i < regions; ++i)
+    {
+        file.Resolve(i, VcsConflictFile::Conflict_Ours);
+    }
+    ours = file.Compose();
+    for (size_t i = 0; i < regions; ++i)
+    {
+        file.Resolve(i, VcsConflictFile::Conflict_Theirs);
+    }
+    theirs = file.Compose();
+}
+
+// Whether workingTree is other than the merge left it, merged being the same merge in diff3 style
+bool EditedSinceMerge(const std::string &workingTree, const std::string &merged)
+{
+    std::string workingOurs, workingTheirs, mergedOurs, mergedTheirs;
+    SidesOf(workingTree, workingOurs, workingTheirs);
+    SidesOf(merged, mergedOurs, mergedTheirs);
+    return workingOurs != mergedOurs || workingTheirs != mergedTheirs;
+}
+
+// The working tree file at relativePath as it would be stored, i.e. through the clean filters
+bool ReadWorkingTreeFile(git_repository *repo, const wxString &path, const std::string &relativePath, std::string &content)
+{
+    wxFFile file;
+    if (!file.Open(path, wxT("rb")))
+    {
+        return false;
+    }
+    const wxFileOffset length = file.Length();
+    content.resize(length > 0 ? length : 0);
+    const bool read = content.empty() || file.Read(&content[0], content.size()) == content.size();
+    file.Close();
+    git_filter_list *filters = nullptr;
+    git_buf cleaned = {0};
+    if (read && 0 == git_filter_list_load(&filters, repo, nullptr, relativePath.c_str(), GIT_FILTER_TO_ODB, GIT_FILTER_DEFAULT) && filters &&
+        0 == git_filter_list_apply_to_buffer(&cleaned, filters, content.data(), content.size()))
+    {
+        content.assign(cleaned.ptr, cleaned.size);
+    }
+    git_buf_dispose(&cleaned);
+    git_filter_list_free(filters);
+    return read;
+}
+} // namespace
+
+bool LibGit2::GetConflict(const wxString &path, std::string &merged)
+{
+    const std::string relativePath(wxFileName(path).GetFullPath(wxPATH_UNIX).ToUTF8().data());
+    GitRepoIndex gitRepoIndex(m_GitRoot);
+    if (!gitRepoIndex.m_idx)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+    const git_index_entry *ancestor;
+    const git_index_entry *ours;
+    const git_index_entry *theirs;
+    int error = git_index_conflict_get(&ancestor, &ours, &theirs, gitRepoIndex.m_idx, relativePath.c_str());
+    if (0 != error)
+    {
+        fprintf(stderr, "LibGit2::%s:%d %s has no conflict in the index : %d\n", __FUNCTION__, __LINE__, relativePath.c_str(), error);
+        return false;
+    }
+    // The merge is redone from the stages with the base shown between the sides
+    git_repository *repo = gitRepoIndex.m_gitRepo.m_repo;
+    git_merge_file_options opts = GIT_MERGE_FILE_OPTIONS_INIT;
+    opts.flags = GIT_MERGE_FILE_STYLE_DIFF3;
+    git_merge_file_result diff3 = {0};
+    error = git_merge_file_from_index(&diff3, repo, ancestor, ours, theirs, &opts);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_merge_file_from_index failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e ? e->klass : 0,
+                e ? e->message : "");
+        return false;
+    }
+    merged.assign(diff3.ptr ? diff3.ptr : "", diff3.len);
+    git_merge_file_result_free(&diff3);
+    // Edits made to the file since the merge are what gets resolved, at the cost of the base
+    std::string workingTree;
+    if (ReadWorkingTreeFile(repo, m_GitRoot + wxFileName::GetPathSeparator() + path, relativePath, workingTree) &&
+        EditedSinceMerge(workingTree, merged))
+    {
+        fprintf(stderr, "LibGit2::%s:%d %s was edited since the merge, resolving the working tree file\n", __FUNCTION__, __LINE__,
+                relativePath.c_str());
+        merged.swap(workingTree);
+    }
+    return true;
+}
+
+bool LibGit2::ResolveConflict(const wxString &path, const std::string &content)
+{
+    const std::string relativePath(wxFileName(path).GetFullPath(wxPATH_UNIX).ToUTF8().data());
+    GitRepoIndex gitRepoIndex(m_GitRoot);
+    git_repository *repo = gitRepoIndex.m_gitRepo.m_repo;
+    if (!gitRepoIndex.m_idx)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
+        return false;
+    }
+
+    // The merged content is as stored, the working tree gets it through the smudge filters, e.g. CRLF conversion
+    git_filter_list *filters = nullptr;
+    git_buf smudged = {0};
+    const char *data = content.data();
+    size_t length = content.size();
+    if (0 == git_filter_list_load(&filters, repo, nullptr, relativePath.c_str(), GIT_FILTER_TO_WORKTREE, GIT_FILTER_DEFAULT) && filters &&
+        0 == git_filter_list_apply_to_buffer(&smudged, filters, data, length))
+    {
+        data = smudged.ptr;
+        length = smudged.size;
+    }
+    wxFFile file;
+    const bool written = file.Open(m_GitRoot + wxFileName::GetPathSeparator() + path, wxT("wb")) && file.Write(data, length) == length;
+    file.Close();
+    git_buf_dispose(&smudged);
+    git_filter_list_free(filters);
+    if (!written)
+    {
+        cbMessageBox(wxString::Format(_("%s could not be written"), path), _("Resolve conflict"), wxICON_ERROR);
+        return false;
+    }
+
+    // One entry replaces the three stages, which are kept as resolve-undo information
+    int error = git_index_add_bypath(gitRepoIndex.m_idx, relativePath.c_str());
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_index_add_bypath failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e ? e->klass : 0,
+                e ? e->message : "");
+        cbMessageBox(wxString::Format(_("%s could not be staged: %s"), path, wxString::FromUTF8(e ? e->message : "")), _("Resolve conflict"),
+                     wxICON_ERROR);
+        return false;
+    }
+    gitRepoIndex.SetModified();
+    return true;
 }
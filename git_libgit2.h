@@ -19,8 +19,15 @@
 #define LibGit2_H
 
 #include "IVersionControlSystem.h"
+#include "VcsDiffCache.h"
+#include "git_branch_info.h"
+#include "git_commit_graph.h"
 #include "git_libgit2_ops.h"
+#include <memory>
+#include <mutex>
 
+class GitBlameCache;
+class GitRepoIndex;
 class wxArrayString;
 
 class LibGit2 : public IVersionControlSystem
@@ -32,6 +39,33 @@ class LibGit2 : public IVersionControlSystem
 
     virtual bool move(std::vector<VcsTreeItem *> &) override { return false; }
     wxString GetBranch() override;
+    bool GetBranchInfo(VcsBranchInfo &info) override;
+    wxString GetRoot() const override { return m_GitRoot; }
+    void SetDiffTarget(VcsDiffTarget target, const wxString &revision) override { m_GitDiff.SetTarget(target, revision); }
+    void SetRestoreSource(VcsRestoreSource source, const wxString &revision) override { m_GitRestore.SetSource(source, revision); }
+    void SetCheckoutTarget(VcsRefKind kind, const wxString &name) override { m_GitCheckout.SetTarget(kind, name); }
+    void SetMergeSource(const wxString &branch) override { m_GitMerge.SetSource(branch); }
+    void SetStashAction(VcsStashAction action, size_t entry, const wxString &message, bool keepIndex) override
+    {
+        m_GitStash.SetAction(action, entry, message, keepIndex);
+    }
+    void SetPull(bool pull) override { m_GitFetch.SetPull(pull); }
+    bool ListRefs(VcsRefKind kind, const RefHandler &handler) override;
+    bool CreateBranch(const wxString &name, bool checkout) override;
+    bool CreateTag(const wxString &name, const wxString &message) override;
+    bool GetConflict(const wxString &path, std::string &merged) override;
+    bool ResolveConflict(const wxString &path, const std::string &content) override;
+    VcsDiffCache &GetDiffCache() { return m_DiffCache; }
+    bool GetIndexedFile(const wxString &path, std::string &id, std::string &content) override;
+    bool GetIndexedStates(const wxString &path, ItemState &unchanged, ItemState &changed) override;
+    void BeginIndexPass() override;
+    void EndIndexPass() override;
+    bool HashBuffer(const char *data, size_t length, std::string &id) override;
+    bool DiffBuffers(const std::string &base, const std::string &buffer, std::vector<VcsLineHunk> &hunks) override;
+    bool GetCommitPatch(const wxString &path, std::string &patch) override;
+    bool StageLines(const wxString &path, int first, int last, bool wholeHunks) override;
+    bool ReadHistory(const wxString &path, VcsCommitTable &table, const HistoryPageHandler &pageRead) override;
+    bool BlameBuffer(const wxString &path, const std::string &buffer, VcsBlameTable &table) override;
 
   protected:
     wxString m_workDirectory;
@@ -46,8 +80,24 @@ class LibGit2 : public IVersionControlSystem
     LibGit2DiffOp m_GitDiff;
     LibGit2RestoreOp m_GitRestore;
     LibGit2UpdateFullOp m_GitUpdateFull;
+    LibGit2CheckoutOp m_GitCheckout;
+    LibGit2MergeOp m_GitMerge;
+    LibGit2StashOp m_GitStash;
+    LibGit2FetchOp m_GitFetch;
+    VcsDiffCache m_DiffCache;
+    // Changed-path filters for file histories, used by one history read at a time
+    GitCommitGraph m_CommitGraph;
+    GitChangedPathCache m_ChangedPaths;
+    std::mutex m_HistoryMutex;
+    std::unique_ptr<GitBlameCache> m_Blames;
+    std::mutex m_BlameMutex;
+    GitBranchInfo m_BranchInfo;
+    // Open between BeginIndexPass() and EndIndexPass()
+    std::unique_ptr<GitRepoIndex> m_IndexPass;
 
     wxString QueryRoot(const char *);
+    // The index of the current pass, or one opened into own for a single call
+    GitRepoIndex &IndexForRead(std::unique_ptr<GitRepoIndex> &own);
 };
 
 #endif // GIT_H
@@ -20,19 +20,33 @@
 #include "git_libgit2_ops.h"
 #include "CommitMsgDialog.h"
 #include "VcsTreeItem.h"
+#include "git_libgit2.h"
 #include "git_libgit2_wrapper.h"
 #include "icommandexecuter.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <iterator>
+#include <set>
 #include <cbeditor.h>
 #include <cbstyledtextctrl.h>
 #include <editormanager.h>
 #include <git2.h>
 #include <manager.h>
+#include <wx/choicdlg.h>
+#include <wx/ffile.h>
+#include <wx/process.h>
 
 ItemState getItemStateFromLibGit2StatusFlag(unsigned int statusFlags)
 {
     ItemState status;
 
-    if (statusFlags & GIT_STATUS_INDEX_NEW)
+    // A conflicted path also shows as changed in the working tree, the conflict is what matters
+    if (statusFlags & GIT_STATUS_CONFLICTED)
+    {
+        status = Item_Conflicted;
+    }
+    else if (statusFlags & GIT_STATUS_INDEX_NEW)
     {
         status = Item_Added;
     }
@@ -52,10 +66,6 @@ ItemState getItemStateFromLibGit2StatusFlag(unsigned int statusFlags)
     {
         status = Item_Removed;
     }
-    else if (statusFlags & GIT_STATUS_CONFLICTED)
-    {
-        status = Item_Conflicted;
-    }
     else if (statusFlags & GIT_STATUS_WT_NEW)
     {
         status = Item_Untracked;
@@ -76,10 +86,6 @@ ItemState getItemStateFromLibGit2StatusFlag(unsigned int statusFlags)
     {
         status = Item_Removed;
     }
-    else if (statusFlags & GIT_STATUS_CONFLICTED)
-    {
-        status = Item_Conflicted;
-    }
     else
     {
         status = Item_UpToDate;
@@ -97,6 +103,7 @@ void LibGit2UpdateOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeI
 
     if (gitRepo.m_repo)
     {
+        std::vector<wxString> paths;
         for (auto fi = proj_files.begin(); fi != proj_files.end(); fi++)
         {
             VcsTreeItem *pf = fi->get();
@@ -131,8 +138,11 @@ void LibGit2UpdateOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeI
                         statusFlags);
                 pf->SetState(getItemStateFromLibGit2StatusFlag(statusFlags));
             }
+            m_vcs.GetStatusTable().Update(relativeFilename, pf->GetState());
             pf->VisualiseState();
+            paths.push_back(relativeFilename);
         }
+        m_vcs.NotifyStatesChanged(paths);
     }
 }
 
@@ -147,18 +157,38 @@ struct VcsTreeItemAndRelativePath
 {
     std::shared_ptr<VcsTreeItem> item;
     wxString relativeName;
-    VcsTreeItemAndRelativePath(std::shared_ptr<VcsTreeItem> item, wxString relativeName)
+    // The state the tree shows, read on the UI thread before the walk as the item is not ours to read after
+    ItemState shownState;
+    VcsTreeItemAndRelativePath(std::shared_ptr<VcsTreeItem> item, ItemState shownState)
     {
         this->item = item;
-        this->relativeName = relativeName;
+        this->shownState = shownState;
     }
 };
 
+struct StatusWalkContext
+{
+    std::vector<VcsTreeItemAndRelativePath>* tree;
+    std::vector<LibGit2UpdateFullOp::ItemStateValue>* delta;
+    VcsStatusTable* statusTable;
+    const LibGit2UpdateFullOp* obj;
+};
+
+static void AddToDeltaIfChanged(StatusWalkContext& ctx, VcsTreeItemAndRelativePath& pf, ItemState itemState)
+{
+    // The snapshot says what we reported last time. The shown state says what the tree showed when the refresh
+    // started, which can differ if the file was dropped from and re-added to the project since.
+    bool changed = ctx.statusTable->Update(pf.relativeName, itemState);
+    if (changed || pf.shownState != itemState)
+    {
+        ctx.delta->emplace_back(std::move(pf.item), pf.relativeName, itemState);
+    }
+}
+
 static int git_status_cb_fn (const char *path, unsigned int statusFlags, void *payload)
 {
-    std::tuple < std::vector<VcsTreeItemAndRelativePath>*, const LibGit2UpdateFullOp*> *param = (std::tuple < std::vector<VcsTreeItemAndRelativePath>*, const LibGit2UpdateFullOp*> *)payload;
-    std::vector<VcsTreeItemAndRelativePath>& tree = *std::get<0>(*param);
-    const LibGit2UpdateFullOp* obj  = std::get<1>(*param);
+    StatusWalkContext& ctx = *(StatusWalkContext *)payload;
+    std::vector<VcsTreeItemAndRelativePath>& tree = *ctx.tree;
 
 #ifdef TRACE
     fprintf(stderr, "LibGit2::%s:%d path %s\n", __FUNCTION__, __LINE__, path);
@@ -170,8 +200,10 @@ static int git_status_cb_fn (const char *path, unsigned int statusFlags, void *p
                                                     });
     if (it != tree.end())
     {
+#ifdef TRACE
         fprintf(stderr, "LibGit2::%s:%d path %s present in list. statusFlags  0x%x\n", __FUNCTION__, __LINE__, path, statusFlags);
-        obj->m_pendingStates.emplace_back(std::move(it->item), getItemStateFromLibGit2StatusFlag(statusFlags));
+#endif
+        AddToDeltaIfChanged(ctx, *it, getItemStateFromLibGit2StatusFlag(statusFlags));
         std::iter_swap(it, tree.end() - 1);
         tree.erase(tree.end() - 1);
     }
@@ -181,7 +213,7 @@ static int git_status_cb_fn (const char *path, unsigned int statusFlags, void *p
         fprintf(stderr, "LibGit2::%s:%d path %s not present in list. statusFlags  %u\n", __FUNCTION__, __LINE__, path, statusFlags);
     }
 #endif
-    return obj->IsAborted()? 1 : 0;
+    return ctx.obj->IsAborted()? 1 : 0;
 }
 
 void LibGit2UpdateFullOp::stopExecution()
@@ -195,29 +227,39 @@ void LibGit2UpdateFullOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsT
 {
     fprintf(stderr, "LibGit2::%s:%d Enter. m_VcsRootDir %s proj_files size %zu\n", __FUNCTION__, __LINE__, m_VcsRootDir.ToUTF8().data(),
             projectFiles.size());
-    auto executionFn = [this] (std::vector<std::shared_ptr<VcsTreeItem>> projectFiles) mutable
+    std::vector <VcsTreeItemAndRelativePath> projectFilesAndRelativePaths;
+    projectFilesAndRelativePaths.reserve(projectFiles.size());
+    for (std::shared_ptr<VcsTreeItem>& item : projectFiles)
+    {
+        const ItemState shownState = item->GetState();
+        projectFilesAndRelativePaths.emplace_back(std::move(item), shownState);
+    }
+    auto executionFn = [this] (std::vector<VcsTreeItemAndRelativePath> projectFilesAndRelativePaths) mutable
     {
         wxStopWatch sw;
         GitRepo gitRepo(m_VcsRootDir);
+        std::vector<ItemStateValue> delta;
+        const size_t itemCount = projectFilesAndRelativePaths.size();
         if (gitRepo.m_repo)
         {
-            std::vector <VcsTreeItemAndRelativePath> projectFilesAndRelativePaths;
-            projectFilesAndRelativePaths.reserve(projectFiles.size());
-            for (std::shared_ptr<VcsTreeItem>& item : projectFiles)
+            for (VcsTreeItemAndRelativePath& pf : projectFilesAndRelativePaths)
             {
-                projectFilesAndRelativePaths.emplace_back(std::move(item), item->GetRelativeName(m_VcsRootDir));
+                pf.relativeName = pf.item->GetRelativeName(m_VcsRootDir);
             }
-            std::tuple < std::vector<VcsTreeItemAndRelativePath>*, const LibGit2UpdateFullOp*> param;
-            param = make_tuple(&projectFilesAndRelativePaths, this);
+            StatusWalkContext ctx = {&projectFilesAndRelativePaths, &delta, &m_vcs.GetStatusTable(), this};
 #ifdef TRACE
             fprintf(stderr, "LibGit2::%s:%d before git_status_foreach. workDir %s\n", __FUNCTION__, __LINE__, m_VcsRootDir.ToUTF8().data());
 #endif
             git_status_options opts = GIT_STATUS_OPTIONS_INIT;
             opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
             opts.flags = GIT_STATUS_OPT_INCLUDE_IGNORED | GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_INCLUDE_UNMODIFIED;
-            git_status_foreach_ext( gitRepo.m_repo, &opts, git_status_cb_fn, &param);
+            git_status_foreach_ext( gitRepo.m_repo, &opts, git_status_cb_fn, &ctx);
             for (auto &pf : projectFilesAndRelativePaths)
             {
+                if (m_abort)
+                {
+                    break;
+                }
                 ItemState itemState;
                 wxString fileName = m_VcsRootDir + wxFileName::GetPathSeparator() + pf.relativeName;
                 if (wxFileExists(fileName))
@@ -229,17 +271,26 @@ void LibGit2UpdateFullOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsT
                     fprintf(stderr, "LibGit2::::%s:%d[%p] item %s do not exit\n", __FUNCTION__, __LINE__, this, fileName.ToUTF8().data());
                     itemState = Item_UntrackedMissing;
                 }
-                m_pendingStates.emplace_back(std::move(pf.item), itemState);
+                AddToDeltaIfChanged(ctx, pf, itemState);
             }
         }
-        fprintf(stderr, "LibGit2::LibGit2UpdateFullOp[%p] Async git state Update:%d Exit. Took %ld ms\n", this, __LINE__, sw.Time());
+        fprintf(stderr, "LibGit2::LibGit2UpdateFullOp[%p] Async git state Update:%d Exit. Took %ld ms, %zu of %zu items changed\n", this, __LINE__,
+                sw.Time(), delta.size(), itemCount);
+        if (delta.empty())
+        {
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_pendingStatesMutex);
+            std::move(delta.begin(), delta.end(), std::back_inserter(m_pendingStates));
+        }
         CallAfter(&LibGit2UpdateFullOp::UpdateStates);
     };
     m_abort = true;
     if (m_executionThread.joinable())
         m_executionThread.join();
     m_abort = false;
-    m_executionThread = std::thread(executionFn, std::move(projectFiles));;
+    m_executionThread = std::thread(executionFn, std::move(projectFilesAndRelativePaths));
 }
 
 void LibGit2UpdateFullOp::UpdateStates()
@@ -247,289 +298,442 @@ void LibGit2UpdateFullOp::UpdateStates()
 #ifdef TRACE
     wxStopWatch sw;
 #endif
-    for (auto &item : m_pendingStates)
+    std::vector<ItemStateValue> pendingStates;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingStatesMutex);
+        pendingStates.swap(m_pendingStates);
+    }
+    std::vector<wxString> paths;
+    paths.reserve(pendingStates.size());
+    for (auto &item : pendingStates)
     {
         VcsTreeItem *pf = item.m_treeItem.get();
         pf->SetState(item.m_State);
         pf->VisualiseState();
+        paths.push_back(item.m_relativeName);
         if (m_abort)
         {
             fprintf(stderr, "LibGit2::%s:%d break as aborted\n", __FUNCTION__, __LINE__);
-            break;
+            return;
         }
     }
+    m_vcs.NotifyStatesChanged(paths);
 #ifdef TRACE
-    fprintf(stderr, "LibGit2::LibGit2UpdateFullOp[%p] Update:%d Exit. SetState of %zu items took %ld ms\n", this, __LINE__, m_pendingStates.size(), sw.Time());
+    fprintf(stderr, "LibGit2::LibGit2UpdateFullOp[%p] Update:%d Exit. SetState of %zu items took %ld ms\n", this, __LINE__, pendingStates.size(), sw.Time());
 #endif
 }
 
-/***********************************************************************
- *  Method: LibGit2AddOp::execute
- *  Params: std::vector<VcsTreeItem *> &
- * Returns: void
- * Effects:
- ***********************************************************************/
-void LibGit2AddOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
+void LibGit2IndexOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
 {
-    wxString pathString;
-    GitRepoIndex gitRepoIndex(m_VcsRootDir);
-    if (!gitRepoIndex.m_idx)
+    // The index changes of one request must be written before those of the next are made
+    if (m_executionThread.joinable())
     {
-        fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
-        return;
+        m_executionThread.join();
     }
+    m_items = std::move(pathList);
+    m_executionThread = std::thread(&LibGit2IndexOp::UpdateIndex, this);
+}
 
-    for (auto &vcsTreeItem : pathList)
+void LibGit2IndexOp::UpdateIndex()
+{
     {
-        wxString relativeFilename = vcsTreeItem->GetRelativeName(m_VcsRootDir);
-        if (relativeFilename.length() == 0)
+        // Written as it goes out of scope, before the items are updated
+        GitRepoIndex gitRepoIndex(m_VcsRootDir);
+        if (!gitRepoIndex.m_idx)
         {
-            continue;
+            fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
         }
-        int error = git_index_add_bypath(gitRepoIndex.m_idx, relativeFilename.ToUTF8().data());
-        if (0 != error)
+        else if (ChangeIndex(gitRepoIndex.m_idx, m_items))
         {
-            const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_index_add_bypath failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+            gitRepoIndex.SetModified();
         }
     }
+    CallAfter(&LibGit2IndexOp::FinishUpdate);
 }
 
-/***********************************************************************
- *  Method: LibGit2CommitOp::execute
- *  Params: std::vector<VcsTreeItem *> &
- * Returns: void
- * Effects:
- ***********************************************************************/
-void LibGit2CommitOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
+void LibGit2IndexOp::FinishUpdate()
 {
-    wxArrayString itemList;
-    LibGit2AddOp::ExecuteImplementation(pathList);
-    for (auto &vcsTreeItem : pathList)
+    if (m_executionThread.joinable())
     {
-        wxString relativeFilename = vcsTreeItem->GetRelativeName(m_VcsRootDir);
-        if (relativeFilename.length() == 0)
-        {
-            continue;
-        }
-
-        if (vcsTreeItem->GetState() == Item_Added || vcsTreeItem->GetState() == Item_Modified || vcsTreeItem->GetState() == Item_Removed)
-        {
-            itemList.Add(relativeFilename);
-        }
+        m_executionThread.join();
     }
+    std::vector<std::shared_ptr<VcsTreeItem>> items;
+    items.swap(m_items);
+    m_vcs.UpdateOp->execute(std::move(items));
+}
 
-    if (itemList.size() == 0)
+void LibGit2IndexOp::stopExecution()
+{
+    if (m_executionThread.joinable())
     {
-        return;
+        m_executionThread.join();
     }
+}
 
-    wxString msg;
-    CommitMsgDialog dlg(Manager::Get()->GetAppWindow(), msg, itemList);
+/***********************************************************************
+ *  Method: LibGit2AddOp::ChangeIndex
+ *  Params: git_index *, std::vector<VcsTreeItem *> &
+ * Returns: bool
+ * Effects:
+ ***********************************************************************/
+bool LibGit2AddOp::ChangeIndex(git_index *index, const std::vector<std::shared_ptr<VcsTreeItem>> &items)
+{
+    return StageItems(index, items);
+}
 
-    DumpOutput(itemList);
+namespace
+{
+// Fewer new files than this are cheaper to leave to git_index_add_all than to spread over threads
+const size_t kParallelStageMin = 32;
+const unsigned kMaxStageThreads = 8;
 
-    if (dlg.ShowModal() == wxID_OK)
+// A git_strarray over paths that it keeps alive
+struct Pathspec
+{
+    std::vector<std::string> paths;
+    std::vector<char *> strings;
+    git_strarray Get()
     {
-        GitRepoIndex gitRepoIndex(m_VcsRootDir);
-        git_repository *repo = gitRepoIndex.m_gitRepo.m_repo;
-        if (!gitRepoIndex.m_idx)
+        strings.clear();
+        for (std::string &path : paths)
         {
-            fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
-            return;
+            strings.push_back(&path[0]);
         }
-        git_signature *sig;
-        git_oid commit_id;
+        git_strarray array = {strings.data(), strings.size()};
+        return array;
+    }
+};
 
-        int error = git_signature_default(&sig, repo);
-        if (0 != error)
+// Pathspecs are matched as wildmatch patterns, so file names with pattern characters must be escaped
+std::string EscapePathspec(const std::string &path)
+{
+    std::string escaped;
+    escaped.reserve(path.size());
+    for (char c : path)
+    {
+        if (c == '*' || c == '?' || c == '[' || c == '\\')
         {
-            const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_signature_default failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
-            return;
+            escaped += '\\';
         }
-        git_oid tree_id;
-        git_tree *tree;
-        error = git_index_write_tree(&tree_id, gitRepoIndex.m_idx);
-        if (0 != error)
+        escaped += c;
+    }
+    return escaped;
+}
+
+struct NewFile
+{
+    std::string path;
+    git_oid id;
+    wxStructStat st;
+    bool hashed;
+};
+
+// Writes the blobs of untracked files on several threads, each with its own repository handle as
+// libgit2 objects must not be shared between threads
+void HashNewFiles(const wxString &vcsRootDir, std::vector<NewFile> &files)
+{
+    std::atomic<size_t> next(0);
+    auto hashFiles = [&vcsRootDir, &files, &next]()
+    {
+        GitRepo gitRepo(vcsRootDir);
+        if (!gitRepo.m_repo)
         {
-            const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_index_write_tree failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
-            git_signature_free(sig);
             return;
         }
-        error = git_tree_lookup(&tree, repo, &tree_id);
-        if (0 != error)
+        for (size_t i = next++; i < files.size(); i = next++)
         {
-            const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_tree_lookup failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
-            git_signature_free(sig);
-            return;
+            NewFile &file = files[i];
+            wxString fileName = vcsRootDir + wxFileName::GetPathSeparator() + wxString::FromUTF8(file.path.c_str());
+            // Stat before hashing, so that a write in between shows up as a change later on
+            file.hashed = 0 == wxLstat(fileName, &file.st) && 0 == git_blob_create_from_workdir(&file.id, gitRepo.m_repo, file.path.c_str());
         }
+    };
+    unsigned threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), kMaxStageThreads);
+    std::vector<std::thread> threads;
+    for (unsigned i = 1; i < threadCount; ++i)
+    {
+        threads.emplace_back(hashFiles);
+    }
+    hashFiles();
+    for (std::thread &thread : threads)
+    {
+        thread.join();
+    }
+}
 
-        git_oid parent_id;
-        error = git_reference_name_to_id(&parent_id, repo, "HEAD");
-        if (0 != error)
-        {
-            const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_reference_name_to_id failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
-            git_signature_free(sig);
-            git_tree_free(tree);
-            return;
-        }
+// Index entry for a file whose blob is already in the object database, as git_index_add_bypath would make it
+void FillIndexEntry(git_index_entry &entry, const NewFile &file, int indexCaps)
+{
+    memset(&entry, 0, sizeof(entry));
+    entry.ctime.seconds = (int32_t)file.st.st_ctime;
+    entry.mtime.seconds = (int32_t)file.st.st_mtime;
+#if defined(__linux__)
+    entry.ctime.nanoseconds = file.st.st_ctim.tv_nsec;
+    entry.mtime.nanoseconds = file.st.st_mtim.tv_nsec;
+#elif defined(__APPLE__)
+    entry.ctime.nanoseconds = file.st.st_ctimespec.tv_nsec;
+    entry.mtime.nanoseconds = file.st.st_mtimespec.tv_nsec;
+#endif
+    entry.dev = file.st.st_dev;
+    entry.ino = file.st.st_ino;
+    entry.uid = file.st.st_uid;
+    entry.gid = file.st.st_gid;
+    entry.file_size = (uint32_t)file.st.st_size;
+#ifdef S_ISLNK
+    if (S_ISLNK(file.st.st_mode) && !(indexCaps & GIT_INDEX_CAPABILITY_NO_SYMLINKS))
+    {
+        entry.mode = GIT_FILEMODE_LINK;
+    }
+    else
+#endif
+    if (!(indexCaps & GIT_INDEX_CAPABILITY_NO_FILEMODE) && (file.st.st_mode & S_IXUSR))
+    {
+        entry.mode = GIT_FILEMODE_BLOB_EXECUTABLE;
+    }
+    else
+    {
+        entry.mode = GIT_FILEMODE_BLOB;
+    }
+    entry.id = file.id;
+    entry.path = file.path.c_str();
+}
 
-        git_commit *parent;
-        error = git_commit_lookup(&parent, repo, &parent_id);
-        if (0 != error)
-        {
-            const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_reference_name_to_id failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
-            git_signature_free(sig);
-            git_tree_free(tree);
-            return;
-        }
+// What the index records for the content of a path, to tell whether staging it changed anything. The stat data is
+// left out: refreshing it alone is not worth a write.
+struct StagedBlob
+{
+    bool present;
+    git_oid id;
+    uint32_t mode;
 
-        error = git_commit_create(&commit_id, repo, "HEAD", sig, sig, NULL, msg.ToUTF8().data(), tree, 1, (const git_commit **)&parent);
-        if (0 != error)
+    StagedBlob(git_index *index, const std::string &path)
+    {
+        const git_index_entry *entry = git_index_get_bypath(index, path.c_str(), 0);
+        present = entry != nullptr;
+        if (present)
         {
-            const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_commit_create failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+            id = entry->id;
+            mode = entry->mode;
         }
+    }
 
-        git_commit_free(parent);
-        git_signature_free(sig);
-        git_tree_free(tree);
+    bool operator!=(const StagedBlob &other) const
+    {
+        return present != other.present || (present && (mode != other.mode || !git_oid_equal(&id, &other.id)));
     }
-}
+};
 
-/***********************************************************************
- *  Method: LibGit2RemoveOp::execute
- *  Params: std::vector<VcsTreeItem *> &
- * Returns: void
- * Effects:
- ***********************************************************************/
-void LibGit2RemoveOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
+// State of a file after HEAD and the index were made to match tree for it
+ItemState StateFromTree(git_tree *tree, const wxString &vcsRootDir, const wxString &relativeFilename)
 {
-    GitRepoIndex gitRepoIndex(m_VcsRootDir);
-    if (!gitRepoIndex.m_idx)
+    git_tree_entry *entry;
+    if (0 == git_tree_entry_bypath(&entry, tree, relativeFilename.ToUTF8().data()))
     {
-        fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
-        return;
+        git_tree_entry_free(entry);
+        return Item_UpToDate;
+    }
+    if (wxFileExists(vcsRootDir + wxFileName::GetPathSeparator() + relativeFilename))
+    {
+        return Item_Untracked;
     }
+    return Item_UntrackedMissing;
+}
+} // namespace
 
-    for (auto &vcsTreeItem : pathList)
+bool LibGit2_Op::StageItems(git_index *index, const std::vector<std::shared_ptr<VcsTreeItem>> &items) const
+{
+    // Like git add, a file deleted from the working tree stages its removal
+    Pathspec present;
+    Pathspec missing;
+    std::vector<NewFile> newFiles;
+    std::vector<std::string> submitted;
+    std::vector<StagedBlob> before;
+    // Resolving a conflict or removing a file changes the number of entries
+    const size_t entryCount = git_index_entrycount(index);
+    size_t position;
+    for (auto &vcsTreeItem : items)
     {
         wxString relativeFilename = vcsTreeItem->GetRelativeName(m_VcsRootDir);
         if (relativeFilename.length() == 0)
         {
             continue;
         }
-        int error = git_index_remove_bypath(gitRepoIndex.m_idx, relativeFilename.ToUTF8().data());
-        if (0 != error)
+        std::string path(relativeFilename.ToUTF8().data());
+        before.emplace_back(index, path);
+        submitted.push_back(path);
+        if (!wxFileExists(m_VcsRootDir + wxFileName::GetPathSeparator() + relativeFilename))
         {
-            const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_index_remove_bypath failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+            missing.paths.push_back(EscapePathspec(path));
+        }
+        else if (0 == git_index_find(&position, index, path.c_str()))
+        {
+            // Tracked, or conflicted: git_index_add_all also resolves the conflict
+            present.paths.push_back(std::move(path));
+        }
+        else
+        {
+            NewFile file;
+            file.path = std::move(path);
+            file.hashed = false;
+            newFiles.push_back(std::move(file));
         }
     }
-}
-
-static int diff_aggragator_cb(const git_diff_delta *delta, const git_diff_hunk *hunk, const git_diff_line *l, void *data)
-{
-    (void)delta;
-    (void)hunk;
-    wxString *diff = (wxString *)data;
-    if (l->origin == GIT_DIFF_LINE_CONTEXT || l->origin == GIT_DIFF_LINE_ADDITION || l->origin == GIT_DIFF_LINE_DELETION)
-        diff->append(l->origin);
 
-    diff->append(l->content, l->content_len);
-    return 0;
-}
-
-/***********************************************************************
- *  Method: LibGit2DiffOp::ExecuteImplementation
- *  Params: std::vector<VcsTreeItem *> &
- * Returns: void
- * Effects:
- ***********************************************************************/
-void LibGit2DiffOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
-{
-    GitRepo gitRepo(m_VcsRootDir);
-    if (!gitRepo.m_repo)
+    if (newFiles.size() >= kParallelStageMin)
     {
-        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
-        return;
+        HashNewFiles(m_VcsRootDir, newFiles);
+        int indexCaps = git_index_caps(index);
+        for (NewFile &file : newFiles)
+        {
+            git_index_entry entry;
+            if (file.hashed)
+            {
+                FillIndexEntry(entry, file, indexCaps);
+            }
+            if (!file.hashed || 0 != git_index_add(index, &entry))
+            {
+                // git_index_add_all gets another go at it, and reports the error
+                present.paths.push_back(std::move(file.path));
+            }
+        }
+    }
+    else
+    {
+        for (NewFile &file : newFiles)
+        {
+            present.paths.push_back(std::move(file.path));
+        }
     }
 
-    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
-    opts.pathspec.strings = (char **)malloc(sizeof(char *) * pathList.size());
-    for (auto &vcsTreeItem : pathList)
+    // One pass over the working tree for all the files, which skips those unchanged since the last stat
+    if (!present.paths.empty())
     {
-        wxString relativeFilename = vcsTreeItem->GetRelativeName(m_VcsRootDir);
-        if (relativeFilename.length() == 0)
+        git_strarray pathspec = present.Get();
+        int error = git_index_add_all(index, &pathspec, GIT_INDEX_ADD_FORCE | GIT_INDEX_ADD_DISABLE_PATHSPEC_MATCH, nullptr, nullptr);
+        if (0 != error)
         {
-            continue;
+            const git_error *e = git_error_last();
+            fprintf(stderr, "LibGit2::%s:%d git_index_add_all failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
         }
-        opts.pathspec.strings[opts.pathspec.count] = strdup(relativeFilename.ToUTF8().data());
-        opts.pathspec.count++;
     }
-    if (opts.pathspec.count)
+    if (!missing.paths.empty())
     {
-        git_diff *diff;
-        int error = git_diff_index_to_workdir(&diff, gitRepo.m_repo, NULL, &opts);
+        git_strarray pathspec = missing.Get();
+        int error = git_index_remove_all(index, &pathspec, nullptr, nullptr);
         if (0 != error)
         {
             const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_diff_index_to_workdir failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+            fprintf(stderr, "LibGit2::%s:%d git_index_remove_all failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
         }
-        else
+    }
+    if (git_index_entrycount(index) != entryCount)
+    {
+        return true;
+    }
+    for (size_t i = 0; i < submitted.size(); ++i)
+    {
+        if (StagedBlob(index, submitted[i]) != before[i])
         {
-            wxString diffStr;
-            error = git_diff_print(diff, GIT_DIFF_FORMAT_PATCH, diff_aggragator_cb, &diffStr);
-            if (0 != error)
-            {
-                const git_error *e = git_error_last();
-                fprintf(stderr, "LibGit2::%s:%d git_diff_print failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
-            }
-            else
-            {
-                cbEditor *editor = Manager::Get()->GetEditorManager()->New(_("Diff to index.patch"));
-                cbStyledTextCtrl *ctrl = editor->GetControl();
-                ctrl->SetLexerLanguage(wxT("diff"));
-                ctrl->SetText(diffStr);
-                editor->SetModified(false);
-            }
-            git_diff_free(diff);
+            return true;
         }
+    }
+    return false;
+}
+
+void LibGit2_Op::ApplyStates(const std::vector<std::shared_ptr<VcsTreeItem>> &items, const std::vector<ItemState> &states) const
+{
+    VcsStatusTable &statusTable = m_vcs.GetStatusTable();
+    std::vector<wxString> paths;
+    for (size_t i = 0; i < items.size(); ++i)
+    {
+        items[i]->SetState(states[i]);
+        paths.push_back(items[i]->GetRelativeName(m_VcsRootDir));
+        statusTable.Update(paths.back(), states[i]);
+        items[i]->VisualiseState();
+    }
+    m_vcs.NotifyStatesChanged(paths);
+}
 
-        for (size_t count = 0; count < opts.pathspec.count; count++)
+// Runs one commit hook and reports its exit code back to the op that started it
+class HookProcess : public wxProcess
+{
+  public:
+    explicit HookProcess(LibGit2CommitOp *op) : m_op(op) {}
+    void OnTerminate(int /*pid*/, int status) override
+    {
+        if (m_op)
         {
-            free(opts.pathspec.strings[count]);
+            m_op->HookFinished(status);
         }
+        delete this;
     }
-    else
+    // Cleared when the op no longer waits for this hook
+    LibGit2CommitOp *m_op;
+};
+
+namespace
+{
+// How often the commit worker looks for cancellation while the hooks run
+const int kHookPollInterval = 100;
+
+struct MergeHeads
+{
+    git_repository *repo;
+    std::vector<git_commit *> commits;
+};
+
+int CollectMergeHead(const git_oid *oid, void *payload)
+{
+    MergeHeads *heads = static_cast<MergeHeads *>(payload);
+    git_commit *commit;
+    int error = git_commit_lookup(&commit, heads->repo, oid);
+    if (0 == error)
     {
-        fprintf(stderr, "LibGit2::%s:%d no files\n", __FUNCTION__, __LINE__);
+        heads->commits.push_back(commit);
     }
-    free(opts.pathspec.strings);
+    return error;
+}
+
+// The message a merge in progress left for its commit, empty if there is none
+wxString MergeMessage(const wxString &vcsRootDir)
+{
+    wxString message;
+    GitRepo gitRepo(vcsRootDir);
+    git_buf buf = {0};
+    git_buf prettified = {0};
+    // As git commit does, the "#Conflicts:" list the merge added is left out along with any other comment
+    if (gitRepo.m_repo && GIT_REPOSITORY_STATE_MERGE == git_repository_state(gitRepo.m_repo) &&
+        0 == git_repository_message(&buf, gitRepo.m_repo) && 0 == git_message_prettify(&prettified, buf.ptr, 1, '#'))
+    {
+        message = wxString::FromUTF8(prettified.ptr).Trim();
+    }
+    git_buf_dispose(&prettified);
+    git_buf_dispose(&buf);
+    return message;
+}
+} // namespace
+
+LibGit2CommitOp::LibGit2CommitOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils)
+    : LibGit2_Op(vcs, vcsRootDir, shellUtils), m_progress(m_abort)
+{
 }
 
 /***********************************************************************
- *  Method: LibGit2RestoreOp::execute
+ *  Method: LibGit2CommitOp::execute
  *  Params: std::vector<VcsTreeItem *> &
  * Returns: void
  * Effects:
  ***********************************************************************/
-void LibGit2RestoreOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
+void LibGit2CommitOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
 {
-    GitRepo gitRepo(m_VcsRootDir);
-    if (!gitRepo.m_repo)
+    if (m_executionThread.joinable())
     {
-        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        fprintf(stderr, "LibGit2::%s:%d a commit is already in progress\n", __FUNCTION__, __LINE__);
         return;
     }
 
-    git_checkout_options opts = {GIT_CHECKOUT_OPTIONS_VERSION, GIT_CHECKOUT_FORCE};
-    opts.paths.strings = (char **)malloc(sizeof(char *) * pathList.size());
+    std::vector<wxString> itemList;
+    std::vector<std::shared_ptr<VcsTreeItem>> commitItems;
     for (auto &vcsTreeItem : pathList)
     {
         wxString relativeFilename = vcsTreeItem->GetRelativeName(m_VcsRootDir);
@@ -537,25 +741,2183 @@ void LibGit2RestoreOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTree
         {
             continue;
         }
-        opts.paths.strings[opts.paths.count] = strdup(relativeFilename.ToUTF8().data());
-        opts.paths.count++;
+
+        if (vcsTreeItem->GetState() == Item_Added || vcsTreeItem->GetState() == Item_Modified || vcsTreeItem->GetState() == Item_Removed)
+        {
+            itemList.push_back(relativeFilename);
+            commitItems.push_back(vcsTreeItem);
+        }
+    }
+
+    if (itemList.size() == 0)
+    {
+        return;
+    }
+
+    wxString msg = MergeMessage(m_VcsRootDir);
+    CommitMsgDialog dlg(Manager::Get()->GetAppWindow(), msg, itemList, m_vcs.GetStatusTable(),
+                        [this](const wxString &path, std::string &patch) { return m_vcs.GetCommitPatch(path, patch); });
+
+    if (dlg.ShowModal() != wxID_OK)
+    {
+        return;
+    }
+
+    m_items.clear();
+    for (size_t i = 0; i < commitItems.size(); i++)
+    {
+        if (dlg.IsChecked(i))
+        {
+            m_items.push_back(commitItems[i]);
+        }
+    }
+    m_newStates.clear();
+    m_committed = false;
+    m_failure.Clear();
+    m_hookFailure.Clear();
+    m_message = msg;
+    FindHooks();
+    m_hooksRunning = !m_hooks.empty();
+    m_hooksFailed = false;
+    if (m_hooksRunning)
+    {
+        // commit-msg gets the message in a file it may rewrite
+        wxFFile messageFile;
+        wxScopedCharBuffer utf8 = msg.ToUTF8();
+        if (!messageFile.Open(m_messageFile, "w") || !messageFile.Write(utf8.data(), utf8.length()))
+        {
+            fprintf(stderr, "LibGit2::%s:%d writing %s failed\n", __FUNCTION__, __LINE__, m_messageFile.ToUTF8().data());
+        }
+    }
+
+    m_abort = false;
+    m_progress.Start(_("Commit"), _("Staging changes..."), Commit_StageCount);
+    m_executionThread = std::thread(&LibGit2CommitOp::CreateCommit, this, m_hooksRunning);
+}
+
+void LibGit2CommitOp::FindHooks()
+{
+    m_hooks.clear();
+    GitRepo gitRepo(m_VcsRootDir);
+    if (!gitRepo.m_repo)
+    {
+        return;
+    }
+    git_config *config;
+    int error = git_repository_config(&config, gitRepo.m_repo);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_repository_config failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return;
+    }
+    int runHooks = 0;
+    git_buf hooksDir = {0};
+    if (0 == git_config_get_bool(&runHooks, config, "cbvcs.runHooks") && runHooks &&
+        (0 == git_config_get_path(&hooksDir, config, "core.hooksPath") ||
+         0 == git_repository_item_path(&hooksDir, gitRepo.m_repo, GIT_REPOSITORY_ITEM_HOOKS)))
+    {
+        wxString dir = wxString::FromUTF8(hooksDir.ptr);
+        // Like git, a relative core.hooksPath is taken from the top of the working tree
+        if (!wxFileName(dir).IsAbsolute())
+        {
+            dir = m_VcsRootDir + wxFileName::GetPathSeparator() + dir;
+        }
+        const char *const names[] = {"pre-commit", "commit-msg"};
+        for (const char *name : names)
+        {
+            wxString hook = dir + wxFileName::GetPathSeparator() + name;
+            if (wxFileName::IsFileExecutable(hook))
+            {
+                m_hooks.push_back(hook);
+            }
+        }
+        m_messageFile = wxString::FromUTF8(git_repository_path(gitRepo.m_repo)) + wxT("COMMIT_EDITMSG");
+    }
+    git_buf_dispose(&hooksDir);
+    git_config_free(config);
+}
+
+void LibGit2CommitOp::RunNextHook()
+{
+    if (m_hooks.empty() || m_abort)
+    {
+        std::lock_guard<std::mutex> lock(m_hooksMutex);
+        m_hooksRunning = false;
+        m_hooksDone.notify_all();
+        return;
+    }
+    wxString hook = m_hooks.front();
+    m_hooks.pop_front();
+    wxString command = wxT("\"") + hook + wxT("\"");
+    if (wxFileName(hook).GetFullName() == wxT("commit-msg"))
+    {
+        command += wxT(" \"") + m_messageFile + wxT("\"");
+    }
+    wxExecuteEnv env;
+    env.cwd = m_VcsRootDir;
+    m_hookProcess = new HookProcess(this);
+    if (0 == wxExecute(command, wxEXEC_ASYNC, m_hookProcess, &env))
+    {
+        fprintf(stderr, "LibGit2::%s:%d starting %s failed\n", __FUNCTION__, __LINE__, hook.ToUTF8().data());
+        delete m_hookProcess;
+        m_hookProcess = nullptr;
+        m_hookFailure = wxString::Format(_("The %s hook could not be run"), wxFileName(hook).GetFullName());
+        std::lock_guard<std::mutex> lock(m_hooksMutex);
+        m_hooksFailed = true;
+        m_hooksRunning = false;
+        m_hooksDone.notify_all();
+    }
+}
+
+void LibGit2CommitOp::HookFinished(int exitCode)
+{
+    m_hookProcess = nullptr;
+    if (0 != exitCode)
+    {
+        fprintf(stderr, "LibGit2::%s:%d hook exited with %d\n", __FUNCTION__, __LINE__, exitCode);
+        m_hookFailure = wxString::Format(_("A commit hook rejected the commit (exit code %d)"), exitCode);
+        std::lock_guard<std::mutex> lock(m_hooksMutex);
+        m_hooksFailed = true;
+        m_hooksRunning = false;
+        m_hooksDone.notify_all();
+        return;
+    }
+    if (!m_hooks.empty())
+    {
+        RunNextHook();
+        return;
+    }
+    wxString message;
+    wxFFile messageFile;
+    bool haveMessage = messageFile.Open(m_messageFile, "r") && messageFile.ReadAll(&message, wxConvUTF8);
+    std::lock_guard<std::mutex> lock(m_hooksMutex);
+    if (haveMessage)
+    {
+        m_message = message;
+    }
+    m_hooksRunning = false;
+    m_hooksDone.notify_all();
+}
+
+void LibGit2CommitOp::DetachHook()
+{
+    if (m_hookProcess)
+    {
+        m_hookProcess->m_op = nullptr;
+        // Nobody waits for the hook any more, so it must not go on changing the index behind the next commit
+        wxProcess::Kill(m_hookProcess->GetPid(), wxSIGTERM, wxKILL_CHILDREN);
+        m_hookProcess = nullptr;
+    }
+}
+
+void LibGit2CommitOp::CreateCommit(bool runHooks)
+{
+    GitRepoIndex gitRepoIndex(m_VcsRootDir);
+    git_repository *repo = gitRepoIndex.m_gitRepo.m_repo;
+    if (!gitRepoIndex.m_idx)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepoIndex.m_idx not available\n", __FUNCTION__, __LINE__);
+        m_failure = _("The index could not be opened");
+        CallAfter(&LibGit2CommitOp::FinishCommit);
+        return;
+    }
+    // Staging, tree writing and the commit share this one index session
+    StageItems(gitRepoIndex.m_idx, m_items);
+    // The hooks look at the index on disk, so it is written before they start
+    int error = gitRepoIndex.Write();
+    if (0 != error)
+    {
+        m_failure = wxString::FromUTF8(git_error_last()->message);
+        CallAfter(&LibGit2CommitOp::FinishCommit);
+        return;
+    }
+    if (runHooks)
+    {
+        CallAfter(&LibGit2CommitOp::RunNextHook);
+    }
+
+    SetStage(Commit_WritingTree);
+    git_signature *sig;
+    git_oid commit_id;
+
+    error = git_signature_default(&sig, repo);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_signature_default failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        m_failure = wxString::FromUTF8(e->message);
+        CallAfter(&LibGit2CommitOp::FinishCommit);
+        return;
+    }
+    git_oid tree_id;
+    git_tree *tree;
+    error = git_index_write_tree(&tree_id, gitRepoIndex.m_idx);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_index_write_tree failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        m_failure = wxString::FromUTF8(e->message);
+        git_signature_free(sig);
+        CallAfter(&LibGit2CommitOp::FinishCommit);
+        return;
+    }
+    error = git_tree_lookup(&tree, repo, &tree_id);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_tree_lookup failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        m_failure = wxString::FromUTF8(e->message);
+        git_signature_free(sig);
+        CallAfter(&LibGit2CommitOp::FinishCommit);
+        return;
+    }
+
+    // The first commit on an unborn branch has no parent
+    git_commit *parent = nullptr;
+    git_oid parent_id;
+    error = git_reference_name_to_id(&parent_id, repo, "HEAD");
+    if (0 == error)
+    {
+        error = git_commit_lookup(&parent, repo, &parent_id);
+    }
+    else if (GIT_ENOTFOUND == error || GIT_EUNBORNBRANCH == error)
+    {
+        error = 0;
+    }
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d looking up HEAD commit failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        m_failure = wxString::FromUTF8(e->message);
+        git_signature_free(sig);
+        git_tree_free(tree);
+        CallAfter(&LibGit2CommitOp::FinishCommit);
+        return;
+    }
+    // Concluding a merge, the commits in MERGE_HEAD follow HEAD as parents
+    MergeHeads mergeHeads = {repo, {}};
+    error = git_repository_mergehead_foreach(repo, CollectMergeHead, &mergeHeads);
+    if (0 != error && GIT_ENOTFOUND != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d reading MERGE_HEAD failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+    }
+    std::vector<const git_commit *> parents;
+    if (parent)
+    {
+        parents.push_back(parent);
+    }
+    parents.insert(parents.end(), mergeHeads.commits.begin(), mergeHeads.commits.end());
+
+    SetStage(Commit_RunningHooks);
+    bool hooksFailed;
+    wxString message;
+    {
+        std::unique_lock<std::mutex> lock(m_hooksMutex);
+        while (m_hooksRunning && !m_abort)
+        {
+            m_hooksDone.wait_for(lock, std::chrono::milliseconds(kHookPollInterval));
+        }
+        hooksFailed = m_hooksFailed;
+        message = m_message;
+    }
+
+    // The tree was written while the hooks ran. A pre-commit hook that staged more, e.g. reformatted files, leaves
+    // the index changed on disk, and the tree is written again from it.
+    bool treeCurrent = true;
+    if (runHooks && !m_abort && !hooksFailed)
+    {
+        git_oid hookedTreeId;
+        git_tree *hookedTree = nullptr;
+        error = git_index_read(gitRepoIndex.m_idx, false);
+        if (0 == error)
+        {
+            error = git_index_write_tree(&hookedTreeId, gitRepoIndex.m_idx);
+        }
+        if (0 == error && !git_oid_equal(&hookedTreeId, &tree_id))
+        {
+            error = git_tree_lookup(&hookedTree, repo, &hookedTreeId);
+            if (0 == error)
+            {
+                git_tree_free(tree);
+                tree = hookedTree;
+                tree_id = hookedTreeId;
+            }
+        }
+        if (0 != error)
+        {
+            const git_error *e = git_error_last();
+            fprintf(stderr, "LibGit2::%s:%d writing the tree after the hooks failed : %d: %s\n", __FUNCTION__, __LINE__, error,
+                    e ? e->message : "");
+            m_failure = e ? wxString::FromUTF8(e->message) : wxString(_("Unknown error"));
+            treeCurrent = false;
+        }
+    }
+
+    // The commit object is written without touching any reference, so that cancelling up to the
+    // reference update leaves the branch as it was
+    error = -1;
+    if (!m_abort && !hooksFailed && treeCurrent)
+    {
+        SetStage(Commit_Creating);
+        error = git_commit_create(&commit_id, repo, NULL, sig, sig, NULL, message.ToUTF8().data(), tree, parents.size(),
+                                  parents.empty() ? NULL : &parents[0]);
+        if (0 != error)
+        {
+            const git_error *e = git_error_last();
+            fprintf(stderr, "LibGit2::%s:%d git_commit_create failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+            m_failure = wxString::FromUTF8(e->message);
+        }
     }
-    if (opts.paths.count)
+    if (0 == error && !m_abort)
     {
-        int error = git_checkout_head(gitRepo.m_repo, &opts);
+        // Move the branch HEAD points to, or HEAD itself when detached. Only from the parent the commit
+        // was made on, in case something else committed meanwhile.
+        std::string refName("HEAD");
+        git_reference *head;
+        if (0 == git_reference_lookup(&head, repo, "HEAD"))
+        {
+            if (git_reference_type(head) == GIT_REFERENCE_SYMBOLIC)
+            {
+                refName = git_reference_symbolic_target(head);
+            }
+            git_reference_free(head);
+        }
+        wxString reflog = (parents.size() > 1 ? wxT("commit (merge): ") : parent ? wxT("commit: ") : wxT("commit (initial): ")) +
+                          message.BeforeFirst(wxT('\n'));
+        git_reference *ref;
+        error = git_reference_create_matching(&ref, repo, refName.c_str(), &commit_id, 1, parent ? &parent_id : NULL, reflog.ToUTF8().data());
         if (0 != error)
         {
             const git_error *e = git_error_last();
-            fprintf(stderr, "LibGit2::%s:%d git_checkout_head failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+            fprintf(stderr, "LibGit2::%s:%d updating %s failed : %d/%d: %s\n", __FUNCTION__, __LINE__, refName.c_str(), error, e->klass,
+                    e->message);
+            m_failure = wxString::FromUTF8(e->message);
         }
-        for (size_t count = 0; count < opts.paths.count; count++)
+        else
         {
-            free(opts.paths.strings[count]);
+            git_reference_free(ref);
+            // The merge is concluded, MERGE_HEAD and MERGE_MSG go
+            if (!mergeHeads.commits.empty() && 0 != git_repository_state_cleanup(repo))
+            {
+                const git_error *e = git_error_last();
+                fprintf(stderr, "LibGit2::%s:%d git_repository_state_cleanup failed : %d: %s\n", __FUNCTION__, __LINE__, e->klass, e->message);
+            }
+            // HEAD now holds the tree just written and the index was just filled from the working tree,
+            // so the tree alone tells the new state of every committed item
+            m_newStates.reserve(m_items.size());
+            for (auto &vcsTreeItem : m_items)
+            {
+                m_newStates.push_back(StateFromTree(tree, m_VcsRootDir, vcsTreeItem->GetRelativeName(m_VcsRootDir)));
+            }
+            m_committed = true;
         }
     }
+
+    git_commit_free(parent);
+    for (git_commit *head : mergeHeads.commits)
+    {
+        git_commit_free(head);
+    }
+    git_signature_free(sig);
+    git_tree_free(tree);
+    CallAfter(&LibGit2CommitOp::FinishCommit);
+}
+
+void LibGit2CommitOp::FinishCommit()
+{
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    DetachHook();
+    m_progress.Stop();
+    if (m_committed)
+    {
+        ApplyStates(m_items, m_newStates);
+    }
     else
     {
-        fprintf(stderr, "LibGit2::%s:%d no files\n", __FUNCTION__, __LINE__);
+        if (!m_abort)
+        {
+            wxString reason = m_hookFailure.empty() ? m_failure : m_hookFailure;
+            cbMessageBox(_("The commit failed:\n") + reason, _("Commit"), wxICON_ERROR);
+        }
+        // The items may have been staged before the commit stopped
+        m_vcs.UpdateOp->execute(m_items);
+    }
+    m_items.clear();
+}
+
+void LibGit2CommitOp::SetStage(CommitStage stage)
+{
+    switch (stage)
+    {
+    case Commit_Staging:
+        m_progress.SetLabel(_("Staging changes..."));
+        break;
+    case Commit_WritingTree:
+        m_progress.SetLabel(_("Writing tree..."));
+        break;
+    case Commit_RunningHooks:
+        m_progress.SetLabel(_("Running commit hooks..."));
+        break;
+    default:
+        m_progress.SetLabel(_("Creating commit..."));
+        break;
+    }
+    m_progress.SetValue(stage, Commit_StageCount);
+}
+
+void LibGit2CommitOp::stopExecution()
+{
+    m_abort = true;
+    m_hooksDone.notify_all();
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    DetachHook();
+    m_progress.Stop();
+}
+
+/***********************************************************************
+ *  Method: LibGit2RemoveOp::ChangeIndex
+ *  Params: git_index *, std::vector<VcsTreeItem *> &
+ * Returns: bool
+ * Effects:
+ ***********************************************************************/
+bool LibGit2RemoveOp::ChangeIndex(git_index *index, const std::vector<std::shared_ptr<VcsTreeItem>> &items)
+{
+    Pathspec removed;
+    for (auto &vcsTreeItem : items)
+    {
+        wxString relativeFilename = vcsTreeItem->GetRelativeName(m_VcsRootDir);
+        if (relativeFilename.length() == 0)
+        {
+            continue;
+        }
+        removed.paths.push_back(EscapePathspec(relativeFilename.ToUTF8().data()));
+    }
+    if (removed.paths.empty())
+    {
+        return false;
+    }
+    // Untracked paths match nothing, and leave the index as it was
+    const size_t entryCount = git_index_entrycount(index);
+    git_strarray pathspec = removed.Get();
+    int error = git_index_remove_all(index, &pathspec, nullptr, nullptr);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_index_remove_all failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+    }
+    return git_index_entrycount(index) != entryCount;
+}
+
+namespace
+{
+// Patch text is handed to the editor in runs of whole lines of about this size
+const size_t kDiffChunkSize = 64 * 1024;
+// Chunks the worker may queue before it waits for the editor to catch up
+const size_t kMaxPendingDiffChunks = 8;
+
+struct DiffStreamContext
+{
+    LibGit2DiffOp *op;
+    std::string chunk;
+};
+
+// A revision such as "origin/master" or "HEAD~1", made fit for a file name
+wxString FileNamePart(const wxString &revision)
+{
+    wxString part(revision);
+    for (size_t i = 0; i < part.length(); ++i)
+    {
+        const wxUniChar c = part[i];
+        if (c < 0x20 || wxString(wxT("/\\:~^*?\"<>|")).Find(c) != wxNOT_FOUND)
+        {
+            part[i] = wxT('_');
+        }
+    }
+    return part;
+}
+} // namespace
+
+// Queue text for the editor once a whole chunk has built up
+static bool AppendToStream(DiffStreamContext &ctx, const char *text, size_t length)
+{
+    ctx.chunk.append(text, length);
+    if (ctx.chunk.size() >= kDiffChunkSize)
+    {
+        if (!ctx.op->PushChunk(std::move(ctx.chunk)))
+        {
+            return false;
+        }
+        ctx.chunk.clear();
+        ctx.chunk.reserve(kDiffChunkSize + 1024);
+    }
+    return true;
+}
+
+// Identifies the patch of a delta: both sides by content, plus everything else that shows up in the patch text
+static std::string MakeDiffKey(const git_diff_delta *delta, const git_diff_options &opts)
+{
+    std::string key(delta->old_file.path);
+    key.push_back('\0');
+    key.append(delta->new_file.path);
+    key.push_back('\0');
+    key.append((const char *)delta->old_file.id.id, sizeof(delta->old_file.id.id));
+    key.append((const char *)delta->new_file.id.id, sizeof(delta->new_file.id.id));
+    char options[64];
+    snprintf(options, sizeof(options), "%o:%o:%x:%u:%u", delta->old_file.mode, delta->new_file.mode, opts.flags, opts.context_lines,
+             opts.interhunk_lines);
+    key.append(options);
+    return key;
+}
+
+void LibGit2DiffOp::Abort()
+{
+    {
+        std::lock_guard<std::mutex> lock(m_pendingChunksMutex);
+        m_abort = true;
+    }
+    m_chunkConsumed.notify_all();
+}
+
+void LibGit2DiffOp::stopExecution()
+{
+    Abort();
+    if (m_executionThread.joinable())
+        m_executionThread.join();
+}
+
+bool LibGit2DiffOp::PushChunk(std::string chunk)
+{
+    {
+        std::unique_lock<std::mutex> lock(m_pendingChunksMutex);
+        m_chunkConsumed.wait(lock, [this] { return m_abort || m_pendingChunks.size() < kMaxPendingDiffChunks; });
+        if (m_abort)
+        {
+            return false;
+        }
+        m_pendingChunks.push_back(std::move(chunk));
+    }
+    CallAfter(&LibGit2DiffOp::AppendChunks);
+    return true;
+}
+
+cbEditor *LibGit2DiffOp::GetDiffEditor() const
+{
+    // The user may close the diff while it is still streaming, so never trust m_editor on its own
+    EditorManager *editorManager = Manager::Get()->GetEditorManager();
+    for (int i = 0; i < editorManager->GetEditorsCount(); ++i)
+    {
+        if (editorManager->GetEditor(i) == m_editor)
+        {
+            return m_editor;
+        }
+    }
+    return nullptr;
+}
+
+void LibGit2DiffOp::AppendChunks()
+{
+    std::deque<std::string> chunks;
+    {
+        std::lock_guard<std::mutex> lock(m_pendingChunksMutex);
+        chunks.swap(m_pendingChunks);
+    }
+    m_chunkConsumed.notify_all();
+    if (chunks.empty())
+    {
+        return;
+    }
+    cbEditor *editor = GetDiffEditor();
+    if (!editor)
+    {
+        fprintf(stderr, "LibGit2::%s:%d diff editor closed, cancel diff\n", __FUNCTION__, __LINE__);
+        Abort();
+        return;
+    }
+    cbStyledTextCtrl *ctrl = editor->GetControl();
+    for (const std::string &chunk : chunks)
+    {
+        ctrl->AppendTextRaw(chunk.data(), chunk.size());
+    }
+    editor->SetModified(false);
+}
+
+void LibGit2DiffOp::FinishDiff()
+{
+    AppendChunks();
+    cbEditor *editor = GetDiffEditor();
+    if (editor)
+    {
+        editor->GetControl()->EmptyUndoBuffer();
+        editor->SetModified(false);
+    }
+}
+
+/***********************************************************************
+ *  Method: LibGit2DiffOp::ExecuteImplementation
+ *  Params: std::vector<VcsTreeItem *> &
+ * Returns: void
+ * Effects:
+ ***********************************************************************/
+void LibGit2DiffOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
+{
+    std::vector<std::string> paths;
+    paths.reserve(pathList.size());
+    for (auto &vcsTreeItem : pathList)
+    {
+        wxString relativeFilename = vcsTreeItem->GetRelativeName(m_VcsRootDir);
+        if (relativeFilename.length() == 0)
+        {
+            continue;
+        }
+        paths.emplace_back(relativeFilename.ToUTF8().data());
+    }
+    if (paths.empty())
+    {
+        fprintf(stderr, "LibGit2::%s:%d no files\n", __FUNCTION__, __LINE__);
+        return;
+    }
+
+    // Resolve the revision up front so that a typo is reported before an editor is opened
+    std::string treeId;
+    if (m_target != VcsDiff_Index)
+    {
+        GitRepo gitRepo(m_VcsRootDir);
+        if (!gitRepo.m_repo)
+        {
+            fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+            return;
+        }
+        wxString spec = (m_target == VcsDiff_Revision ? m_revision : wxString(wxT("HEAD"))) + wxT("^{tree}");
+        git_object *tree;
+        int error = git_revparse_single(&tree, gitRepo.m_repo, spec.ToUTF8().data());
+        if (0 == error)
+        {
+            char hex[GIT_OID_HEXSZ + 1];
+            treeId = git_oid_tostr(hex, sizeof(hex), git_object_id(tree));
+            git_object_free(tree);
+        }
+        else if (m_target == VcsDiff_Revision)
+        {
+            const git_error *e = git_error_last();
+            fprintf(stderr, "LibGit2::%s:%d git_revparse_single failed for %s : %d/%d: %s\n", __FUNCTION__, __LINE__,
+                    spec.ToUTF8().data(), error, e->klass, e->message);
+            cbMessageBox(wxString::Format(_("Unknown revision '%s'"), m_revision), _("Diff"), wxICON_ERROR);
+            return;
+        }
+        // An unborn HEAD has no tree yet, everything is diffed against the empty tree
+    }
+
+    // A previous diff still streaming into its editor is left as it is
+    stopExecution();
+    {
+        std::lock_guard<std::mutex> lock(m_pendingChunksMutex);
+        m_pendingChunks.clear();
+        m_abort = false;
+    }
+
+    wxString title;
+    switch (m_target)
+    {
+    case VcsDiff_Head:
+        title = _("Diff to HEAD.patch");
+        break;
+    case VcsDiff_Staged:
+        title = _("Staged changes.patch");
+        break;
+    case VcsDiff_Revision:
+        title = wxString::Format(_("Diff to %s.patch"), FileNamePart(m_revision));
+        break;
+    default:
+        title = _("Diff to index.patch");
+        break;
+    }
+    m_editor = Manager::Get()->GetEditorManager()->New(title);
+    if (!m_editor)
+    {
+        fprintf(stderr, "LibGit2::%s:%d could not create diff editor\n", __FUNCTION__, __LINE__);
+        return;
+    }
+    m_editor->GetControl()->SetLexerLanguage(wxT("diff"));
+
+    m_executionThread = std::thread(&LibGit2DiffOp::StreamDiff, this, std::move(paths), m_target, std::move(treeId));
+}
+
+void LibGit2DiffOp::StreamDiff(std::vector<std::string> paths, VcsDiffTarget target, std::string treeId)
+{
+    wxStopWatch sw;
+    GitRepo gitRepo(m_VcsRootDir);
+    git_repository *repo = gitRepo.m_repo;
+    if (!repo)
+    {
+        fprintf(stderr, "LibGit2::%s:%d gitRepo.m_repo not available\n", __FUNCTION__, __LINE__);
+        return;
+    }
+
+    git_index *index = nullptr;
+    git_tree *tree = nullptr;
+    int error = git_repository_index(&index, repo);
+    if (0 == error && !treeId.empty())
+    {
+        git_oid id;
+        git_oid_fromstr(&id, treeId.c_str());
+        error = git_tree_lookup(&tree, repo, &id);
+    }
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d loading index or tree failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        git_index_free(index);
+        return;
+    }
+
+    std::vector<char *> pathspec;
+    pathspec.reserve(paths.size());
+    for (std::string &path : paths)
+    {
+        pathspec.push_back(&path[0]);
+    }
+    git_diff_options opts = GIT_DIFF_OPTIONS_INIT;
+    opts.pathspec.strings = pathspec.data();
+    opts.pathspec.count = pathspec.size();
+
+    // Listing the deltas is cheap, the working tree side is mostly answered from the index stat cache.
+    // Generating the patch text is what the cache saves.
+    git_diff *diff;
+    switch (target)
+    {
+    case VcsDiff_Staged:
+        error = git_diff_tree_to_index(&diff, repo, tree, index, &opts);
+        break;
+    case VcsDiff_Head:
+    case VcsDiff_Revision:
+        error = git_diff_tree_to_workdir_with_index(&diff, repo, tree, &opts);
+        break;
+    default:
+        error = git_diff_index_to_workdir(&diff, repo, index, &opts);
+        break;
+    }
+    git_tree_free(tree);
+    git_index_free(index);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d git_diff failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        return;
+    }
+
+    VcsDiffCache &cache = m_vcs.GetDiffCache();
+    DiffStreamContext ctx = {this, std::string()};
+    ctx.chunk.reserve(kDiffChunkSize + 1024);
+    const size_t numDeltas = git_diff_num_deltas(diff);
+    size_t cacheHits = 0;
+    for (size_t i = 0; i < numDeltas && !m_abort; ++i)
+    {
+        git_diff_delta delta = *git_diff_get_delta(diff, i);
+        bool cacheable = true;
+        if (!(delta.new_file.flags & GIT_DIFF_FLAG_VALID_ID) && delta.new_file.mode)
+        {
+            // Working tree files that changed on disk are only hashed once their content is needed
+            error = git_repository_hashfile(&delta.new_file.id, repo, delta.new_file.path, GIT_OBJECT_BLOB, delta.new_file.path);
+            if (0 != error)
+            {
+                const git_error *e = git_error_last();
+                fprintf(stderr, "LibGit2::%s:%d git_repository_hashfile failed for %s : %d/%d: %s\n", __FUNCTION__, __LINE__,
+                        delta.new_file.path, error, e->klass, e->message);
+                cacheable = false;
+            }
+        }
+        const std::string key = cacheable ? MakeDiffKey(&delta, opts) : std::string();
+        VcsDiffCache::Patch patch = cacheable ? cache.Lookup(key) : VcsDiffCache::Patch();
+        if (patch)
+        {
+            ++cacheHits;
+        }
+        else
+        {
+            git_patch *gitPatch;
+            git_buf buf = {0};
+            int patchError = git_patch_from_diff(&gitPatch, diff, i);
+            if (0 == patchError)
+            {
+                patchError = git_patch_to_buf(&buf, gitPatch);
+                git_patch_free(gitPatch);
+            }
+            if (0 != patchError)
+            {
+                const git_error *e = git_error_last();
+                fprintf(stderr, "LibGit2::%s:%d patch failed for %s : %d/%d: %s\n", __FUNCTION__, __LINE__, delta.new_file.path, patchError,
+                        e->klass, e->message);
+                git_buf_free(&buf);
+                continue;
+            }
+            patch = std::make_shared<const std::string>(buf.ptr, buf.size);
+            git_buf_free(&buf);
+            if (cacheable)
+            {
+                cache.Insert(key, patch);
+            }
+        }
+        if (!AppendToStream(ctx, patch->data(), patch->size()))
+        {
+            break;
+        }
+    }
+    git_diff_free(diff);
+
+    if (m_abort)
+    {
+        fprintf(stderr, "LibGit2::%s:%d diff cancelled after %ld ms\n", __FUNCTION__, __LINE__, sw.Time());
+        return;
+    }
+    if (ctx.chunk.empty() || PushChunk(std::move(ctx.chunk)))
+    {
+        CallAfter(&LibGit2DiffOp::FinishDiff);
+    }
+    fprintf(stderr, "LibGit2::LibGit2DiffOp[%p] Async diff:%d Exit. Took %ld ms for %zu files, %zu from cache\n", this, __LINE__, sw.Time(),
+            numDeltas, cacheHits);
+}
+
+namespace
+{
+// Restores of fewer files are left to a single checkout
+const size_t kParallelRestoreMin = 256;
+// Files per checkout when restoring in parallel, also how far a restore gets after it is cancelled
+const size_t kRestoreChunkSize = 64;
+const unsigned kMaxRestoreThreads = 4;
+
+struct RestoreProgress
+{
+    VcsProgress *progress;
+    std::atomic_int *restored;
+    int total;
+    size_t reported;
+};
+
+void RestoreProgressCallback(const char * /*path*/, size_t completed, size_t /*total*/, void *payload)
+{
+    RestoreProgress *ctx = static_cast<RestoreProgress *>(payload);
+    *ctx->restored += int(completed - ctx->reported);
+    ctx->reported = completed;
+    ctx->progress->SetValue(*ctx->restored, ctx->total);
+}
+
+int RestorePreviewCallback(git_checkout_notify_t /*why*/, const char *path, const git_diff_file *baseline, const git_diff_file *target,
+                           const git_diff_file *workdir, void *payload)
+{
+    return static_cast<LibGit2RestoreOp *>(payload)->AddPreviewChange(path, !baseline && !workdir, !target);
+}
+
+// Tree the files are restored from. An unborn branch has no HEAD commit yet, and restores like an empty tree.
+int LookupRestoreTree(git_repository *repo, VcsRestoreSource source, const std::string &commitId, git_tree **tree)
+{
+    *tree = nullptr;
+    if (source != VcsRestore_Revision && 1 == git_repository_head_unborn(repo))
+    {
+        git_treebuilder *builder = nullptr;
+        git_oid id;
+        int error = git_treebuilder_new(&builder, repo, nullptr);
+        if (0 == error)
+        {
+            error = git_treebuilder_write(&id, builder);
+        }
+        git_treebuilder_free(builder);
+        return 0 == error ? git_tree_lookup(tree, repo, &id) : error;
+    }
+    std::string spec = (source == VcsRestore_Revision ? commitId : std::string("HEAD")) + "^{tree}";
+    return git_revparse_single(reinterpret_cast<git_object **>(tree), repo, spec.c_str());
+}
+
+int CollectStatus(const char *path, unsigned int statusFlags, void *payload)
+{
+    (*static_cast<std::map<std::string, unsigned int> *>(payload))[path] = statusFlags;
+    return 0;
+}
+
+// States of paths, from a status run over just those paths
+void StatesFromStatus(git_repository *repo, const wxString &vcsRootDir, std::vector<std::string> &paths, std::vector<ItemState> &states)
+{
+    std::map<std::string, unsigned int> statusFlags;
+    if (!paths.empty())
+    {
+        Pathspec pathspec;
+        pathspec.paths = paths;
+        git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+        opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+        opts.flags = GIT_STATUS_OPT_INCLUDE_IGNORED | GIT_STATUS_OPT_INCLUDE_UNTRACKED | GIT_STATUS_OPT_INCLUDE_UNMODIFIED |
+                     GIT_STATUS_OPT_DISABLE_PATHSPEC_MATCH;
+        opts.pathspec = pathspec.Get();
+        int error = git_status_foreach_ext(repo, &opts, CollectStatus, &statusFlags);
+        if (0 != error)
+        {
+            const git_error *e = git_error_last();
+            fprintf(stderr, "LibGit2::%s:%d git_status_foreach_ext failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        }
+    }
+    states.clear();
+    states.reserve(paths.size());
+    for (const std::string &path : paths)
+    {
+        std::map<std::string, unsigned int>::const_iterator it = statusFlags.find(path);
+        if (it != statusFlags.end())
+        {
+            states.push_back(getItemStateFromLibGit2StatusFlag(it->second));
+        }
+        else if (wxFileExists(vcsRootDir + wxFileName::GetPathSeparator() + wxString::FromUTF8(path.c_str())))
+        {
+            states.push_back(Item_Untracked);
+        }
+        else
+        {
+            states.push_back(Item_UntrackedMissing);
+        }
+    }
+}
+} // namespace
+
+/***********************************************************************
+ *  Method: LibGit2RestoreOp::execute
+ *  Params: std::vector<VcsTreeItem *> &
+ * Returns: void
+ * Effects:
+ ***********************************************************************/
+void LibGit2RestoreOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> pathList)
+{
+    if (m_executionThread.joinable())
+    {
+        fprintf(stderr, "LibGit2::%s:%d a restore is already in progress\n", __FUNCTION__, __LINE__);
+        return;
+    }
+    m_items.clear();
+    m_paths.clear();
+    m_positions.clear();
+    for (auto &vcsTreeItem : pathList)
+    {
+        wxString relativeFilename = vcsTreeItem->GetRelativeName(m_VcsRootDir);
+        if (relativeFilename.length() == 0)
+        {
+            continue;
+        }
+        std::string path(relativeFilename.ToUTF8().data());
+        if (m_positions.insert(std::make_pair(path, m_items.size())).second)
+        {
+            m_items.push_back(vcsTreeItem);
+            m_paths.push_back(path);
+        }
+    }
+    if (m_items.empty())
+    {
+        fprintf(stderr, "LibGit2::%s:%d no files\n", __FUNCTION__, __LINE__);
+        return;
+    }
+
+    if (m_source == VcsRestore_Revision)
+    {
+        // Resolved here, so that a typo is reported straight away
+        GitRepo gitRepo(m_VcsRootDir);
+        git_object *commit = nullptr;
+        int error = gitRepo.m_repo ? git_revparse_single(&commit, gitRepo.m_repo, (m_revision + wxT("^{commit}")).ToUTF8().data()) : -1;
+        if (0 != error)
+        {
+            fprintf(stderr, "LibGit2::%s:%d git_revparse_single failed for %s : %d\n", __FUNCTION__, __LINE__, m_revision.ToUTF8().data(), error);
+            cbMessageBox(wxString::Format(_("Unknown revision '%s'"), m_revision), _("Restore"), wxICON_ERROR);
+            m_items.clear();
+            return;
+        }
+        char hex[GIT_OID_HEXSZ + 1];
+        m_commitId = git_oid_tostr(hex, sizeof(hex), git_object_id(commit));
+        git_object_free(commit);
+    }
+
+    m_preview.clear();
+    m_previewed = false;
+    m_abort = false;
+    m_progress.Start(_("Restore"), _("Looking for changes to restore..."), int(m_items.size()));
+    m_executionThread = std::thread(&LibGit2RestoreOp::PreviewRestore, this);
+}
+
+int LibGit2RestoreOp::AddPreviewChange(const char *path, bool created, bool deleted)
+{
+    std::map<std::string, size_t>::const_iterator it = m_positions.find(path);
+    if (it != m_positions.end())
+    {
+        Change change = {it->second, deleted ? 'D' : (created ? 'A' : 'M')};
+        m_preview.push_back(change);
+        m_progress.SetValue(int(m_preview.size()), int(m_items.size()));
+    }
+    return m_abort ? GIT_EUSER : 0;
+}
+
+void LibGit2RestoreOp::PreviewRestore()
+{
+    wxStopWatch sw;
+    GitRepo gitRepo(m_VcsRootDir);
+    if (gitRepo.m_repo)
+    {
+        // Nothing is written, the dry run only reports through the notify callback
+        std::vector<size_t> positions(m_items.size());
+        for (size_t i = 0; i < positions.size(); ++i)
+        {
+            positions[i] = i;
+        }
+        std::atomic_int restored(0);
+        m_previewed = CheckoutItems(gitRepo.m_repo, positions, true, true, restored, int(positions.size())) && !m_abort;
+    }
+    fprintf(stderr, "LibGit2::%s:%d %zu of %zu files would change, found in %ld ms\n", __FUNCTION__, __LINE__, m_preview.size(), m_items.size(),
+            sw.Time());
+    CallAfter(&LibGit2RestoreOp::ShowPreview);
+}
+
+void LibGit2RestoreOp::ShowPreview()
+{
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+    if (!m_previewed || m_preview.empty())
+    {
+        if (!m_abort)
+        {
+            cbMessageBox(m_previewed ? _("There is nothing to restore.") : _("The files to restore could not be worked out."), _("Restore"),
+                         m_previewed ? wxICON_INFORMATION : wxICON_ERROR);
+        }
+        m_items.clear();
+        return;
+    }
+
+    wxArrayString choices;
+    wxArrayInt selections;
+    for (size_t i = 0; i < m_preview.size(); ++i)
+    {
+        choices.Add(wxString::Format(wxT("%c  %s"), m_preview[i].kind, wxString::FromUTF8(m_paths[m_preview[i].item].c_str())));
+        selections.Add(int(i));
+    }
+    wxString message;
+    switch (m_source)
+    {
+    case VcsRestore_Index:
+        message = _("These files will be reset to the index, losing their unstaged changes:");
+        break;
+    case VcsRestore_Revision:
+        message = wxString::Format(_("These files will be replaced by their version in %s, and staged:"), m_revision);
+        break;
+    default:
+        message = _("These files will be reset to HEAD, losing their staged and unstaged changes:");
+        break;
+    }
+    wxMultiChoiceDialog dlg(Manager::Get()->GetAppWindow(), message, _("Restore"), choices);
+    dlg.SetSelections(selections);
+    if (dlg.ShowModal() != wxID_OK)
+    {
+        m_items.clear();
+        return;
+    }
+    std::vector<Change> changes;
+    selections = dlg.GetSelections();
+    for (int selection : selections)
+    {
+        changes.push_back(m_preview[selection]);
+    }
+    if (changes.empty())
+    {
+        m_items.clear();
+        return;
+    }
+
+    m_restoredItems.clear();
+    m_newStates.clear();
+    m_restored = false;
+    m_abort = false;
+    m_progress.Start(_("Restore"), _("Restoring files..."), int(changes.size()));
+    m_executionThread = std::thread(&LibGit2RestoreOp::RestoreChanges, this, std::move(changes));
+}
+
+void LibGit2RestoreOp::RestoreChanges(std::vector<Change> changes)
+{
+    wxStopWatch sw;
+    // The preview already found the files that change, so only those are checked out
+    std::vector<size_t> positions;
+    positions.reserve(changes.size());
+    for (const Change &change : changes)
+    {
+        positions.push_back(change.item);
+    }
+
+    const int total = int(positions.size());
+    std::atomic_int restored(0);
+    bool succeeded;
+    std::vector<size_t> done;
+    if (positions.size() < kParallelRestoreMin)
+    {
+        GitRepo gitRepo(m_VcsRootDir);
+        succeeded = gitRepo.m_repo && CheckoutItems(gitRepo.m_repo, positions, false, true, restored, total);
+        if (succeeded)
+        {
+            done = positions;
+        }
+    }
+    else
+    {
+        // libgit2 writes the files of one checkout one after the other. Checkouts of separate chunks of paths
+        // are run side by side instead, each on its own repository handle and leaving the index alone, and the
+        // index is brought up to date once at the end.
+        std::atomic<size_t> nextChunk(0);
+        std::atomic_bool failed(false);
+        std::mutex doneMutex;
+        auto checkoutChunks = [this, &positions, &nextChunk, &failed, &doneMutex, &done, &restored, total]()
+        {
+            GitRepo threadRepo(m_VcsRootDir);
+            if (!threadRepo.m_repo)
+            {
+                failed = true;
+                return;
+            }
+            for (size_t chunk = nextChunk++; chunk * kRestoreChunkSize < positions.size() && !m_abort; chunk = nextChunk++)
+            {
+                std::vector<size_t>::const_iterator first = positions.begin() + chunk * kRestoreChunkSize;
+                std::vector<size_t> chunkPositions(first, first + std::min(kRestoreChunkSize, size_t(positions.end() - first)));
+                // A chunk that failed may be half written, so its files are left to the status update
+                if (!CheckoutItems(threadRepo.m_repo, chunkPositions, false, false, restored, total))
+                {
+                    failed = true;
+                    continue;
+                }
+                std::lock_guard<std::mutex> lock(doneMutex);
+                done.insert(done.end(), chunkPositions.begin(), chunkPositions.end());
+            }
+        };
+        unsigned threadCount = std::min(std::max(std::thread::hardware_concurrency(), 1u), kMaxRestoreThreads);
+        std::vector<std::thread> threads;
+        for (unsigned i = 1; i < threadCount; ++i)
+        {
+            threads.emplace_back(checkoutChunks);
+        }
+        checkoutChunks();
+        for (std::thread &thread : threads)
+        {
+            thread.join();
+        }
+        // Restoring from the index leaves it as it is
+        if (m_source != VcsRestore_Index && !done.empty())
+        {
+            GitRepoIndex gitRepoIndex(m_VcsRootDir);
+            if (gitRepoIndex.m_idx && IndexCheckedOutItems(gitRepoIndex.m_gitRepo.m_repo, gitRepoIndex.m_idx, done))
+            {
+                gitRepoIndex.SetModified();
+            }
+        }
+        succeeded = !failed && !m_abort;
+    }
+
+    // Only the files actually written need a new state
+    GitRepo gitRepo(m_VcsRootDir);
+    if (gitRepo.m_repo && !done.empty())
+    {
+        std::vector<std::string> paths;
+        for (size_t position : done)
+        {
+            m_restoredItems.push_back(m_items[position]);
+            paths.push_back(m_paths[position]);
+        }
+        StatesFromStatus(gitRepo.m_repo, m_VcsRootDir, paths, m_newStates);
+    }
+    m_restored = succeeded;
+    fprintf(stderr, "LibGit2::%s:%d restored %d of %zu files in %ld ms\n", __FUNCTION__, __LINE__, int(restored), positions.size(), sw.Time());
+    CallAfter(&LibGit2RestoreOp::FinishRestore);
+}
+
+bool LibGit2RestoreOp::CheckoutItems(git_repository *repo, const std::vector<size_t> &positions, bool dryRun, bool updateIndex,
+                                     std::atomic_int &restored, int total)
+{
+    if (positions.empty())
+    {
+        return true;
+    }
+    Pathspec pathspec;
+    for (size_t position : positions)
+    {
+        pathspec.paths.push_back(m_paths[position]);
+    }
+    RestoreProgress progress = {&m_progress, &restored, total, 0};
+    git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+    opts.checkout_strategy = GIT_CHECKOUT_FORCE | GIT_CHECKOUT_DISABLE_PATHSPEC_MATCH;
+    if (!updateIndex)
+    {
+        opts.checkout_strategy |= GIT_CHECKOUT_DONT_UPDATE_INDEX;
+    }
+    if (dryRun)
+    {
+        opts.checkout_strategy |= GIT_CHECKOUT_DRY_RUN;
+        opts.notify_flags = GIT_CHECKOUT_NOTIFY_UPDATED;
+        opts.notify_cb = RestorePreviewCallback;
+        opts.notify_payload = this;
+    }
+    else
+    {
+        opts.progress_cb = RestoreProgressCallback;
+        opts.progress_payload = &progress;
+    }
+    opts.paths = pathspec.Get();
+
+    int error;
+    switch (m_source)
+    {
+    case VcsRestore_Index:
+        error = git_checkout_index(repo, nullptr, &opts);
+        break;
+    default:
+    {
+        git_tree *tree;
+        error = LookupRestoreTree(repo, m_source, m_commitId, &tree);
+        if (0 == error)
+        {
+            error = git_checkout_tree(repo, reinterpret_cast<git_object *>(tree), &opts);
+        }
+        git_tree_free(tree);
+        break;
+    }
+    }
+    if (0 != error && !m_abort)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d checkout failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e ? e->klass : 0, e ? e->message : "");
+    }
+    return 0 == error;
+}
+
+// The checkout wrote the files from the tree, so their entries take the ids and modes from there instead of
+// hashing the files again, and the stat data from the files just written
+bool LibGit2RestoreOp::IndexCheckedOutItems(git_repository *repo, git_index *index, const std::vector<size_t> &positions) const
+{
+    git_tree *tree;
+    int error = LookupRestoreTree(repo, m_source, m_commitId, &tree);
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d tree lookup failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e ? e->klass : 0, e ? e->message : "");
+        return false;
+    }
+    const int indexCaps = git_index_caps(index);
+    bool modified = false;
+    for (size_t position : positions)
+    {
+        const std::string &path = m_paths[position];
+        git_tree_entry *treeEntry;
+        if (0 != git_tree_entry_bypath(&treeEntry, tree, path.c_str()))
+        {
+            // Not in the tree, so the checkout deleted it
+            modified |= nullptr != git_index_get_bypath(index, path.c_str(), 0);
+            git_index_remove_bypath(index, path.c_str());
+            continue;
+        }
+        if (GIT_OBJECT_BLOB == git_tree_entry_type(treeEntry))
+        {
+            NewFile file;
+            file.path = path;
+            file.id = *git_tree_entry_id(treeEntry);
+            wxString fileName = m_VcsRootDir + wxFileName::GetPathSeparator() + wxString::FromUTF8(path.c_str());
+            if (0 != wxLstat(fileName, &file.st))
+            {
+                // No stat data, so status hashes the file next time
+                memset(&file.st, 0, sizeof(file.st));
+            }
+            git_index_entry entry;
+            FillIndexEntry(entry, file, indexCaps);
+            entry.mode = git_tree_entry_filemode(treeEntry);
+            error = git_index_add(index, &entry);
+            if (0 != error)
+            {
+                const git_error *e = git_error_last();
+                fprintf(stderr, "LibGit2::%s:%d git_index_add failed for %s : %d/%d: %s\n", __FUNCTION__, __LINE__, path.c_str(), error,
+                        e ? e->klass : 0, e ? e->message : "");
+            }
+            modified |= 0 == error;
+        }
+        git_tree_entry_free(treeEntry);
+    }
+    git_tree_free(tree);
+    return modified;
+}
+
+void LibGit2RestoreOp::FinishRestore()
+{
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+    if (!m_restoredItems.empty())
+    {
+        ApplyStates(m_restoredItems, m_newStates);
+    }
+    if (!m_restored)
+    {
+        // Some of the files may have been restored before it stopped
+        m_vcs.UpdateOp->execute(m_items);
+    }
+    m_items.clear();
+    m_restoredItems.clear();
+}
+
+void LibGit2RestoreOp::stopExecution()
+{
+    m_abort = true;
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+}
+
+namespace
+{
+// Conflicting paths listed when a checkout is refused
+const size_t kConflictsShown = 20;
+
+template <class Op>
+int CheckoutNotifyCallback(git_checkout_notify_t why, const char *path, const git_diff_file * /*baseline*/, const git_diff_file * /*target*/,
+                           const git_diff_file * /*workdir*/, void *payload)
+{
+    return static_cast<Op *>(payload)->AddChange(path, GIT_CHECKOUT_NOTIFY_CONFLICT == why);
+}
+
+void CheckoutProgressCallback(const char * /*path*/, size_t completed, size_t total, void *payload)
+{
+    static_cast<VcsProgress *>(payload)->SetValue(int(completed), int(total));
+}
+
+// The first kConflictsShown paths one per line, and how many more there are
+wxString ListPaths(const std::vector<std::string> &paths)
+{
+    wxString files;
+    for (size_t i = 0; i < paths.size() && i < kConflictsShown; ++i)
+    {
+        files += wxString::FromUTF8(paths[i].c_str()) + wxT("\n");
+    }
+    if (paths.size() > kConflictsShown)
+    {
+        files += wxString::Format(_("and %lu more\n"), (unsigned long)(paths.size() - kConflictsShown));
+    }
+    return files;
+}
+
+// Project files by relative path, for matching the paths an operation writes
+void IndexItems(const wxString &vcsRootDir, const std::vector<std::shared_ptr<VcsTreeItem>> &projectFiles,
+                std::vector<std::shared_ptr<VcsTreeItem>> &items, std::map<std::string, size_t> &positions)
+{
+    items.clear();
+    positions.clear();
+    for (auto &vcsTreeItem : projectFiles)
+    {
+        wxString relativeFilename = vcsTreeItem->GetRelativeName(vcsRootDir);
+        if (relativeFilename.length() == 0)
+        {
+            continue;
+        }
+        if (positions.insert(std::make_pair(std::string(relativeFilename.ToUTF8().data()), items.size())).second)
+        {
+            items.push_back(vcsTreeItem);
+        }
+    }
+}
+
+// Puts the new states of the written paths in the status table and on the project files among them.
+// Paths past the end of states were not got to; their project files are left in unknown.
+void ApplyWrittenStates(VcsStatusTable &statusTable, const std::vector<std::shared_ptr<VcsTreeItem>> &items,
+                        const std::map<std::string, size_t> &positions, const std::vector<std::string> &paths,
+                        const std::vector<ItemState> &states, std::vector<std::shared_ptr<VcsTreeItem>> &unknown,
+                        std::vector<wxString> &applied)
+{
+    for (size_t i = 0; i < paths.size(); ++i)
+    {
+        std::map<std::string, size_t>::const_iterator it = positions.find(paths[i]);
+        if (i >= states.size())
+        {
+            if (it != positions.end())
+            {
+                unknown.push_back(items[it->second]);
+            }
+            continue;
+        }
+        const wxString path = wxString::FromUTF8(paths[i].c_str());
+        if (Item_UntrackedMissing == states[i])
+        {
+            statusTable.Erase(path);
+        }
+        else
+        {
+            statusTable.Update(path, states[i]);
+        }
+        if (it != positions.end())
+        {
+            items[it->second]->SetState(states[i]);
+            items[it->second]->VisualiseState();
+        }
+        applied.push_back(wxFileName(path, wxPATH_UNIX).GetFullPath());
+    }
+}
+} // namespace
+
+/***********************************************************************
+ *  Method: LibGit2CheckoutOp::ExecuteImplementation
+ *  Params: std::vector<VcsTreeItem *> &
+ * Returns: void
+ * Effects:
+ ***********************************************************************/
+void LibGit2CheckoutOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> projectFiles)
+{
+    if (m_executionThread.joinable())
+    {
+        fprintf(stderr, "LibGit2::%s:%d a checkout is already in progress\n", __FUNCTION__, __LINE__);
+        return;
+    }
+    IndexItems(m_VcsRootDir, projectFiles, m_items, m_positions);
+    m_changed.clear();
+    m_newStates.clear();
+    m_conflicts.clear();
+    m_checkedOut = false;
+    m_failure.clear();
+    m_abort = false;
+    m_progress.Start(_("Checkout"), wxString::Format(_("Switching to %s..."), m_target), 1);
+    m_executionThread = std::thread(&LibGit2CheckoutOp::Checkout, this, std::string(m_target.ToUTF8().data()));
+}
+
+int LibGit2CheckoutOp::AddChange(const char *path, bool conflict)
+{
+    if (m_abort)
+    {
+        return -1;
+    }
+    (conflict ? m_conflicts : m_changed).push_back(path);
+    return 0;
+}
+
+void LibGit2CheckoutOp::Checkout(std::string name)
+{
+    wxStopWatch sw;
+    GitRepo gitRepo(m_VcsRootDir);
+    git_repository *repo = gitRepo.m_repo;
+    const std::string refName = (VcsRef_Tag == m_kind ? "refs/tags/" : "refs/heads/") + name;
+    // Only this one ref is peeled, annotated tags included
+    git_object *commit = nullptr;
+    int error = repo ? git_revparse_single(&commit, repo, (refName + "^{commit}").c_str()) : -1;
+    git_oid commitId = {{0}};
+    if (0 == error)
+    {
+        // Checked out against the HEAD tree, the default baseline, only files that differ between the two commits
+        // are written. Local changes to any of them stop the checkout before a file is touched.
+        git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+        opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+        opts.notify_flags = GIT_CHECKOUT_NOTIFY_CONFLICT | GIT_CHECKOUT_NOTIFY_UPDATED;
+        opts.notify_cb = CheckoutNotifyCallback<LibGit2CheckoutOp>;
+        opts.notify_payload = this;
+        opts.progress_cb = CheckoutProgressCallback;
+        opts.progress_payload = &m_progress;
+        error = git_checkout_tree(repo, commit, &opts);
+        git_oid_cpy(&commitId, git_object_id(commit));
+    }
+    bool headFailed = false;
+    if (0 == error)
+    {
+        // HEAD cannot point at a tag ref, a tag is checked out as its commit
+        error = VcsRef_Tag == m_kind ? git_repository_set_head_detached(repo, &commitId) : git_repository_set_head(repo, refName.c_str());
+        m_checkedOut = 0 == error;
+        headFailed = !m_checkedOut;
+    }
+    if (0 != error && !m_abort && m_conflicts.empty())
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d checkout of %s failed : %d: %s\n", __FUNCTION__, __LINE__, name.c_str(), error, e ? e->message : "");
+        m_failure = e ? wxString::FromUTF8(e->message) : wxString(_("Unknown error"));
+    }
+    if (headFailed && !UndoCheckout(repo, commit))
+    {
+        m_failure += _("\nThe working tree was left at the new commit.");
+    }
+    git_object_free(commit);
+
+    // The states of the files written follow from a status run over just those paths
+    if (repo && m_conflicts.empty() && !m_changed.empty())
+    {
+        StatesFromStatus(repo, m_VcsRootDir, m_changed, m_newStates);
+    }
+    fprintf(stderr, "LibGit2::%s:%d checkout of %s wrote %zu files in %ld ms\n", __FUNCTION__, __LINE__, name.c_str(),
+            m_newStates.size(), sw.Time());
+    CallAfter(&LibGit2CheckoutOp::FinishCheckout);
+}
+
+// HEAD did not move after the working tree was checked out at target, so the files go back to the HEAD commit.
+// Against the target tree as the baseline only the files the checkout wrote are touched.
+bool LibGit2CheckoutOp::UndoCheckout(git_repository *repo, git_object *target)
+{
+    git_object *baseline = nullptr;
+    git_object *head = nullptr;
+    int error = git_object_peel(&baseline, target, GIT_OBJECT_TREE);
+    if (0 == error)
+    {
+        error = git_revparse_single(&head, repo, "HEAD^{tree}");
+    }
+    if (0 == error)
+    {
+        git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+        opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+        opts.baseline = reinterpret_cast<git_tree *>(baseline);
+        error = git_checkout_tree(repo, head, &opts);
+    }
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d putting back HEAD failed : %d: %s\n", __FUNCTION__, __LINE__, error, e ? e->message : "");
+    }
+    git_object_free(head);
+    git_object_free(baseline);
+    return 0 == error;
+}
+
+void LibGit2CheckoutOp::FinishCheckout()
+{
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+    if (!m_conflicts.empty())
+    {
+        cbMessageBox(wxString::Format(_("%s was not checked out, it would overwrite local changes to:\n\n"), m_target) + ListPaths(m_conflicts),
+                     _("Checkout"), wxICON_WARNING);
+    }
+    else if (!m_failure.IsEmpty())
+    {
+        cbMessageBox(wxString::Format(_("Checkout of %s failed: %s"), m_target, m_failure), _("Checkout"), wxICON_ERROR);
+    }
+
+    // Only the paths the checkout wrote change state; everything else is as it was. If it stopped
+    // while writing, the status update finds out how far it got.
+    std::vector<std::shared_ptr<VcsTreeItem>> unknown;
+    std::vector<wxString> applied;
+    ApplyWrittenStates(m_vcs.GetStatusTable(), m_items, m_positions, m_changed, m_newStates, unknown, applied);
+    if (!unknown.empty() && m_conflicts.empty())
+    {
+        m_vcs.UpdateOp->execute(std::move(unknown));
+    }
+    m_vcs.NotifyStatesChanged(applied);
+    m_items.clear();
+    m_positions.clear();
+    m_changed.clear();
+    m_newStates.clear();
+    m_conflicts.clear();
+}
+
+void LibGit2CheckoutOp::stopExecution()
+{
+    m_abort = true;
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+}
+
+/***********************************************************************
+ *  Method: LibGit2MergeOp::ExecuteImplementation
+ *  Params: std::vector<VcsTreeItem *> &
+ * Returns: void
+ * Effects:
+ ***********************************************************************/
+void LibGit2MergeOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> projectFiles)
+{
+    if (m_executionThread.joinable())
+    {
+        fprintf(stderr, "LibGit2::%s:%d a merge is already in progress\n", __FUNCTION__, __LINE__);
+        return;
+    }
+    IndexItems(m_VcsRootDir, projectFiles, m_items, m_positions);
+    m_changed.clear();
+    m_newStates.clear();
+    m_blocked.clear();
+    m_conflicts.clear();
+    m_outcome = Merge_Failed;
+    m_failure.clear();
+    m_abort = false;
+    m_progress.Start(_("Merge"), wxString::Format(_("Merging %s..."), m_source), 1);
+    m_executionThread = std::thread(&LibGit2MergeOp::Merge, this, std::string(m_source.ToUTF8().data()));
+}
+
+int LibGit2MergeOp::AddChange(const char *path, bool conflict)
+{
+    if (m_abort)
+    {
+        return -1;
+    }
+    (conflict ? m_blocked : m_changed).push_back(path);
+    return 0;
+}
+
+void LibGit2MergeOp::Merge(std::string branch)
+{
+    wxStopWatch sw;
+    GitRepo gitRepo(m_VcsRootDir);
+    git_repository *repo = gitRepo.m_repo;
+    git_reference *ref = nullptr;
+    git_annotated_commit *theirs = nullptr;
+    int error = repo ? git_reference_lookup(&ref, repo, ("refs/heads/" + branch).c_str()) : -1;
+    if (0 == error)
+    {
+        // Made from the ref, so that the merge message names the branch
+        error = git_annotated_commit_from_ref(&theirs, repo, ref);
+    }
+    git_reference_free(ref);
+    git_merge_analysis_t analysis = GIT_MERGE_ANALYSIS_NONE;
+    git_merge_preference_t preference = GIT_MERGE_PREFERENCE_NONE;
+    if (0 == error)
+    {
+        error = git_merge_analysis(&analysis, &preference, repo, (const git_annotated_commit **)&theirs, 1);
+    }
+
+    // Either way the working tree is written by a checkout against HEAD, which only touches the files that change
+    // and stops before touching any if that would lose local changes
+    git_checkout_options checkoutOpts = GIT_CHECKOUT_OPTIONS_INIT;
+    checkoutOpts.checkout_strategy = GIT_CHECKOUT_SAFE;
+    checkoutOpts.notify_flags = GIT_CHECKOUT_NOTIFY_CONFLICT | GIT_CHECKOUT_NOTIFY_UPDATED;
+    checkoutOpts.notify_cb = CheckoutNotifyCallback<LibGit2MergeOp>;
+    checkoutOpts.notify_payload = this;
+    checkoutOpts.progress_cb = CheckoutProgressCallback;
+    checkoutOpts.progress_payload = &m_progress;
+    if (0 == error)
+    {
+        if (analysis & GIT_MERGE_ANALYSIS_UP_TO_DATE)
+        {
+            m_outcome = Merge_UpToDate;
+        }
+        else if ((analysis & GIT_MERGE_ANALYSIS_FASTFORWARD) && !(preference & GIT_MERGE_PREFERENCE_NO_FASTFORWARD))
+        {
+            // HEAD is an ancestor of the branch: nothing is merged and no merge state is written, the branch
+            // commit is checked out and the ref moved to it
+            error = FastForward(repo, git_annotated_commit_id(theirs), "merge " + branch + ": Fast-forward", checkoutOpts);
+            if (0 == error)
+            {
+                m_outcome = Merge_FastForward;
+            }
+        }
+        else if (preference & GIT_MERGE_PREFERENCE_FASTFORWARD_ONLY)
+        {
+            m_outcome = Merge_NotFastForward;
+        }
+        else
+        {
+            // Conflicting paths are left in the index with their three stages and written with conflict markers
+            git_merge_options mergeOpts = GIT_MERGE_OPTIONS_INIT;
+            checkoutOpts.checkout_strategy |= GIT_CHECKOUT_ALLOW_CONFLICTS;
+            error = git_merge(repo, (const git_annotated_commit **)&theirs, 1, &mergeOpts, &checkoutOpts);
+            if (0 == error)
+            {
+                m_outcome = Merge_Merged;
+                FindConflicts(repo);
+            }
+        }
+    }
+    git_annotated_commit_free(theirs);
+    if (0 == error)
+    {
+        // Only a refused checkout reports what was in the way
+        m_blocked.clear();
+    }
+    else if (!m_abort && m_blocked.empty())
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d merge of %s failed : %d: %s\n", __FUNCTION__, __LINE__, branch.c_str(), error, e ? e->message : "");
+        m_failure = e ? wxString::FromUTF8(e->message) : wxString(_("Unknown error"));
+    }
+
+    // The states of the files written and of the conflicted ones follow from a status run over just those paths
+    if (repo && m_blocked.empty())
+    {
+        std::set<std::string> written(m_changed.begin(), m_changed.end());
+        for (const std::string &path : m_conflicts)
+        {
+            if (written.insert(path).second)
+            {
+                m_changed.push_back(path);
+            }
+        }
+        StatesFromStatus(repo, m_VcsRootDir, m_changed, m_newStates);
+    }
+    fprintf(stderr, "LibGit2::%s:%d merge of %s changed %zu files, %zu conflicted, in %ld ms\n", __FUNCTION__, __LINE__, branch.c_str(),
+            m_newStates.size(), m_conflicts.size(), sw.Time());
+    CallAfter(&LibGit2MergeOp::FinishMerge);
+}
+
+int LibGit2MergeOp::FastForward(git_repository *repo, const git_oid *target, const std::string &reflog, git_checkout_options &checkoutOpts)
+{
+    git_object *commit = nullptr;
+    int error = git_object_lookup(&commit, repo, target, GIT_OBJECT_COMMIT);
+    if (0 == error)
+    {
+        error = git_checkout_tree(repo, commit, &checkoutOpts);
+    }
+    git_object_free(commit);
+    if (0 != error)
+    {
+        return error;
+    }
+    // The branch HEAD names moves, and is created if HEAD is unborn. A detached HEAD moves itself.
+    std::string refName("HEAD");
+    git_reference *head;
+    if (0 == git_reference_lookup(&head, repo, "HEAD"))
+    {
+        if (git_reference_type(head) == GIT_REFERENCE_SYMBOLIC)
+        {
+            refName = git_reference_symbolic_target(head);
+        }
+        git_reference_free(head);
+    }
+    git_reference *ref = nullptr;
+    error = git_reference_create(&ref, repo, refName.c_str(), target, 1, reflog.c_str());
+    git_reference_free(ref);
+    return error;
+}
+
+void LibGit2MergeOp::FindConflicts(git_repository *repo)
+{
+    git_index *index = nullptr;
+    git_index_conflict_iterator *it = nullptr;
+    int error = git_repository_index(&index, repo);
+    if (0 == error)
+    {
+        error = git_index_conflict_iterator_new(&it, index);
+    }
+    if (0 != error)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d reading the index conflicts failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        git_index_free(index);
+        return;
+    }
+    const git_index_entry *ancestor;
+    const git_index_entry *ours;
+    const git_index_entry *theirs;
+    while (0 == git_index_conflict_next(&ancestor, &ours, &theirs, it))
+    {
+        // Any of the three stages may be missing, as when one side deleted the file
+        const git_index_entry *entry = ours ? ours : (theirs ? theirs : ancestor);
+        m_conflicts.push_back(entry->path);
+    }
+    git_index_conflict_iterator_free(it);
+    git_index_free(index);
+}
+
+void LibGit2MergeOp::FinishMerge()
+{
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+    if (!m_blocked.empty())
+    {
+        cbMessageBox(wxString::Format(_("%s was not merged, it would overwrite local changes to:\n\n"), m_source) + ListPaths(m_blocked),
+                     _("Merge"), wxICON_WARNING);
+    }
+    else if (!m_failure.IsEmpty())
+    {
+        cbMessageBox(wxString::Format(_("Merge of %s failed: %s"), m_source, m_failure), _("Merge"), wxICON_ERROR);
+    }
+    else if (Merge_UpToDate == m_outcome)
+    {
+        cbMessageBox(wxString::Format(_("Already up to date with %s"), m_source), _("Merge"), wxICON_INFORMATION);
+    }
+    else if (Merge_NotFastForward == m_outcome)
+    {
+        cbMessageBox(wxString::Format(_("%s was not merged: merge.ff is set to only, and HEAD cannot be fast-forwarded to it"), m_source),
+                     _("Merge"), wxICON_WARNING);
+    }
+    else if (Merge_Merged == m_outcome && !m_conflicts.empty())
+    {
+        cbMessageBox(wxString::Format(_("Merging %s left conflicts in:\n\n"), m_source) + ListPaths(m_conflicts) +
+                         _("\nResolve them and commit to conclude the merge."),
+                     _("Merge"), wxICON_WARNING);
+    }
+    else if (Merge_Merged == m_outcome)
+    {
+        cbMessageBox(wxString::Format(_("%s was merged without conflicts. Commit to conclude the merge."), m_source), _("Merge"),
+                     wxICON_INFORMATION);
+    }
+
+    // Only the paths the merge wrote or left conflicted change state
+    std::vector<std::shared_ptr<VcsTreeItem>> unknown;
+    std::vector<wxString> applied;
+    ApplyWrittenStates(m_vcs.GetStatusTable(), m_items, m_positions, m_changed, m_newStates, unknown, applied);
+    if (!unknown.empty() && m_blocked.empty())
+    {
+        m_vcs.UpdateOp->execute(std::move(unknown));
+    }
+    m_vcs.NotifyStatesChanged(applied);
+    m_items.clear();
+    m_positions.clear();
+    m_changed.clear();
+    m_newStates.clear();
+    m_blocked.clear();
+    m_conflicts.clear();
+}
+
+void LibGit2MergeOp::stopExecution()
+{
+    m_abort = true;
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+}
+
+namespace
+{
+int StashApplyProgressCallback(git_stash_apply_progress_t progress, void *payload)
+{
+    return static_cast<LibGit2StashOp *>(payload)->SetStage(int(progress));
+}
+
+int CollectChanged(const char *path, unsigned int /*statusFlags*/, void *payload)
+{
+    static_cast<std::vector<std::string> *>(payload)->push_back(path);
+    return 0;
+}
+} // namespace
+
+/***********************************************************************
+ *  Method: LibGit2StashOp::ExecuteImplementation
+ *  Params: std::vector<VcsTreeItem *> &
+ * Returns: void
+ * Effects:
+ ***********************************************************************/
+void LibGit2StashOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> projectFiles)
+{
+    if (m_executionThread.joinable())
+    {
+        fprintf(stderr, "LibGit2::%s:%d a stash operation is already in progress\n", __FUNCTION__, __LINE__);
+        return;
+    }
+    IndexItems(m_VcsRootDir, projectFiles, m_items, m_positions);
+    m_changed.clear();
+    m_newStates.clear();
+    m_blocked.clear();
+    m_nothingToSave = false;
+    m_failure.clear();
+    m_abort = false;
+    if (VcsStash_Save == m_action)
+    {
+        m_progress.Start(_("Stash"), _("Saving local changes..."), 1);
+        m_executionThread = std::thread(&LibGit2StashOp::Save, this, std::string(m_message.ToUTF8().data()));
+    }
+    else
+    {
+        m_progress.Start(_("Stash"), wxString::Format(_("Applying stash@{%lu}..."), (unsigned long)m_entry), GIT_STASH_APPLY_PROGRESS_DONE);
+        m_executionThread = std::thread(&LibGit2StashOp::Apply, this);
+    }
+}
+
+int LibGit2StashOp::AddChange(const char *path, bool conflict)
+{
+    if (m_abort)
+    {
+        return -1;
+    }
+    (conflict ? m_blocked : m_changed).push_back(path);
+    return 0;
+}
+
+int LibGit2StashOp::SetStage(int stage)
+{
+    if (m_abort)
+    {
+        return -1;
+    }
+    m_progress.SetValue(stage, GIT_STASH_APPLY_PROGRESS_DONE);
+    return 0;
+}
+
+void LibGit2StashOp::Save(std::string message)
+{
+    wxStopWatch sw;
+    GitRepo gitRepo(m_VcsRootDir);
+    git_repository *repo = gitRepo.m_repo;
+    int error = -1;
+    if (repo)
+    {
+        // The stash resets exactly the paths with changes to tracked files, so those are the ones whose state moves
+        git_status_options opts = GIT_STATUS_OPTIONS_INIT;
+        opts.show = GIT_STATUS_SHOW_INDEX_AND_WORKDIR;
+        opts.flags = GIT_STATUS_OPT_EXCLUDE_SUBMODULES;
+        error = git_status_foreach_ext(repo, &opts, CollectChanged, &m_changed);
+    }
+    git_signature *sig = nullptr;
+    if (0 == error)
+    {
+        error = git_signature_default(&sig, repo);
+    }
+    if (0 == error && !m_abort)
+    {
+        git_oid id;
+        error = git_stash_save(&id, repo, sig, message.empty() ? nullptr : message.c_str(), m_keepIndex ? GIT_STASH_KEEP_INDEX : GIT_STASH_DEFAULT);
+        m_nothingToSave = GIT_ENOTFOUND == error;
+    }
+    git_signature_free(sig);
+    if (0 != error && !m_abort && !m_nothingToSave)
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d stash save failed : %d: %s\n", __FUNCTION__, __LINE__, error, e ? e->message : "");
+        m_failure = e ? wxString::FromUTF8(e->message) : wxString(_("Unknown error"));
+    }
+    if (0 == error)
+    {
+        StatesFromStatus(repo, m_VcsRootDir, m_changed, m_newStates);
+    }
+    else
+    {
+        m_changed.clear();
+    }
+    fprintf(stderr, "LibGit2::%s:%d stashed %zu files in %ld ms\n", __FUNCTION__, __LINE__, m_newStates.size(), sw.Time());
+    CallAfter(&LibGit2StashOp::FinishStash);
+}
+
+void LibGit2StashOp::Apply()
+{
+    wxStopWatch sw;
+    GitRepo gitRepo(m_VcsRootDir);
+    git_repository *repo = gitRepo.m_repo;
+    // Checked out against HEAD, which only writes the files the entry changes and stops before touching any
+    // if that would lose local changes
+    git_stash_apply_options opts = GIT_STASH_APPLY_OPTIONS_INIT;
+    opts.checkout_options.checkout_strategy = GIT_CHECKOUT_SAFE;
+    opts.checkout_options.notify_flags = GIT_CHECKOUT_NOTIFY_CONFLICT | GIT_CHECKOUT_NOTIFY_UPDATED;
+    opts.checkout_options.notify_cb = CheckoutNotifyCallback<LibGit2StashOp>;
+    opts.checkout_options.notify_payload = this;
+    opts.progress_cb = StashApplyProgressCallback;
+    opts.progress_payload = this;
+    int error = -1;
+    if (repo)
+    {
+        error = VcsStash_Pop == m_action ? git_stash_pop(repo, m_entry, &opts) : git_stash_apply(repo, m_entry, &opts);
+    }
+    if (0 == error)
+    {
+        m_blocked.clear();
+    }
+    else if (!m_abort && m_blocked.empty())
+    {
+        const git_error *e = git_error_last();
+        fprintf(stderr, "LibGit2::%s:%d stash apply failed : %d: %s\n", __FUNCTION__, __LINE__, error, e ? e->message : "");
+        m_failure = e ? wxString::FromUTF8(e->message) : wxString(_("Unknown error"));
+    }
+
+    // Only the files the apply wrote are looked at again
+    if (repo && m_blocked.empty() && !m_changed.empty())
+    {
+        StatesFromStatus(repo, m_VcsRootDir, m_changed, m_newStates);
+    }
+    fprintf(stderr, "LibGit2::%s:%d applying stash@{%zu} wrote %zu files in %ld ms\n", __FUNCTION__, __LINE__, m_entry, m_newStates.size(),
+            sw.Time());
+    CallAfter(&LibGit2StashOp::FinishStash);
+}
+
+void LibGit2StashOp::FinishStash()
+{
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+    const wxString entry = wxString::Format(wxT("stash@{%lu}"), (unsigned long)m_entry);
+    if (m_nothingToSave)
+    {
+        cbMessageBox(_("There are no local changes to save"), _("Stash"), wxICON_INFORMATION);
+    }
+    else if (!m_blocked.empty())
+    {
+        cbMessageBox(wxString::Format(_("%s was not applied, it would overwrite local changes to:\n\n"), entry) + ListPaths(m_blocked),
+                     _("Stash"), wxICON_WARNING);
+    }
+    else if (!m_failure.IsEmpty())
+    {
+        cbMessageBox(VcsStash_Save == m_action ? _("Saving to the stash failed: ") + m_failure
+                                               : wxString::Format(_("Applying %s failed: %s"), entry, m_failure),
+                     _("Stash"), wxICON_ERROR);
+    }
+
+    // Only the paths stashed or written by the apply change state
+    std::vector<std::shared_ptr<VcsTreeItem>> unknown;
+    std::vector<wxString> applied;
+    ApplyWrittenStates(m_vcs.GetStatusTable(), m_items, m_positions, m_changed, m_newStates, unknown, applied);
+    if (!unknown.empty() && m_blocked.empty())
+    {
+        m_vcs.UpdateOp->execute(std::move(unknown));
+    }
+    m_vcs.NotifyStatesChanged(applied);
+    m_items.clear();
+    m_positions.clear();
+    m_changed.clear();
+    m_newStates.clear();
+    m_blocked.clear();
+}
+
+void LibGit2StashOp::stopExecution()
+{
+    m_abort = true;
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+}
+
+/***********************************************************************
+ *  Method: LibGit2FetchOp::ExecuteImplementation
+ *  Params: std::vector<VcsTreeItem *> &
+ * Returns: void
+ * Effects:
+ ***********************************************************************/
+void LibGit2FetchOp::ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>> projectFiles)
+{
+    if (m_executionThread.joinable())
+    {
+        fprintf(stderr, "LibGit2::%s:%d a fetch is already in progress\n", __FUNCTION__, __LINE__);
+        return;
+    }
+    IndexItems(m_VcsRootDir, projectFiles, m_items, m_positions);
+    m_remote.clear();
+    m_fetched = false;
+    m_result = GitRemoteSync::Pull_Failed;
+    m_changed.clear();
+    m_newStates.clear();
+    m_blocked.clear();
+    m_failure.clear();
+    m_abort = false;
+    m_progress.Start(m_pull ? _("Pull") : _("Fetch"), _("Connecting..."), 1);
+    m_executionThread = std::thread(&LibGit2FetchOp::Fetch, this, m_pull);
+}
+
+void LibGit2FetchOp::Fetch(bool pull)
+{
+    wxStopWatch sw;
+    GitRepo gitRepo(m_VcsRootDir);
+    git_repository *repo = gitRepo.m_repo;
+    if (!repo)
+    {
+        m_failure = _("The repository could not be opened");
+        CallAfter(&LibGit2FetchOp::FinishFetch);
+        return;
+    }
+    GitRemoteSync sync(repo);
+    const std::string remote = sync.DefaultRemote();
+    const wxString remoteName = wxString::FromUTF8(remote.c_str());
+    m_fetched = sync.Fetch(remote, [this, &remoteName](unsigned int received, unsigned int total, size_t bytes) {
+        m_progress.SetLabel(wxString::Format(_("Fetching from %s: %u of %u objects, %lu KiB"), remoteName, received, total,
+                                             (unsigned long)(bytes / 1024)));
+        m_progress.SetValue(int(received), int(total));
+        return !m_abort;
+    });
+    if (m_fetched && pull && !m_abort)
+    {
+        m_progress.SetLabel(_("Fast-forwarding..."));
+        m_result = sync.FastForward(m_changed, m_blocked);
+        // Only what differs between the old and the new HEAD tree can have changed state
+        if (GitRemoteSync::Pull_FastForward == m_result)
+        {
+            StatesFromStatus(repo, m_VcsRootDir, m_changed, m_newStates);
+        }
+    }
+    if (!sync.GetError().empty())
+    {
+        m_failure = wxString::FromUTF8(sync.GetError().c_str());
+    }
+    m_remote = remoteName;
+    fprintf(stderr, "LibGit2::%s:%d %s from %s, %zu files changed, in %ld ms\n", __FUNCTION__, __LINE__, pull ? "pull" : "fetch",
+            remote.c_str(), m_newStates.size(), sw.Time());
+    CallAfter(&LibGit2FetchOp::FinishFetch);
+}
+
+void LibGit2FetchOp::FinishFetch()
+{
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
+    }
+    m_progress.Stop();
+    const wxString title = m_pull ? _("Pull") : _("Fetch");
+    if (!m_fetched)
+    {
+        if (!m_abort)
+        {
+            cbMessageBox(wxString::Format(_("Fetching from %s failed: %s"), m_remote, m_failure), title, wxICON_ERROR);
+        }
+    }
+    else if (m_pull)
+    {
+        switch (m_result)
+        {
+        case GitRemoteSync::Pull_UpToDate:
+            cbMessageBox(_("Already up to date"), title, wxICON_INFORMATION);
+            break;
+        case GitRemoteSync::Pull_Diverged:
+            cbMessageBox(_("The branch and its upstream have diverged and cannot be fast-forwarded. Merge the upstream instead."), title,
+                         wxICON_WARNING);
+            break;
+        case GitRemoteSync::Pull_NoUpstream:
+            cbMessageBox(_("Nothing to pull: ") + m_failure, title, wxICON_INFORMATION);
+            break;
+        case GitRemoteSync::Pull_Blocked:
+            cbMessageBox(_("The branch was not fast-forwarded, it would overwrite local changes to:\n\n") + ListPaths(m_blocked), title,
+                         wxICON_WARNING);
+            break;
+        case GitRemoteSync::Pull_Failed:
+            if (!m_abort)
+            {
+                cbMessageBox(_("The pull failed: ") + m_failure, title, wxICON_ERROR);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // Only the paths the fast-forward changed are looked at again
+    std::vector<std::shared_ptr<VcsTreeItem>> unknown;
+    std::vector<wxString> applied;
+    ApplyWrittenStates(m_vcs.GetStatusTable(), m_items, m_positions, m_changed, m_newStates, unknown, applied);
+    if (!unknown.empty())
+    {
+        m_vcs.UpdateOp->execute(std::move(unknown));
+    }
+    // The remote-tracking branches moved, and with them the ahead and behind counts
+    if (applied.empty())
+    {
+        m_vcs.NotifyBranchChanged();
+    }
+    else
+    {
+        m_vcs.NotifyStatesChanged(applied);
+    }
+    m_items.clear();
+    m_positions.clear();
+    m_changed.clear();
+    m_newStates.clear();
+    m_blocked.clear();
+}
+
+void LibGit2FetchOp::stopExecution()
+{
+    m_abort = true;
+    if (m_executionThread.joinable())
+    {
+        m_executionThread.join();
     }
-    free(opts.paths.strings);
+    m_progress.Stop();
 }
@@ -1,12 +1,27 @@
 #ifndef LibGit2_OPS_H
 #define LibGit2_OPS_H
 
+#include "IVersionControlSystem.h"
 #include "VcsFileOp.h"
+#include "VcsProgress.h"
 #include "VcsTreeItem.h"
+#include "git_remote_sync.h"
 #include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
 #include <thread>
 
 class LibGit2;
+class cbEditor;
+class HookProcess;
+struct git_checkout_options;
+struct git_index;
+struct git_object;
+struct git_oid;
+struct git_repository;
 
 class LibGit2_Op : public VcsFileOp
 {
@@ -22,6 +37,11 @@ class LibGit2_Op : public VcsFileOp
             fprintf(stderr, "LibGit2::%s:%d array[%zu] = %s\n", __FUNCTION__, __LINE__, i, array[i].ToUTF8().data());
         }
     };
+    // Stage the items into an index the caller holds open, so that several steps can share one index session.
+    // Returns false if no index entry changed, e.g. when the files were staged already.
+    bool StageItems(git_index *index, const std::vector<std::shared_ptr<VcsTreeItem>> &items) const;
+    // Show the states an op worked out itself, without a status update
+    void ApplyStates(const std::vector<std::shared_ptr<VcsTreeItem>> &items, const std::vector<ItemState> &states) const;
     LibGit2 &m_vcs;
 
   private:
@@ -31,6 +51,8 @@ class LibGit2_Op : public VcsFileOp
 class ICommandExecuter;
 enum ItemState;
 
+ItemState getItemStateFromLibGit2StatusFlag(unsigned int statusFlags);
+
 class LibGit2UpdateOp : public LibGit2_Op
 {
   public:
@@ -41,49 +63,358 @@ class LibGit2UpdateOp : public LibGit2_Op
     virtual void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>);
 };
 
-class LibGit2AddOp : public LibGit2_Op
+// Changes the index on a worker, as writing it may have to wait for a git command that holds its lock. The items
+// are updated once the index is written.
+class LibGit2IndexOp : public LibGit2_Op, public wxEvtHandler
 {
   public:
-    LibGit2AddOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils) : LibGit2_Op(vcs, vcsRootDir, shellUtils) {}
+    LibGit2IndexOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils) : LibGit2_Op(vcs, vcsRootDir, shellUtils) {}
+    bool SetsStates() const override { return true; }
+    void stopExecution() override;
 
   protected:
-    virtual void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>);
+    // Worker body. Returns false if no index entry changed, so that the index is not written.
+    virtual bool ChangeIndex(git_index *index, const std::vector<std::shared_ptr<VcsTreeItem>> &items) = 0;
+
+  private:
+    void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
+    void UpdateIndex();
+    void FinishUpdate();
+    std::vector<std::shared_ptr<VcsTreeItem>> m_items;
+    std::thread m_executionThread;
+};
+
+class LibGit2AddOp : public LibGit2IndexOp
+{
+  public:
+    LibGit2AddOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils) : LibGit2IndexOp(vcs, vcsRootDir, shellUtils) {}
+    ~LibGit2AddOp() { stopExecution(); }
+
+  protected:
+    bool ChangeIndex(git_index *index, const std::vector<std::shared_ptr<VcsTreeItem>> &items) override;
 };
 
-class LibGit2CommitOp : public LibGit2AddOp
+class LibGit2CommitOp : public LibGit2_Op, public wxEvtHandler
 {
   public:
-    LibGit2CommitOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils) : LibGit2AddOp(vcs, vcsRootDir, shellUtils) {}
+    LibGit2CommitOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils);
+    ~LibGit2CommitOp() { stopExecution(); }
+    bool SetsStates() const override { return true; }
+    void stopExecution() override;
+    // Called on the UI thread when the running hook process exits
+    void HookFinished(int exitCode);
 
   private:
-    virtual void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>);
+    enum CommitStage
+    {
+        Commit_Staging,
+        Commit_WritingTree,
+        Commit_RunningHooks,
+        Commit_Creating,
+        Commit_StageCount
+    };
+    void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
+    // Worker body. Stages paths, then builds the tree while the hooks run on the UI thread
+    void CreateCommit(bool runHooks);
+    // Queues the pre-commit and commit-msg hooks when the repository opts in with cbvcs.runHooks
+    void FindHooks();
+    void RunNextHook();
+    void DetachHook();
+    void FinishCommit();
+    // Called from the worker
+    void SetStage(CommitStage stage);
+    std::vector<std::shared_ptr<VcsTreeItem>> m_items;
+    // New state of each of m_items, filled in by the worker once the commit is in place
+    std::vector<ItemState> m_newStates;
+    bool m_committed{false};
+    // Why the commit was not made, set by the worker and by a failing hook respectively
+    wxString m_failure;
+    wxString m_hookFailure;
+    // Hooks still to run, in order, and the file handed to commit-msg
+    std::deque<wxString> m_hooks;
+    wxString m_messageFile;
+    HookProcess *m_hookProcess{nullptr};
+    // Guards the hook outcome and the message, which commit-msg may rewrite
+    std::mutex m_hooksMutex;
+    std::condition_variable m_hooksDone;
+    bool m_hooksRunning{false};
+    bool m_hooksFailed{false};
+    wxString m_message;
+    std::thread m_executionThread;
+    std::atomic_bool m_abort = {false};
+    VcsProgress m_progress;
 };
 
-class LibGit2DiffOp : public LibGit2_Op
+class LibGit2DiffOp : public LibGit2_Op, public wxEvtHandler
 {
   public:
     LibGit2DiffOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils) : LibGit2_Op(vcs, vcsRootDir, shellUtils) {}
+    ~LibGit2DiffOp() { stopExecution(); }
+    void stopExecution() override;
+    void SetTarget(VcsDiffTarget target, const wxString &revision)
+    {
+        m_target = target;
+        m_revision = revision;
+    }
+    // Called from the diff worker with a run of complete patch lines. Blocks while the editor is behind,
+    // returns false once the diff has been cancelled.
+    bool PushChunk(std::string chunk);
 
   private:
-    virtual void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>);
+    void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
+    // Worker body. treeId is the hex id of the tree diffed against, empty for the index or an unborn HEAD
+    void StreamDiff(std::vector<std::string> paths, VcsDiffTarget target, std::string treeId);
+    void AppendChunks();
+    void FinishDiff();
+    cbEditor *GetDiffEditor() const;
+    void Abort();
+    VcsDiffTarget m_target{VcsDiff_Index};
+    wxString m_revision;
+    cbEditor *m_editor{nullptr};
+    // UTF-8 patch text produced by the worker, not yet appended to the editor
+    std::deque<std::string> m_pendingChunks;
+    std::mutex m_pendingChunksMutex;
+    std::condition_variable m_chunkConsumed;
+    std::thread m_executionThread;
+    std::atomic_bool m_abort = {false};
 };
 
-class LibGit2RemoveOp : public LibGit2_Op
+class LibGit2RemoveOp : public LibGit2IndexOp
 {
   public:
-    LibGit2RemoveOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils) : LibGit2_Op(vcs, vcsRootDir, shellUtils) {}
+    LibGit2RemoveOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils) : LibGit2IndexOp(vcs, vcsRootDir, shellUtils) {}
+    ~LibGit2RemoveOp() { stopExecution(); }
+
+  protected:
+    bool ChangeIndex(git_index *index, const std::vector<std::shared_ptr<VcsTreeItem>> &items) override;
+};
+
+class LibGit2CheckoutOp : public LibGit2_Op, public wxEvtHandler
+{
+  public:
+    LibGit2CheckoutOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils)
+        : LibGit2_Op(vcs, vcsRootDir, shellUtils), m_progress(m_abort)
+    {
+    }
+    ~LibGit2CheckoutOp() { stopExecution(); }
+    bool SetsStates() const override { return true; }
+    void stopExecution() override;
+    void SetTarget(VcsRefKind kind, const wxString &name)
+    {
+        m_kind = kind;
+        m_target = name;
+    }
+    // Called from the checkout for each file it is about to write or delete, or cannot because of local changes
+    int AddChange(const char *path, bool conflict);
 
   private:
-    virtual void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>);
+    void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
+    // Worker body. Checks out the tree of the branch or tag against the one of HEAD and moves HEAD
+    void Checkout(std::string name);
+    bool UndoCheckout(git_repository *repo, git_object *target);
+    void FinishCheckout();
+    VcsRefKind m_kind{VcsRef_Branch};
+    wxString m_target;
+    // The project files, whose states change along with the files written
+    std::vector<std::shared_ptr<VcsTreeItem>> m_items;
+    std::map<std::string, size_t> m_positions;
+    // Paths the checkout writes or deletes, and their states afterwards
+    std::vector<std::string> m_changed;
+    std::vector<ItemState> m_newStates;
+    // Paths with local changes the checkout would overwrite
+    std::vector<std::string> m_conflicts;
+    bool m_checkedOut{false};
+    wxString m_failure;
+    std::thread m_executionThread;
+    std::atomic_bool m_abort = {false};
+    VcsProgress m_progress;
 };
 
-class LibGit2RestoreOp : public LibGit2_Op
+class LibGit2MergeOp : public LibGit2_Op, public wxEvtHandler
 {
   public:
-    LibGit2RestoreOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils) : LibGit2_Op(vcs, vcsRootDir, shellUtils) {}
+    LibGit2MergeOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils)
+        : LibGit2_Op(vcs, vcsRootDir, shellUtils), m_progress(m_abort)
+    {
+    }
+    ~LibGit2MergeOp() { stopExecution(); }
+    bool SetsStates() const override { return true; }
+    void stopExecution() override;
+    void SetSource(const wxString &branch) { m_source = branch; }
+    // Called from the checkout for each file it is about to write or delete, or cannot because of local changes
+    int AddChange(const char *path, bool conflict);
 
   private:
-    virtual void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>);
+    enum MergeOutcome
+    {
+        Merge_Failed,
+        Merge_UpToDate,
+        Merge_FastForward,
+        Merge_Merged,
+        // merge.ff is only, and the branch has diverged
+        Merge_NotFastForward
+    };
+    void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
+    // Worker body. Fast-forwards when it can, merges into the index and working tree otherwise
+    void Merge(std::string branch);
+    int FastForward(git_repository *repo, const git_oid *target, const std::string &reflog, git_checkout_options &checkoutOpts);
+    // Collects the paths the merge left with conflict entries in the index
+    void FindConflicts(git_repository *repo);
+    void FinishMerge();
+    wxString m_source;
+    // The project files, whose states change along with the files written
+    std::vector<std::shared_ptr<VcsTreeItem>> m_items;
+    std::map<std::string, size_t> m_positions;
+    // Paths the merge writes or leaves conflicted, and their states afterwards
+    std::vector<std::string> m_changed;
+    std::vector<ItemState> m_newStates;
+    // Paths with local changes the merge would overwrite
+    std::vector<std::string> m_blocked;
+    std::vector<std::string> m_conflicts;
+    MergeOutcome m_outcome{Merge_Failed};
+    wxString m_failure;
+    std::thread m_executionThread;
+    std::atomic_bool m_abort = {false};
+    VcsProgress m_progress;
+};
+
+class LibGit2StashOp : public LibGit2_Op, public wxEvtHandler
+{
+  public:
+    LibGit2StashOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils)
+        : LibGit2_Op(vcs, vcsRootDir, shellUtils), m_progress(m_abort)
+    {
+    }
+    ~LibGit2StashOp() { stopExecution(); }
+    bool SetsStates() const override { return true; }
+    void stopExecution() override;
+    void SetAction(VcsStashAction action, size_t entry, const wxString &message, bool keepIndex)
+    {
+        m_action = action;
+        m_entry = entry;
+        m_message = message;
+        m_keepIndex = keepIndex;
+    }
+    // Called from the checkout for each file it is about to write or delete, or cannot because of local changes
+    int AddChange(const char *path, bool conflict);
+    // Called from the apply as it goes through its stages
+    int SetStage(int stage);
+
+  private:
+    void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
+    // Worker bodies
+    void Save(std::string message);
+    void Apply();
+    void FinishStash();
+    VcsStashAction m_action{VcsStash_Save};
+    size_t m_entry{0};
+    wxString m_message;
+    bool m_keepIndex{false};
+    // The project files, whose states change along with the files stashed or applied
+    std::vector<std::shared_ptr<VcsTreeItem>> m_items;
+    std::map<std::string, size_t> m_positions;
+    // Paths the stash reset or the apply wrote, and their states afterwards
+    std::vector<std::string> m_changed;
+    std::vector<ItemState> m_newStates;
+    // Paths with local changes the apply would overwrite
+    std::vector<std::string> m_blocked;
+    bool m_nothingToSave{false};
+    wxString m_failure;
+    std::thread m_executionThread;
+    std::atomic_bool m_abort = {false};
+    VcsProgress m_progress;
+};
+
+class LibGit2FetchOp : public LibGit2_Op, public wxEvtHandler
+{
+  public:
+    LibGit2FetchOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils)
+        : LibGit2_Op(vcs, vcsRootDir, shellUtils), m_progress(m_abort)
+    {
+    }
+    ~LibGit2FetchOp() { stopExecution(); }
+    bool SetsStates() const override { return true; }
+    void stopExecution() override;
+    void SetPull(bool pull) { m_pull = pull; }
+
+  private:
+    void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
+    // Worker body. Fetches the remote of the current branch, then fast-forwards the branch when pulling
+    void Fetch(bool pull);
+    void FinishFetch();
+    bool m_pull{false};
+    // The project files, whose states change along with the files a pull writes
+    std::vector<std::shared_ptr<VcsTreeItem>> m_items;
+    std::map<std::string, size_t> m_positions;
+    wxString m_remote;
+    bool m_fetched{false};
+    GitRemoteSync::PullResult m_result{GitRemoteSync::Pull_Failed};
+    // Paths that differ between the old and the new HEAD tree, and their states afterwards
+    std::vector<std::string> m_changed;
+    std::vector<ItemState> m_newStates;
+    // Paths with local changes the fast-forward would overwrite
+    std::vector<std::string> m_blocked;
+    wxString m_failure;
+    std::thread m_executionThread;
+    std::atomic_bool m_abort = {false};
+    VcsProgress m_progress;
+};
+
+class LibGit2RestoreOp : public LibGit2_Op, public wxEvtHandler
+{
+  public:
+    LibGit2RestoreOp(LibGit2 &vcs, const wxString &vcsRootDir, ICommandExecuter &shellUtils)
+        : LibGit2_Op(vcs, vcsRootDir, shellUtils), m_progress(m_abort)
+    {
+    }
+    ~LibGit2RestoreOp() { stopExecution(); }
+    bool SetsStates() const override { return true; }
+    void stopExecution() override;
+    void SetSource(VcsRestoreSource source, const wxString &revision)
+    {
+        m_source = source;
+        m_revision = revision;
+    }
+    // Called from a dry run checkout for each file it would write or delete
+    int AddPreviewChange(const char *path, bool created, bool deleted);
+
+  private:
+    struct Change
+    {
+        // Position in m_items
+        size_t item;
+        char kind;
+    };
+    void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
+    // Worker bodies. The preview is a dry run over all the items, the restore only checks out the changes
+    // the preview found and the user kept.
+    void PreviewRestore();
+    void RestoreChanges(std::vector<Change> changes);
+    // Checks out the items at positions of m_items, counting the files written in restored
+    bool CheckoutItems(git_repository *repo, const std::vector<size_t> &positions, bool dryRun, bool updateIndex,
+                       std::atomic_int &restored, int total);
+    // Points the index entries of the checked out items at their blobs in the source tree
+    bool IndexCheckedOutItems(git_repository *repo, git_index *index, const std::vector<size_t> &positions) const;
+    void ShowPreview();
+    void FinishRestore();
+    VcsRestoreSource m_source{VcsRestore_Head};
+    wxString m_revision;
+    // Hex id of the commit restored from, for VcsRestore_Revision
+    std::string m_commitId;
+    std::vector<std::shared_ptr<VcsTreeItem>> m_items;
+    // Paths of m_items relative to the working tree, for the worker
+    std::vector<std::string> m_paths;
+    // Lookup of m_paths, for the dry run callback
+    std::map<std::string, size_t> m_positions;
+    std::vector<Change> m_preview;
+    bool m_previewed{false};
+    // Items restored and their new states
+    std::vector<std::shared_ptr<VcsTreeItem>> m_restoredItems;
+    std::vector<ItemState> m_newStates;
+    bool m_restored{false};
+    std::thread m_executionThread;
+    std::atomic_bool m_abort = {false};
+    VcsProgress m_progress;
 };
 
 class LibGit2UpdateFullOp : public LibGit2UpdateOp, public wxEvtHandler
@@ -100,15 +431,19 @@ class LibGit2UpdateFullOp : public LibGit2UpdateOp, public wxEvtHandler
     struct ItemStateValue
     {
         std::shared_ptr<VcsTreeItem> m_treeItem;
+        wxString m_relativeName;
         ItemState m_State;
-        ItemStateValue(std::shared_ptr<VcsTreeItem> treeItem, ItemState state) : m_treeItem(treeItem), m_State(state){}
+        ItemStateValue(std::shared_ptr<VcsTreeItem> treeItem, const wxString &relativeName, ItemState state)
+            : m_treeItem(treeItem), m_relativeName(relativeName), m_State(state){}
     };
-    mutable std::vector<ItemStateValue> m_pendingStates;
     void stopExecution() override;
 
   private:
     void ExecuteImplementation(std::vector<std::shared_ptr<VcsTreeItem>>) override;
     void UpdateStates();
+    // Only the items whose state changed since the last refresh end up here
+    std::vector<ItemStateValue> m_pendingStates;
+    std::mutex m_pendingStatesMutex;
     mutable std::thread m_executionThread;
     std::atomic_bool m_abort = {false};
 };
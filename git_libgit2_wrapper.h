@@ -1,7 +1,12 @@
 #ifndef GIT_LIBGIT2_WRAPPER_H_INCLUDED
 #define GIT_LIBGIT2_WRAPPER_H_INCLUDED
 
+#include <chrono>
 #include <git2.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <thread>
 
 class GitRepo
 {
@@ -55,19 +60,112 @@ class GitRepoIndex
         }
     }
 
+    // Marks the in-memory index as changed, so that it is written back
+    void SetModified()
+    {
+        m_modified = true;
+    }
+
+    // Writes the index, waiting a little for a git command that holds index.lock
+    int Write()
+    {
+        const int maxRetries = 5;
+        std::chrono::milliseconds delay(10);
+        int error;
+        for (int retry = 0;; ++retry)
+        {
+            error = git_index_write(m_idx);
+            if (GIT_ELOCKED != error || retry == maxRetries)
+            {
+                break;
+            }
+            std::this_thread::sleep_for(delay);
+            delay *= 2;
+        }
+        if (0 != error)
+        {
+            const git_error* e = git_error_last();
+            fprintf(stderr, "LibGit2::%s:%d git_index_write failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+        }
+        else
+        {
+            m_modified = false;
+        }
+        return error;
+    }
+
     ~GitRepoIndex()
     {
         if (m_idx)
         {
-            int error = git_index_write(m_idx);
-            if (0 != error)
+            if (m_modified)
             {
-                const git_error* e = git_error_last();
-                fprintf(stderr, "LibGit2::%s:%d git_index_read failed : %d/%d: %s\n", __FUNCTION__, __LINE__, error, e->klass, e->message);
+                Write();
             }
             git_index_free(m_idx);
         }
     }
+
+  private:
+    bool m_modified{false};
+};
+
+// Blames of committed files, most recently used first. Edited buffers are blamed against them, which
+// only diffs the buffer. The blames refer to the repository they were made in, so it is kept open with them.
+class GitBlameCache
+{
+  public:
+    ~GitBlameCache()
+    {
+        Clear();
+    }
+
+    git_repository* GetRepo(const wxString& workDir)
+    {
+        if (!m_repo)
+        {
+            m_repo.reset(new GitRepo(workDir));
+        }
+        return m_repo->m_repo;
+    }
+
+    git_blame* Find(const std::string& key)
+    {
+        for (auto it = m_blames.begin(); it != m_blames.end(); ++it)
+        {
+            if (it->first == key)
+            {
+                m_blames.splice(m_blames.begin(), m_blames, it);
+                return it->second;
+            }
+        }
+        return nullptr;
+    }
+
+    void Add(const std::string& key, git_blame* blame)
+    {
+        m_blames.emplace_front(key, blame);
+        if (m_blames.size() > maxBlames)
+        {
+            git_blame_free(m_blames.back().second);
+            m_blames.pop_back();
+        }
+    }
+
+    void Clear()
+    {
+        for (auto& blame : m_blames)
+        {
+            git_blame_free(blame.second);
+        }
+        m_blames.clear();
+        m_repo.reset();
+    }
+
+  private:
+    static const size_t maxBlames = 8;
+    std::unique_ptr<GitRepo> m_repo;
+    std::list<std::pair<std::string, git_blame*>> m_blames;
 };
 
 #endif // GIT_LIBGIT2_WRAPPER_H_INCLUDED
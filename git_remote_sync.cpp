@@ -0,0 +1,224 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#include "git_remote_sync.h"
+#include <cstdio>
+#include <git2.h>
+
+namespace
+{
+struct FetchContext
+{
+    const GitRemoteSync::ProgressHandler *progress;
+    bool cancelled;
+    bool triedAgent;
+};
+
+int TransferProgress(const git_indexer_progress *stats, void *payload)
+{
+    FetchContext *ctx = static_cast<FetchContext *>(payload);
+    if (!(*ctx->progress)(stats->received_objects, stats->total_objects, stats->received_bytes))
+    {
+        ctx->cancelled = true;
+        return -1;
+    }
+    return 0;
+}
+
+// Keys from a running ssh-agent, tried once so that a rejected key ends the fetch instead of asking again
+int AcquireCredential(git_credential **out, const char * /*url*/, const char *usernameFromUrl, unsigned int allowedTypes, void *payload)
+{
+    FetchContext *ctx = static_cast<FetchContext *>(payload);
+    if ((allowedTypes & GIT_CREDENTIAL_SSH_KEY) && !ctx->triedAgent)
+    {
+        ctx->triedAgent = true;
+        return git_credential_ssh_key_from_agent(out, usernameFromUrl ? usernameFromUrl : "git");
+    }
+    return GIT_PASSTHROUGH;
+}
+
+int CollectDelta(const git_diff_delta *delta, float /*progress*/, void *payload)
+{
+    std::vector<std::string> *paths = static_cast<std::vector<std::string> *>(payload);
+    paths->push_back(delta->new_file.path);
+    return 0;
+}
+
+int CollectBlocked(git_checkout_notify_t /*why*/, const char *path, const git_diff_file * /*baseline*/, const git_diff_file * /*target*/,
+                   const git_diff_file * /*workdir*/, void *payload)
+{
+    static_cast<std::vector<std::string> *>(payload)->push_back(path);
+    return 0;
+}
+} // namespace
+
+void GitRemoteSync::SetError(const char *what, int error)
+{
+    const git_error *e = git_error_last();
+    fprintf(stderr, "LibGit2::%s:%d %s failed : %d: %s\n", __FUNCTION__, __LINE__, what, error, e ? e->message : "");
+    m_error = e ? e->message : what;
+}
+
+std::string GitRemoteSync::DefaultRemote() const
+{
+    std::string remote("origin");
+    git_reference *head = nullptr;
+    git_buf name = {0};
+    if (0 == git_repository_head(&head, m_repo) && git_reference_is_branch(head) &&
+        0 == git_branch_upstream_remote(&name, m_repo, git_reference_name(head)))
+    {
+        remote.assign(name.ptr, name.size);
+    }
+    git_buf_dispose(&name);
+    git_reference_free(head);
+    return remote;
+}
+
+bool GitRemoteSync::Fetch(const std::string &remoteName, const ProgressHandler &progress)
+{
+    m_error.clear();
+    git_remote *remote = nullptr;
+    int error = git_remote_lookup(&remote, m_repo, remoteName.c_str());
+    if (0 != error)
+    {
+        SetError("git_remote_lookup", error);
+        return false;
+    }
+    FetchContext ctx = {&progress, false, false};
+    git_fetch_options opts = GIT_FETCH_OPTIONS_INIT;
+    opts.callbacks.transfer_progress = TransferProgress;
+    opts.callbacks.credentials = AcquireCredential;
+    opts.callbacks.payload = &ctx;
+    // The configured refspecs, and the reflog message git itself would write
+    error = git_remote_fetch(remote, nullptr, &opts, nullptr);
+    git_remote_free(remote);
+    if (0 != error)
+    {
+        if (ctx.cancelled)
+        {
+            m_error = "Cancelled";
+        }
+        else
+        {
+            SetError("git_remote_fetch", error);
+        }
+        return false;
+    }
+    return true;
+}
+
+GitRemoteSync::PullResult GitRemoteSync::FastForward(std::vector<std::string> &changed, std::vector<std::string> &blocked)
+{
+    m_error.clear();
+    git_reference *head = nullptr;
+    git_reference *upstream = nullptr;
+    int error = git_repository_head(&head, m_repo);
+    if (0 != error || !git_reference_is_branch(head))
+    {
+        git_reference_free(head);
+        m_error = "HEAD is not on a branch";
+        return Pull_NoUpstream;
+    }
+    error = git_branch_upstream(&upstream, head);
+    if (0 != error)
+    {
+        git_reference_free(head);
+        m_error = "The branch has no upstream";
+        return Pull_NoUpstream;
+    }
+
+    PullResult result = Pull_Failed;
+    const git_oid *oldId = git_reference_target(head);
+    const git_oid *newId = git_reference_target(upstream);
+    git_commit *oldCommit = nullptr;
+    git_commit *newCommit = nullptr;
+    git_tree *oldTree = nullptr;
+    git_tree *newTree = nullptr;
+    git_diff *diff = nullptr;
+    if (!oldId || !newId)
+    {
+        m_error = "HEAD or its upstream is not a commit";
+    }
+    else if (git_oid_equal(oldId, newId) || 1 == git_graph_descendant_of(m_repo, oldId, newId))
+    {
+        result = Pull_UpToDate;
+    }
+    else if (1 != git_graph_descendant_of(m_repo, newId, oldId))
+    {
+        result = Pull_Diverged;
+    }
+    else if (0 != (error = git_commit_lookup(&oldCommit, m_repo, oldId)) || 0 != (error = git_commit_lookup(&newCommit, m_repo, newId)) ||
+             0 != (error = git_commit_tree(&oldTree, oldCommit)) || 0 != (error = git_commit_tree(&newTree, newCommit)) ||
+             0 != (error = git_diff_tree_to_tree(&diff, m_repo, oldTree, newTree, nullptr)) ||
+             0 != (error = git_diff_foreach(diff, CollectDelta, nullptr, nullptr, nullptr, &changed)))
+    {
+        SetError("diffing HEAD against its upstream", error);
+    }
+    else
+    {
+        // Against the HEAD tree, the default baseline, only the paths in changed are written, and local changes to
+        // any of them stop the checkout before a file is touched
+        git_checkout_options opts = GIT_CHECKOUT_OPTIONS_INIT;
+        opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+        opts.notify_flags = GIT_CHECKOUT_NOTIFY_CONFLICT;
+        opts.notify_cb = CollectBlocked;
+        opts.notify_payload = &blocked;
+        error = git_checkout_tree(m_repo, (const git_object *)newCommit, &opts);
+        if (0 != error)
+        {
+            result = blocked.empty() ? Pull_Failed : Pull_Blocked;
+            SetError("git_checkout_tree", error);
+        }
+        else
+        {
+            git_reference *moved = nullptr;
+            error = git_reference_set_target(&moved, head, newId, "pull: Fast-forward");
+            git_reference_free(moved);
+            if (0 == error)
+            {
+                result = Pull_FastForward;
+            }
+            else
+            {
+                SetError("git_reference_set_target", error);
+                // The branch did not move, so the working tree goes back to its commit. Against the upstream tree
+                // as the baseline only the paths just written are touched.
+                opts = GIT_CHECKOUT_OPTIONS_INIT;
+                opts.checkout_strategy = GIT_CHECKOUT_SAFE;
+                opts.baseline = newTree;
+                int undoError = git_checkout_tree(m_repo, (const git_object *)oldCommit, &opts);
+                if (0 != undoError)
+                {
+                    const git_error *e = git_error_last();
+                    fprintf(stderr, "LibGit2::%s:%d putting back HEAD failed : %d: %s\n", __FUNCTION__, __LINE__, undoError, e ? e->message : "");
+                }
+            }
+        }
+    }
+    if (Pull_FastForward != result)
+    {
+        changed.clear();
+    }
+    git_diff_free(diff);
+    git_tree_free(oldTree);
+    git_tree_free(newTree);
+    git_commit_free(oldCommit);
+    git_commit_free(newCommit);
+    git_reference_free(upstream);
+    git_reference_free(head);
+    return result;
+}
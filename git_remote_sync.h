@@ -0,0 +1,62 @@
+/*  cbvcs Code::Blocks version control system plugin
+
+    Copyright (C) 2011 Dushara Jayasinghe.
+
+    cbvcs is free software: you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation, either version 3 of the License, or
+    (at your option) any later version.
+
+    cbvcs is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with cbvcs.  If not, see <http://www.gnu.org/licenses/>.
+*/
+#ifndef GIT_REMOTE_SYNC_H_INCLUDED
+#define GIT_REMOTE_SYNC_H_INCLUDED
+
+#include <functional>
+#include <string>
+#include <vector>
+
+struct git_repository;
+
+// Fetch from a remote and fast-forward of the current branch to its upstream. Only libgit2 is used, so it
+// runs on a worker as it is; progress goes to a handler that can also cancel.
+class GitRemoteSync
+{
+  public:
+    // Objects received so far out of total, and the bytes they took. Returns false to cancel the transfer.
+    typedef std::function<bool(unsigned int received, unsigned int total, size_t bytes)> ProgressHandler;
+    enum PullResult
+    {
+        Pull_Failed,
+        Pull_UpToDate,
+        Pull_FastForward,
+        // The branch has commits its upstream does not, only a merge would do
+        Pull_Diverged,
+        Pull_NoUpstream,
+        // Local changes to files the fast-forward would write
+        Pull_Blocked
+    };
+
+    explicit GitRemoteSync(git_repository *repo) : m_repo(repo) {}
+    // Remote of the upstream of the current branch, or "origin" when it has none
+    std::string DefaultRemote() const;
+    // Fetch remote with its configured refspecs, updating its remote-tracking branches
+    bool Fetch(const std::string &remote, const ProgressHandler &progress);
+    // Move the current branch to its upstream as last fetched. Paths that differ between the old and the new
+    // HEAD tree go to changed, and only those are written; local changes in the way go to blocked instead.
+    PullResult FastForward(std::vector<std::string> &changed, std::vector<std::string> &blocked);
+    const std::string &GetError() const { return m_error; }
+
+  private:
+    void SetError(const char *what, int error);
+    git_repository *m_repo;
+    std::string m_error;
+};
+
+#endif // GIT_REMOTE_SYNC_H_INCLUDED
@@ -0,0 +1,177 @@
+#include <UnitTest++/UnitTest++.h>
+#include <git_remote_sync.h>
+#include <git2.h>
+#include <cstdlib>
+#include <fstream>
+#include <sstream>
+#include <stdlib.h>
+
+namespace
+{
+
+// A bare repository reached over file:// stands in for the remote. "seed" pushes to it, "work" is the clone
+// under test; after construction the remote is one commit ahead of work, which changed b.txt only.
+// Every test checks ready first, so a setup that failed is reported as such.
+struct RemoteFixture
+{
+    RemoteFixture() : repo(NULL)
+    {
+        char dirTemplate[] = "/tmp/cbvcs-remote-XXXXXX";
+        dir = mkdtemp(dirTemplate);
+        git_libgit2_init();
+        // The branch is named here, so that the user's init.defaultBranch does not leave "work" unborn
+        ready = Run("git init -q --bare --initial-branch=master remote.git") &&
+                Run("git clone -q file://" + dir + "/remote.git seed");
+        Write("seed/a.txt", "a\n");
+        Write("seed/b.txt", "b\n");
+        ready = ready && Commit("seed", "first") && Run("git -C seed push -q origin HEAD:refs/heads/master") &&
+                Run("git clone -q file://" + dir + "/remote.git work");
+        Write("seed/b.txt", "b2\n");
+        ready = ready && Commit("seed", "second") && Run("git -C seed push -q origin HEAD:refs/heads/master") &&
+                0 == git_repository_open(&repo, (dir + "/work").c_str());
+    }
+
+    ~RemoteFixture()
+    {
+        git_repository_free(repo);
+        git_libgit2_shutdown();
+        Run("rm -rf " + dir);
+    }
+
+    bool Run(const std::string &command)
+    {
+        return 0 == std::system(("cd " + dir + " && " + command + " >/dev/null 2>&1").c_str());
+    }
+
+    void Write(const std::string &path, const std::string &content)
+    {
+        std::ofstream(dir + "/" + path) << content;
+    }
+
+    std::string Read(const std::string &path)
+    {
+        std::ifstream in(dir + "/" + path);
+        std::ostringstream content;
+        content << in.rdbuf();
+        return content.str();
+    }
+
+    bool Commit(const std::string &clone, const std::string &message)
+    {
+        return Run("git -C " + clone + " add -A && git -C " + clone +
+            " -c user.name=test -c user.email=test@example.com commit -q -m " + message);
+    }
+
+    bool SameTarget(const char *left, const char *right)
+    {
+        git_oid leftId, rightId;
+        return !git_reference_name_to_id(&leftId, repo, left) && !git_reference_name_to_id(&rightId, repo, right) &&
+               git_oid_equal(&leftId, &rightId);
+    }
+
+    std::string dir;
+    bool ready;
+    git_repository *repo;
+};
+
+bool Continue(unsigned int, unsigned int, size_t)
+{
+    return true;
+}
+
+bool Cancel(unsigned int, unsigned int, size_t)
+{
+    return false;
+}
+
+TEST_FIXTURE(RemoteFixture, DefaultRemote_TrackingBranch_ReturnsUpstreamRemote)
+{
+    CHECK(ready);
+    GitRemoteSync sync(repo);
+
+    CHECK_EQUAL("origin", sync.DefaultRemote());
+}
+
+TEST_FIXTURE(RemoteFixture, Fetch_RemoteAhead_MovesTrackingBranchOnly)
+{
+    CHECK(ready);
+    GitRemoteSync sync(repo);
+
+    CHECK(sync.Fetch("origin", Continue));
+    CHECK(!SameTarget("refs/heads/master", "refs/remotes/origin/master"));
+    CHECK_EQUAL("b\n", Read("work/b.txt"));
+}
+
+TEST_FIXTURE(RemoteFixture, Fetch_HandlerCancels_Fails)
+{
+    CHECK(ready);
+    GitRemoteSync sync(repo);
+
+    CHECK(!sync.Fetch("origin", Cancel));
+    CHECK_EQUAL("Cancelled", sync.GetError());
+    CHECK(SameTarget("refs/heads/master", "refs/remotes/origin/master"));
+}
+
+TEST_FIXTURE(RemoteFixture, FastForward_NotFetched_UpToDate)
+{
+    CHECK(ready);
+    GitRemoteSync sync(repo);
+    std::vector<std::string> changed, blocked;
+
+    CHECK_EQUAL(GitRemoteSync::Pull_UpToDate, sync.FastForward(changed, blocked));
+    CHECK(changed.empty());
+}
+
+TEST_FIXTURE(RemoteFixture, FastForward_Fetched_WritesChangedPathsOnly)
+{
+    CHECK(ready);
+    GitRemoteSync sync(repo);
+    std::vector<std::string> changed, blocked;
+    sync.Fetch("origin", Continue);
+
+    CHECK_EQUAL(GitRemoteSync::Pull_FastForward, sync.FastForward(changed, blocked));
+    CHECK_EQUAL(1u, changed.size());
+    CHECK_EQUAL("b.txt", changed.empty() ? "" : changed[0]);
+    CHECK(blocked.empty());
+    CHECK(SameTarget("refs/heads/master", "refs/remotes/origin/master"));
+    CHECK_EQUAL("b2\n", Read("work/b.txt"));
+}
+
+TEST_FIXTURE(RemoteFixture, FastForward_LocalChangeInTheWay_Blocked)
+{
+    CHECK(ready);
+    GitRemoteSync sync(repo);
+    std::vector<std::string> changed, blocked;
+    sync.Fetch("origin", Continue);
+    Write("work/b.txt", "local\n");
+
+    CHECK_EQUAL(GitRemoteSync::Pull_Blocked, sync.FastForward(changed, blocked));
+    CHECK_EQUAL(1u, blocked.size());
+    CHECK(!SameTarget("refs/heads/master", "refs/remotes/origin/master"));
+    CHECK_EQUAL("local\n", Read("work/b.txt"));
+}
+
+TEST_FIXTURE(RemoteFixture, FastForward_LocalCommit_Diverged)
+{
+    CHECK(ready);
+    GitRemoteSync sync(repo);
+    std::vector<std::string> changed, blocked;
+    Write("work/c.txt", "c\n");
+    CHECK(Commit("work", "local"));
+    sync.Fetch("origin", Continue);
+
+    CHECK_EQUAL(GitRemoteSync::Pull_Diverged, sync.FastForward(changed, blocked));
+    CHECK(!SameTarget("refs/heads/master", "refs/remotes/origin/master"));
+}
+
+TEST_FIXTURE(RemoteFixture, FastForward_DetachedHead_NoUpstream)
+{
+    CHECK(ready);
+    GitRemoteSync sync(repo);
+    std::vector<std::string> changed, blocked;
+    CHECK(Run("git -C work checkout -q --detach"));
+
+    CHECK_EQUAL(GitRemoteSync::Pull_NoUpstream, sync.FastForward(changed, blocked));
+}
+
+}
@@ -0,0 +1,72 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsBlameTable.h>
+
+namespace
+{
+
+TEST(Find_EmptyTable_ReturnsNull)
+{
+    VcsBlameTable table;
+
+    CHECK(table.Find(0) == 0);
+    CHECK_EQUAL(0, table.GetLineCount());
+}
+
+TEST(Find_LineInHunk_ReturnsHunk)
+{
+    VcsBlameTable table;
+    table.Append(0, 3, "aaaa", "Jane", 100);
+    table.Append(3, 2, "bbbb", "John", 200);
+
+    const VcsBlameHunk* hunk = table.Find(2);
+    CHECK(hunk != 0);
+    CHECK_EQUAL("aaaa", hunk->id);
+    hunk = table.Find(3);
+    CHECK(hunk != 0);
+    CHECK_EQUAL("bbbb", hunk->id);
+    CHECK(hunk->author == _("John"));
+    CHECK_EQUAL(200, hunk->time);
+    CHECK_EQUAL(5, table.GetLineCount());
+}
+
+TEST(Find_PastLastHunk_ReturnsNull)
+{
+    VcsBlameTable table;
+    table.Append(0, 3, "aaaa", "Jane", 100);
+
+    CHECK(table.Find(3) == 0);
+    CHECK(table.Find(-1) == 0);
+}
+
+TEST(Find_LineInGap_ReturnsNull)
+{
+    VcsBlameTable table;
+    table.Append(0, 1, "aaaa", "Jane", 100);
+    table.Append(4, 1, "bbbb", "John", 200);
+
+    CHECK(table.Find(2) == 0);
+    CHECK(table.Find(4) != 0);
+}
+
+TEST(Append_NotCommitted_KeepsEmptyId)
+{
+    VcsBlameTable table;
+    table.Append(0, 2, std::string(), 0, 0);
+
+    const VcsBlameHunk* hunk = table.Find(1);
+    CHECK(hunk != 0);
+    CHECK(hunk->id.empty());
+    CHECK(hunk->author.empty());
+}
+
+TEST(Clear_RemovesHunks)
+{
+    VcsBlameTable table;
+    table.Append(0, 2, "aaaa", "Jane", 100);
+    table.Clear();
+
+    CHECK_EQUAL(0u, table.GetHunks().size());
+    CHECK(table.Find(0) == 0);
+}
+
+}
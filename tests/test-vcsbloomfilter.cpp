@@ -0,0 +1,111 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsBloomFilter.h>
+
+namespace
+{
+
+VcsBloomFilter::Result Lookup(const std::string& filter, const std::string& path)
+{
+    VcsBloomFilter::Settings settings;
+    return VcsBloomFilter::Lookup(reinterpret_cast<const unsigned char*>(filter.data()), filter.size(),
+                                  VcsBloomFilter::MakePathKeys(path, settings));
+}
+
+TEST(Murmur3_EmptyString_IsZero)
+{
+    CHECK_EQUAL(0u, VcsBloomFilter::Murmur3("", 0, 0, 2));
+}
+
+TEST(Murmur3_KnownString_MatchesReference)
+{
+    const std::string text("The quick brown fox jumps over the lazy dog");
+
+    CHECK_EQUAL(0x2e4ff723u, VcsBloomFilter::Murmur3(text.data(), text.size(), 0, 2));
+}
+
+TEST(Murmur3_HighBytes_DifferBetweenVersions)
+{
+    const std::string text("\xc3\xa9t\xc3\xa9");
+
+    CHECK(VcsBloomFilter::Murmur3(text.data(), text.size(), 0, 1) != VcsBloomFilter::Murmur3(text.data(), text.size(), 0, 2));
+}
+
+TEST(Murmur3_AsciiOnly_SameInBothVersions)
+{
+    const std::string text("src/main.cpp");
+
+    CHECK_EQUAL(VcsBloomFilter::Murmur3(text.data(), text.size(), 7, 1), VcsBloomFilter::Murmur3(text.data(), text.size(), 7, 2));
+}
+
+TEST(MakePathKeys_NestedPath_OneKeyPerFolder)
+{
+    VcsBloomFilter::Settings settings;
+
+    CHECK_EQUAL(3u, VcsBloomFilter::MakePathKeys("a/b/c.cpp", settings).size());
+    CHECK_EQUAL(7u, VcsBloomFilter::MakePathKeys("a/b/c.cpp", settings)[0].size());
+}
+
+TEST(Build_ChangedPaths_FoundWithTheirFolders)
+{
+    VcsBloomFilter::Settings settings;
+    std::vector<std::string> paths;
+    paths.push_back("src/ui/dialog.cpp");
+    paths.push_back("README.md");
+    const std::string filter = VcsBloomFilter::Build(paths, settings);
+
+    CHECK_EQUAL(VcsBloomFilter::Bloom_Maybe, Lookup(filter, "src/ui/dialog.cpp"));
+    CHECK_EQUAL(VcsBloomFilter::Bloom_Maybe, Lookup(filter, "src/ui"));
+    CHECK_EQUAL(VcsBloomFilter::Bloom_Maybe, Lookup(filter, "README.md"));
+}
+
+TEST(Build_OtherPaths_MostlyRejected)
+{
+    VcsBloomFilter::Settings settings;
+    std::vector<std::string> paths;
+    paths.push_back("src/a.cpp");
+    const std::string filter = VcsBloomFilter::Build(paths, settings);
+
+    int rejected = 0;
+    for(int i = 0; i < 100; i++)
+    {
+        char path[32];
+        snprintf(path, sizeof(path), "other/file%d.cpp", i);
+        if(Lookup(filter, path) == VcsBloomFilter::Bloom_No)
+        {
+            rejected++;
+        }
+    }
+    CHECK(rejected > 90);
+}
+
+TEST(Build_NoChanges_RejectsEverything)
+{
+    VcsBloomFilter::Settings settings;
+    const std::string filter = VcsBloomFilter::Build(std::vector<std::string>(), settings);
+
+    CHECK_EQUAL(1u, filter.size());
+    CHECK_EQUAL(VcsBloomFilter::Bloom_No, Lookup(filter, "a.cpp"));
+}
+
+TEST(Build_TooManyChanges_MatchesEverything)
+{
+    VcsBloomFilter::Settings settings;
+    std::vector<std::string> paths;
+    for(int i = 0; i < 600; i++)
+    {
+        char path[32];
+        snprintf(path, sizeof(path), "f%d", i);
+        paths.push_back(path);
+    }
+    const std::string filter = VcsBloomFilter::Build(paths, settings);
+
+    CHECK_EQUAL(1u, filter.size());
+    CHECK_EQUAL(VcsBloomFilter::Bloom_Maybe, Lookup(filter, "anything/at/all"));
+}
+
+TEST(Lookup_EmptyFilter_IsUnknown)
+{
+    CHECK_EQUAL(VcsBloomFilter::Bloom_Unknown, Lookup(std::string(), "a.cpp"));
+}
+
+}
@@ -0,0 +1,67 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsCommitTable.h>
+
+namespace
+{
+
+TEST(Get_EmptyTable_ReturnsFalse)
+{
+    VcsCommitTable table;
+    VcsCommitInfo info;
+
+    CHECK_EQUAL(false, table.Get(0, info));
+    CHECK_EQUAL(0u, table.Count());
+}
+
+TEST(Append_ThenGet_ReturnsCommit)
+{
+    VcsCommitTable table;
+    table.Append("0123abcd", "Jane", "Fix the build", 1000);
+
+    VcsCommitInfo info;
+    CHECK_EQUAL(true, table.Get(0, info));
+    CHECK_EQUAL("0123abcd", info.id);
+    CHECK(info.author == _("Jane"));
+    CHECK(info.summary == _("Fix the build"));
+    CHECK_EQUAL(1000, info.time);
+}
+
+TEST(Append_Several_KeptInOrder)
+{
+    VcsCommitTable table;
+    table.Append("a", "first", "one", 3);
+    table.Append("b", "second", "two", 2);
+    table.Append("c", "third", "three", 1);
+
+    VcsCommitInfo info;
+    CHECK_EQUAL(3u, table.Count());
+    CHECK_EQUAL(true, table.Get(1, info));
+    CHECK_EQUAL("b", info.id);
+    CHECK(info.summary == _("two"));
+    CHECK_EQUAL(true, table.Get(2, info));
+    CHECK(info.author == _("third"));
+}
+
+TEST(Append_MissingStrings_StoredEmpty)
+{
+    VcsCommitTable table;
+    table.Append("a", 0, 0, 0);
+
+    VcsCommitInfo info;
+    CHECK_EQUAL(true, table.Get(0, info));
+    CHECK(info.author.empty());
+    CHECK(info.summary.empty());
+}
+
+TEST(Clear_RemovesCommits)
+{
+    VcsCommitTable table;
+    table.Append("a", "x", "y", 0);
+    table.Clear();
+
+    VcsCommitInfo info;
+    CHECK_EQUAL(0u, table.Count());
+    CHECK_EQUAL(false, table.Get(0, info));
+}
+
+}
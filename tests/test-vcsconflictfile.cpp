@@ -0,0 +1,132 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsConflictFile.h>
+
+namespace
+{
+
+const char* const kMerged =
+    "a\n"
+    "<<<<<<< ours\n"
+    "b1\n"
+    "||||||| base\n"
+    "b\n"
+    "=======\n"
+    "b2\n"
+    ">>>>>>> theirs\n"
+    "c\n"
+    "<<<<<<< ours\n"
+    "d1\n"
+    "=======\n"
+    "d2\n"
+    ">>>>>>> theirs\n";
+
+TEST(Parse_NoMarkers_NoRegions)
+{
+    VcsConflictFile file;
+
+    CHECK_EQUAL(0u, file.Parse("a\nb\n"));
+    CHECK_EQUAL(0u, file.GetUnresolvedCount());
+    CHECK_EQUAL("a\nb\n", file.Compose());
+}
+
+TEST(Parse_Diff3Markers_SplitsSides)
+{
+    VcsConflictFile file;
+
+    CHECK_EQUAL(2u, file.Parse(kMerged));
+    const VcsConflictRegion& first = file.GetRegion(0);
+    CHECK_EQUAL(1, first.line);
+    CHECK_EQUAL("b1\n", first.ours);
+    CHECK_EQUAL("b\n", first.base);
+    CHECK_EQUAL("b2\n", first.theirs);
+    const VcsConflictRegion& second = file.GetRegion(1);
+    CHECK_EQUAL(9, second.line);
+    CHECK_EQUAL("d1\n", second.ours);
+    CHECK_EQUAL("", second.base);
+    CHECK_EQUAL(true, first.hasBase);
+    CHECK_EQUAL(false, second.hasBase);
+    CHECK_EQUAL("d2\n", second.theirs);
+    CHECK_EQUAL(2u, file.GetUnresolvedCount());
+}
+
+TEST(Parse_TwoWayMarkers_NoBase)
+{
+    VcsConflictFile file;
+
+    CHECK_EQUAL(1u, file.Parse("a\n<<<<<<< ours\nb1\n=======\nb2\n>>>>>>> theirs\n"));
+    CHECK_EQUAL(false, file.GetRegion(0).hasBase);
+    CHECK_EQUAL(false, file.Resolve(0, VcsConflictFile::Conflict_Base));
+    CHECK_EQUAL(VcsConflictFile::Conflict_Unresolved, file.GetResolution(0));
+    CHECK_EQUAL(1u, file.GetUnresolvedCount());
+    CHECK_EQUAL(true, file.Resolve(0, VcsConflictFile::Conflict_Ours));
+    CHECK_EQUAL("a\nb1\n", file.Compose());
+}
+
+TEST(Parse_EmptyBaseSection_CanBeTaken)
+{
+    VcsConflictFile file;
+
+    CHECK_EQUAL(1u, file.Parse("<<<<<<< ours\nb1\n||||||| base\n=======\nb2\n>>>>>>> theirs\n"));
+    CHECK_EQUAL(true, file.GetRegion(0).hasBase);
+    CHECK_EQUAL(true, file.Resolve(0, VcsConflictFile::Conflict_Base));
+    CHECK_EQUAL("", file.Compose());
+}
+
+TEST(Compose_Unresolved_KeepsMarkers)
+{
+    VcsConflictFile file;
+    file.Parse(kMerged);
+
+    CHECK_EQUAL(kMerged, file.Compose());
+}
+
+TEST(Compose_Resolved_TakesChosenSides)
+{
+    VcsConflictFile file;
+    file.Parse(kMerged);
+    file.Resolve(0, VcsConflictFile::Conflict_Base);
+    file.Resolve(1, VcsConflictFile::Conflict_Both);
+
+    CHECK_EQUAL(0u, file.GetUnresolvedCount());
+    CHECK_EQUAL("a\nb\nc\nd1\nd2\n", file.Compose());
+}
+
+TEST(Resolve_BackToUnresolved_CountsAgain)
+{
+    VcsConflictFile file;
+    file.Parse(kMerged);
+    file.Resolve(0, VcsConflictFile::Conflict_Theirs);
+    file.Resolve(0, VcsConflictFile::Conflict_Ours);
+
+    CHECK_EQUAL(1u, file.GetUnresolvedCount());
+    file.Resolve(0, VcsConflictFile::Conflict_Unresolved);
+    CHECK_EQUAL(2u, file.GetUnresolvedCount());
+}
+
+TEST(Parse_MarkerLookalikes_AreText)
+{
+    VcsConflictFile file;
+
+    CHECK_EQUAL(0u, file.Parse("<<<<<<<<\n=======x\n"));
+    CHECK_EQUAL("<<<<<<<<\n=======x\n", file.Compose());
+}
+
+TEST(Parse_UnterminatedRegion_IsText)
+{
+    VcsConflictFile file;
+    const char* const merged = "a\n<<<<<<< ours\nb\n=======\nc";
+
+    CHECK_EQUAL(0u, file.Parse(merged));
+    CHECK_EQUAL(merged, file.Compose());
+}
+
+TEST(Parse_CrLf_KeepsLineEnds)
+{
+    VcsConflictFile file;
+
+    CHECK_EQUAL(1u, file.Parse("<<<<<<< ours\r\nb1\r\n=======\r\nb2\r\n>>>>>>> theirs\r\n"));
+    file.Resolve(0, VcsConflictFile::Conflict_Theirs);
+    CHECK_EQUAL("b2\r\n", file.Compose());
+}
+
+}
@@ -0,0 +1,76 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsDiffCache.h>
+
+namespace
+{
+
+VcsDiffCache::Patch MakePatch(const std::string& text)
+{
+    return VcsDiffCache::Patch(new std::string(text));
+}
+
+TEST(Lookup_UnknownKey_ReturnsEmpty)
+{
+    VcsDiffCache cache;
+
+    CHECK(!cache.Lookup("a"));
+}
+
+TEST(Insert_ThenLookup_ReturnsPatch)
+{
+    VcsDiffCache cache;
+    cache.Insert("a", MakePatch("+line\n"));
+
+    VcsDiffCache::Patch patch = cache.Lookup("a");
+    CHECK(patch);
+    CHECK_EQUAL("+line\n", *patch);
+}
+
+TEST(Insert_SameKey_ReplacesPatch)
+{
+    VcsDiffCache cache;
+    cache.Insert("a", MakePatch("12345"));
+    cache.Insert("a", MakePatch("12"));
+
+    CHECK_EQUAL("12", *cache.Lookup("a"));
+    CHECK_EQUAL(2u, cache.GetSize());
+}
+
+TEST(Insert_OverLimit_DropsLeastRecentlyUsed)
+{
+    VcsDiffCache cache(10);
+    cache.Insert("a", MakePatch("aaaa"));
+    cache.Insert("b", MakePatch("bbbb"));
+    cache.Lookup("a");
+    cache.Insert("c", MakePatch("cccc"));
+
+    CHECK(cache.Lookup("a"));
+    CHECK(!cache.Lookup("b"));
+    CHECK(cache.Lookup("c"));
+    CHECK_EQUAL(8u, cache.GetSize());
+}
+
+TEST(Insert_PatchLargerThanLimit_KeptUntilNextInsert)
+{
+    VcsDiffCache cache(4);
+    cache.Insert("a", MakePatch("aaaaaaaa"));
+
+    CHECK(cache.Lookup("a"));
+
+    cache.Insert("b", MakePatch("bb"));
+
+    CHECK(!cache.Lookup("a"));
+    CHECK(cache.Lookup("b"));
+}
+
+TEST(Clear_DropsEverything)
+{
+    VcsDiffCache cache;
+    cache.Insert("a", MakePatch("aaaa"));
+    cache.Clear();
+
+    CHECK(!cache.Lookup("a"));
+    CHECK_EQUAL(0u, cache.GetSize());
+}
+
+}
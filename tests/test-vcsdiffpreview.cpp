@@ -0,0 +1,112 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsDiffPreview.h>
+#include <chrono>
+
+namespace
+{
+
+// Produces "patch of <path>" and records what was produced and reported
+struct Recorder
+{
+    std::mutex mutex;
+    std::condition_variable readyChanged;
+    std::vector<wxString> produced;
+    std::vector<wxString> ready;
+
+    VcsDiffPreview::PatchFunction Produce()
+    {
+        return [this](const wxString& path, std::string& patch)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            produced.push_back(path);
+            patch = "patch of ";
+            patch += path.mb_str();
+            return path != _("broken");
+        };
+    }
+
+    VcsDiffPreview::ReadyHandler Ready()
+    {
+        return [this](const wxString& path)
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            ready.push_back(path);
+            readyChanged.notify_all();
+        };
+    }
+
+    bool WaitForReady(size_t count)
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        return readyChanged.wait_for(lock, std::chrono::seconds(5), [this, count]() { return ready.size() >= count; });
+    }
+};
+
+TEST(Request_NewPath_ProducedOnWorker)
+{
+    Recorder recorder;
+    VcsDiffPreview preview(recorder.Produce(), recorder.Ready());
+
+    CHECK(!preview.Request(_("a.cpp"), std::vector<wxString>()));
+    CHECK(recorder.WaitForReady(1));
+
+    VcsDiffPreview::Patch patch = preview.Lookup(_("a.cpp"));
+    CHECK(patch);
+    CHECK_EQUAL("patch of a.cpp", *patch);
+}
+
+TEST(Request_ProducedPath_ReturnsCachedPatch)
+{
+    Recorder recorder;
+    VcsDiffPreview preview(recorder.Produce(), recorder.Ready());
+    preview.Request(_("a.cpp"), std::vector<wxString>());
+    CHECK(recorder.WaitForReady(1));
+
+    VcsDiffPreview::Patch patch = preview.Request(_("a.cpp"), std::vector<wxString>());
+
+    CHECK(patch);
+    preview.Stop();
+    CHECK_EQUAL(1u, recorder.produced.size());
+}
+
+TEST(Request_WithNeighbours_PrefetchesThemInOrder)
+{
+    Recorder recorder;
+    VcsDiffPreview preview(recorder.Produce(), recorder.Ready());
+    std::vector<wxString> neighbours;
+    neighbours.push_back(_("b.cpp"));
+    neighbours.push_back(_("c.cpp"));
+
+    preview.Request(_("a.cpp"), neighbours);
+    CHECK(recorder.WaitForReady(3));
+
+    CHECK(preview.Lookup(_("c.cpp")));
+    CHECK(recorder.ready[0] == _("a.cpp"));
+    CHECK(recorder.ready[1] == _("b.cpp"));
+    CHECK(recorder.ready[2] == _("c.cpp"));
+}
+
+TEST(Request_ProduceFails_CachesEmptyPatch)
+{
+    Recorder recorder;
+    VcsDiffPreview preview(recorder.Produce(), recorder.Ready());
+
+    preview.Request(_("broken"), std::vector<wxString>());
+    CHECK(recorder.WaitForReady(1));
+
+    VcsDiffPreview::Patch patch = preview.Lookup(_("broken"));
+    CHECK(patch);
+    CHECK(patch->empty());
+}
+
+TEST(Request_AfterStop_NothingProduced)
+{
+    Recorder recorder;
+    VcsDiffPreview preview(recorder.Produce(), recorder.Ready());
+    preview.Stop();
+
+    CHECK(!preview.Request(_("a.cpp"), std::vector<wxString>()));
+    CHECK(recorder.produced.empty());
+}
+
+}
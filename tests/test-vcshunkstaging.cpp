@@ -0,0 +1,103 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsHunkStaging.h>
+
+namespace
+{
+
+VcsPatchHunk MakeHunk(int oldStart, int newStart, const char* lines)
+{
+    VcsPatchHunk hunk;
+    hunk.oldStart = oldStart;
+    hunk.newStart = newStart;
+    // One character of origin, then the text up to and including the line end
+    for(const char* line = lines; *line; )
+    {
+        const char* end = line;
+        while(*end && *end != '\n')
+        {
+            end++;
+        }
+        if(*end)
+        {
+            end++;
+        }
+        VcsPatchLine patchLine = {line[0], std::string(line + 1, end)};
+        hunk.lines.push_back(patchLine);
+        line = end;
+    }
+    return hunk;
+}
+
+// "a b c d" turned into "a B c d e"
+std::vector<VcsPatchHunk> TwoHunks()
+{
+    std::vector<VcsPatchHunk> hunks;
+    hunks.push_back(MakeHunk(1, 1, "-b\n+B\n"));
+    hunks.push_back(MakeHunk(4, 4, "+e\n"));
+    return hunks;
+}
+
+TEST(ApplyHunks_LineOfFirstHunk_OnlyFirstHunkApplied)
+{
+    CHECK_EQUAL("a\nB\nc\nd\n", VcsApplyHunks("a\nb\nc\nd\n", TwoHunks(), 1, 1, true));
+}
+
+TEST(ApplyHunks_LineOfSecondHunk_OnlySecondHunkApplied)
+{
+    CHECK_EQUAL("a\nb\nc\nd\ne\n", VcsApplyHunks("a\nb\nc\nd\n", TwoHunks(), 4, 4, true));
+}
+
+TEST(ApplyHunks_AllLines_GivesWorkingCopy)
+{
+    CHECK_EQUAL("a\nB\nc\nd\ne\n", VcsApplyHunks("a\nb\nc\nd\n", TwoHunks(), 0, 10, false));
+}
+
+TEST(ApplyHunks_UnchangedLine_GivesBase)
+{
+    CHECK_EQUAL("a\nb\nc\nd\n", VcsApplyHunks("a\nb\nc\nd\n", TwoHunks(), 2, 3, true));
+}
+
+TEST(ApplyHunks_SingleAddedLine_OnlyThatLineApplied)
+{
+    std::vector<VcsPatchHunk> hunks;
+    hunks.push_back(MakeHunk(0, 0, "+x\n+y\n"));
+
+    CHECK_EQUAL("y\na\n", VcsApplyHunks("a\n", hunks, 1, 1, false));
+}
+
+TEST(ApplyHunks_PartOfReplacement_KeepsUnselectedRemovedLine)
+{
+    std::vector<VcsPatchHunk> hunks;
+    hunks.push_back(MakeHunk(1, 1, "-b\n+B1\n+B2\n"));
+
+    CHECK_EQUAL("a\nb\nB2\nc\n", VcsApplyHunks("a\nb\nc\n", hunks, 2, 2, false));
+    CHECK_EQUAL("a\nB1\nB2\nc\n", VcsApplyHunks("a\nb\nc\n", hunks, 2, 2, true));
+}
+
+TEST(ApplyHunks_PureDeletion_SelectedFromMarkerLine)
+{
+    std::vector<VcsPatchHunk> hunks;
+    hunks.push_back(MakeHunk(1, 1, "-b\n"));
+
+    CHECK_EQUAL("a\nc\n", VcsApplyHunks("a\nb\nc\n", hunks, 0, 0, false));
+    CHECK_EQUAL("a\nc\n", VcsApplyHunks("a\nb\nc\n", hunks, 1, 1, false));
+    CHECK_EQUAL("a\nb\nc\n", VcsApplyHunks("a\nb\nc\n", hunks, 2, 2, false));
+}
+
+TEST(ApplyHunks_ContextLines_CopiedOnce)
+{
+    std::vector<VcsPatchHunk> hunks;
+    hunks.push_back(MakeHunk(0, 0, " a\n-b\n+B\n c\n"));
+
+    CHECK_EQUAL("a\nB\nc\nd\n", VcsApplyHunks("a\nb\nc\nd\n", hunks, 1, 1, true));
+}
+
+TEST(ApplyHunks_MissingFinalLineEnd_Preserved)
+{
+    std::vector<VcsPatchHunk> hunks;
+    hunks.push_back(MakeHunk(1, 1, "-b\n+b"));
+
+    CHECK_EQUAL("a\nb", VcsApplyHunks("a\nb\n", hunks, 1, 1, true));
+}
+
+}
@@ -0,0 +1,208 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsLineDiff.h>
+
+namespace
+{
+
+std::vector<std::string> SplitLines(const std::string& text)
+{
+    std::vector<std::string> lines;
+    size_t start = 0;
+    for(size_t i = 0; i < text.size(); ++i)
+    {
+        if(text[i] == '\n')
+        {
+            lines.push_back(text.substr(start, i + 1 - start));
+            start = i + 1;
+        }
+    }
+    if(start < text.size())
+    {
+        lines.push_back(text.substr(start));
+    }
+    return lines;
+}
+
+// Not a minimal diff: everything between the common head and tail is one hunk
+bool HeadTailDiff(const std::string& base, const std::string& buffer, std::vector<VcsLineHunk>& hunks)
+{
+    std::vector<std::string> a = SplitLines(base);
+    std::vector<std::string> b = SplitLines(buffer);
+    size_t head = 0;
+    while(head < a.size() && head < b.size() && a[head] == b[head])
+    {
+        ++head;
+    }
+    size_t tail = 0;
+    while(tail < a.size() - head && tail < b.size() - head && a[a.size() - 1 - tail] == b[b.size() - 1 - tail])
+    {
+        ++tail;
+    }
+    if(head + tail == a.size() && head + tail == b.size())
+    {
+        return true;
+    }
+    VcsLineHunk hunk = {int(head), int(a.size() - head - tail), int(head), int(b.size() - head - tail)};
+    hunks.push_back(hunk);
+    return true;
+}
+
+struct Buffer
+{
+    std::vector<std::string> lines;
+    int readFirst;
+    int readCount;
+
+    explicit Buffer(int count) : readFirst(-1), readCount(-1)
+    {
+        for(int i = 0; i < count; ++i)
+        {
+            lines.push_back("line " + std::to_string(i) + "\n");
+        }
+        lines.push_back("");
+    }
+    std::string Text() const
+    {
+        std::string text;
+        for(const std::string& line : lines)
+        {
+            text += line;
+        }
+        return text;
+    }
+    VcsLineDiff::LineReader Reader()
+    {
+        return [this](int first, int count)
+        {
+            readFirst = first;
+            readCount = count;
+            std::string text;
+            for(int i = first; i < first + count; ++i)
+            {
+                text += lines[i];
+            }
+            return text;
+        };
+    }
+    bool Update(VcsLineDiff& diff)
+    {
+        int first, last;
+        return diff.Update(lines.size(), Reader(), HeadTailDiff, first, last);
+    }
+};
+
+TEST(Update_Unchanged_NoHunks)
+{
+    Buffer buffer(10);
+    VcsLineDiff diff;
+    diff.SetBase(buffer.Text());
+
+    CHECK(buffer.Update(diff));
+    CHECK_EQUAL(0u, diff.GetHunks().size());
+    CHECK(!diff.IsDirty());
+}
+
+TEST(Update_ModifiedLine_OneHunk)
+{
+    Buffer buffer(10);
+    VcsLineDiff diff;
+    diff.SetBase(buffer.Text());
+    buffer.lines[4] = "changed\n";
+
+    buffer.Update(diff);
+
+    CHECK_EQUAL(1u, diff.GetHunks().size());
+    CHECK_EQUAL(4, diff.GetHunks()[0].oldStart);
+    CHECK_EQUAL(1, diff.GetHunks()[0].oldLines);
+    CHECK_EQUAL(4, diff.GetHunks()[0].newStart);
+    CHECK_EQUAL(1, diff.GetHunks()[0].newLines);
+}
+
+TEST(Edit_ModifyLine_OnlyRegionRead)
+{
+    Buffer buffer(100);
+    VcsLineDiff diff;
+    diff.SetBase(buffer.Text());
+    buffer.lines[10] = "first change\n";
+    buffer.Update(diff);
+
+    buffer.lines[50] = "second change\n";
+    diff.Edit(50, 0);
+    buffer.Update(diff);
+
+    CHECK_EQUAL(50, buffer.readFirst);
+    CHECK_EQUAL(1, buffer.readCount);
+    CHECK_EQUAL(2u, diff.GetHunks().size());
+    CHECK_EQUAL(10, diff.GetHunks()[0].newStart);
+    CHECK_EQUAL(50, diff.GetHunks()[1].newStart);
+    CHECK_EQUAL(50, diff.GetHunks()[1].oldStart);
+}
+
+TEST(Edit_InsertLinesAbove_LaterHunkShifted)
+{
+    Buffer buffer(100);
+    VcsLineDiff diff;
+    diff.SetBase(buffer.Text());
+    buffer.lines[80] = "change\n";
+    buffer.Update(diff);
+
+    buffer.lines.insert(buffer.lines.begin() + 5, 2, "new\n");
+    diff.Edit(4, 2);
+    buffer.Update(diff);
+
+    CHECK_EQUAL(2u, diff.GetHunks().size());
+    CHECK_EQUAL(5, diff.GetHunks()[0].newStart);
+    CHECK_EQUAL(2, diff.GetHunks()[0].newLines);
+    CHECK_EQUAL(0, diff.GetHunks()[0].oldLines);
+    CHECK_EQUAL(82, diff.GetHunks()[1].newStart);
+    CHECK_EQUAL(80, diff.GetHunks()[1].oldStart);
+}
+
+TEST(Edit_RevertChange_HunkRemoved)
+{
+    Buffer buffer(20);
+    VcsLineDiff diff;
+    diff.SetBase(buffer.Text());
+    const std::string original = buffer.lines[7];
+    buffer.lines[7] = "change\n";
+    buffer.Update(diff);
+
+    buffer.lines[7] = original;
+    diff.Edit(7, 0);
+    buffer.Update(diff);
+
+    CHECK_EQUAL(0u, diff.GetHunks().size());
+}
+
+TEST(Edit_DeleteLines_DeletionHunk)
+{
+    Buffer buffer(20);
+    VcsLineDiff diff;
+    diff.SetBase(buffer.Text());
+    buffer.Update(diff);
+
+    buffer.lines.erase(buffer.lines.begin() + 10, buffer.lines.begin() + 13);
+    diff.Edit(10, -3);
+    buffer.Update(diff);
+
+    CHECK_EQUAL(1u, diff.GetHunks().size());
+    CHECK_EQUAL(10, diff.GetHunks()[0].oldStart);
+    CHECK_EQUAL(3, diff.GetHunks()[0].oldLines);
+    CHECK_EQUAL(10, diff.GetHunks()[0].newStart);
+    CHECK_EQUAL(0, diff.GetHunks()[0].newLines);
+}
+
+TEST(ClearBase_NoHunks)
+{
+    Buffer buffer(5);
+    VcsLineDiff diff;
+    diff.SetBase("other\n");
+    buffer.Update(diff);
+    diff.ClearBase();
+
+    buffer.Update(diff);
+
+    CHECK_EQUAL(0u, diff.GetHunks().size());
+}
+
+}
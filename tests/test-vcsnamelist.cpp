@@ -0,0 +1,106 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsNameList.h>
+
+namespace
+{
+
+std::vector<wxString> Names()
+{
+    std::vector<wxString> names;
+    names.push_back(_("main"));
+    names.push_back(_("feature/Login"));
+    names.push_back(_("release-1.0"));
+    return names;
+}
+
+TEST(Append_NoFilter_AllVisible)
+{
+    VcsNameList list;
+
+    CHECK_EQUAL(3u, list.Append(Names()));
+    CHECK_EQUAL(3u, list.GetCount());
+    CHECK_EQUAL(3u, list.GetVisibleCount());
+    CHECK(list.GetVisible(1) == _("feature/Login"));
+}
+
+TEST(SetFilter_IgnoresCase)
+{
+    VcsNameList list;
+    list.Append(Names());
+
+    list.SetFilter(_("LOG"));
+    CHECK_EQUAL(1u, list.GetVisibleCount());
+    CHECK(list.GetVisible(0) == _("feature/Login"));
+}
+
+TEST(SetFilter_KeepsOrder)
+{
+    VcsNameList list;
+    list.Append(Names());
+
+    list.SetFilter(_("e"));
+    CHECK_EQUAL(2u, list.GetVisibleCount());
+    CHECK(list.GetVisible(0) == _("feature/Login"));
+    CHECK(list.GetVisible(1) == _("release-1.0"));
+}
+
+TEST(Append_WithFilter_OnlyMatchesVisible)
+{
+    VcsNameList list;
+    list.SetFilter(_("rel"));
+
+    CHECK_EQUAL(1u, list.Append(Names()));
+    CHECK_EQUAL(3u, list.GetCount());
+    CHECK(list.GetVisible(0) == _("release-1.0"));
+}
+
+TEST(SetFilter_Empty_ShowsAllAgain)
+{
+    VcsNameList list;
+    list.Append(Names());
+    list.SetFilter(_("none"));
+    CHECK_EQUAL(0u, list.GetVisibleCount());
+
+    list.SetFilter(wxEmptyString);
+    CHECK_EQUAL(3u, list.GetVisibleCount());
+}
+
+TEST(Append_Sorted_MergesBatchesInOrder)
+{
+    VcsNameList list(true);
+    list.Append(Names());
+    std::vector<wxString> more;
+    more.push_back(_("hotfix"));
+    more.push_back(_("develop"));
+
+    CHECK_EQUAL(2u, list.Append(more));
+    CHECK_EQUAL(5u, list.GetVisibleCount());
+    CHECK(list.GetVisible(0) == _("develop"));
+    CHECK(list.GetVisible(1) == _("feature/Login"));
+    CHECK(list.GetVisible(2) == _("hotfix"));
+    CHECK(list.GetVisible(3) == _("main"));
+    CHECK(list.GetVisible(4) == _("release-1.0"));
+}
+
+TEST(SetFilter_Sorted_KeepsNameOrder)
+{
+    VcsNameList list(true);
+    list.Append(Names());
+
+    list.SetFilter(_("a"));
+    CHECK_EQUAL(2u, list.GetVisibleCount());
+    CHECK(list.GetVisible(0) == _("main"));
+    CHECK(list.GetVisible(1) == _("release-1.0"));
+}
+
+TEST(Clear_RemovesNames)
+{
+    VcsNameList list;
+    list.Append(Names());
+    list.Clear();
+
+    CHECK_EQUAL(0u, list.GetCount());
+    CHECK_EQUAL(0u, list.GetVisibleCount());
+}
+
+}
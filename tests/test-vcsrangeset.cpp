@@ -0,0 +1,84 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsRangeSet.h>
+
+namespace
+{
+
+TEST(Empty_ContainsNothing)
+{
+    VcsRangeSet set;
+
+    CHECK(set.IsEmpty());
+    CHECK(!set.Contains(0));
+    CHECK_EQUAL(0u, set.Count());
+}
+
+TEST(Add_ContainsOnlyTheRange)
+{
+    VcsRangeSet set;
+    set.Add(2, 5);
+
+    CHECK(!set.Contains(1));
+    CHECK(set.Contains(2));
+    CHECK(set.Contains(4));
+    CHECK(!set.Contains(5));
+    CHECK_EQUAL(3u, set.Count());
+}
+
+TEST(Add_OverlappingAndTouching_Merges)
+{
+    VcsRangeSet set;
+    set.Add(0, 3);
+    set.Add(5, 8);
+    set.Add(3, 5);
+    set.Add(7, 10);
+
+    CHECK_EQUAL(10u, set.Count());
+    CHECK(set.Contains(4));
+    CHECK(set.Contains(9));
+    CHECK(!set.Contains(10));
+}
+
+TEST(Remove_Middle_SplitsRange)
+{
+    VcsRangeSet set;
+    set.Add(0, 10);
+    set.Remove(3, 6);
+
+    CHECK(set.Contains(2));
+    CHECK(!set.Contains(3));
+    CHECK(!set.Contains(5));
+    CHECK(set.Contains(6));
+    CHECK_EQUAL(7u, set.Count());
+}
+
+TEST(Remove_AcrossRanges_TrimsEnds)
+{
+    VcsRangeSet set;
+    set.Add(0, 4);
+    set.Add(6, 8);
+    set.Add(10, 14);
+    set.Remove(2, 12);
+
+    CHECK(set.Contains(1));
+    CHECK(!set.Contains(2));
+    CHECK(!set.Contains(7));
+    CHECK(!set.Contains(11));
+    CHECK(set.Contains(12));
+    CHECK_EQUAL(4u, set.Count());
+}
+
+TEST(Set_ClearsAndMarks)
+{
+    VcsRangeSet set;
+    set.Set(0, 100, true);
+    set.Set(50, 51, false);
+
+    CHECK_EQUAL(99u, set.Count());
+    CHECK(!set.Contains(50));
+
+    set.Set(0, 100, false);
+    CHECK(set.IsEmpty());
+}
+
+}
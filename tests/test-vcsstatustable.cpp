@@ -0,0 +1,98 @@
+#include <UnitTest++/UnitTest++.h>
+#include <VcsStatusTable.h>
+
+namespace
+{
+
+TEST(Update_NewPath_ReportsChange)
+{
+    VcsStatusTable table;
+
+    CHECK_EQUAL(true, table.Update(_("src/a.cpp"), Item_UpToDate));
+}
+
+TEST(Update_SameState_ReportsNoChange)
+{
+    VcsStatusTable table;
+    table.Update(_("src/a.cpp"), Item_Modified);
+
+    CHECK_EQUAL(false, table.Update(_("src/a.cpp"), Item_Modified));
+}
+
+TEST(Update_ChangedFile_CountedInEveryParentFolder)
+{
+    VcsStatusTable table;
+    table.Update(_("src/ui/a.cpp"), Item_Modified);
+    table.Update(_("src/b.cpp"), Item_Added);
+    table.Update(_("c.cpp"), Item_Untracked);
+
+    CHECK_EQUAL(1u, table.GetCounts(_("src/ui")).modified);
+    CHECK_EQUAL(1u, table.GetCounts(_("src")).modified);
+    CHECK_EQUAL(1u, table.GetCounts(_("src")).added);
+    CHECK_EQUAL(0u, table.GetCounts(_("src")).untracked);
+    CHECK_EQUAL(1u, table.GetCounts(wxEmptyString).untracked);
+}
+
+TEST(Update_FileBecomesUpToDate_FolderCountsDropped)
+{
+    VcsStatusTable table;
+    table.Update(_("src/a.cpp"), Item_Conflicted);
+    table.Update(_("src/a.cpp"), Item_UpToDate);
+
+    CHECK_EQUAL(true, table.GetCounts(_("src")).IsEmpty());
+    CHECK_EQUAL(Item_UpToDate, table.GetCounts(wxEmptyString).GetState());
+}
+
+TEST(GetNextChanged_WrapsAroundWithinFolder)
+{
+    VcsStatusTable table;
+    table.Update(_("doc/readme"), Item_Modified);
+    table.Update(_("src/a.cpp"), Item_Modified);
+    table.Update(_("src/b.cpp"), Item_UpToDate);
+    table.Update(_("src/c.cpp"), Item_Added);
+    table.Update(_("src/d.cpp"), Item_Untracked);
+
+    wxString next;
+    CHECK_EQUAL(true, table.GetNextChanged(_("src"), _("src/a.cpp"), next));
+    CHECK_EQUAL(0, next.compare(_("src/c.cpp")));
+    CHECK_EQUAL(true, table.GetNextChanged(_("src"), _("src/c.cpp"), next));
+    CHECK_EQUAL(0, next.compare(_("src/a.cpp")));
+}
+
+TEST(GetNextChanged_RemovedAndMissing_Skipped)
+{
+    VcsStatusTable table;
+    table.Update(_("src/a.cpp"), Item_Removed);
+    table.Update(_("src/b.cpp"), Item_Missing);
+    table.Update(_("src/c.cpp"), Item_Modified);
+
+    wxString next;
+    CHECK_EQUAL(true, table.GetNextChanged(_("src"), wxEmptyString, next));
+    CHECK_EQUAL(0, next.compare(_("src/c.cpp")));
+    CHECK_EQUAL(true, table.GetNextChanged(_("src"), _("src/c.cpp"), next));
+    CHECK_EQUAL(0, next.compare(_("src/c.cpp")));
+    // Still counted in the folder summary
+    CHECK_EQUAL(3u, table.GetCounts(_("src")).modified);
+}
+
+TEST(HasChanged_OnlyRemovedFiles_ReturnsFalse)
+{
+    VcsStatusTable table;
+    table.Update(_("src/a.cpp"), Item_Removed);
+    table.Update(_("doc/readme"), Item_Modified);
+
+    CHECK_EQUAL(false, table.HasChanged(_("src")));
+    CHECK_EQUAL(true, table.HasChanged(_("doc")));
+    CHECK_EQUAL(true, table.HasChanged(wxEmptyString));
+}
+
+TEST(GetNextChanged_NoChangedFiles_ReturnsFalse)
+{
+    VcsStatusTable table;
+    table.Update(_("src/a.cpp"), Item_UpToDate);
+
+    wxString next;
+    CHECK_EQUAL(false, table.GetNextChanged(wxEmptyString, wxEmptyString, next));
+}
+
+}